@@ -22,9 +22,13 @@ bool SerializeDB(Stream& stream, const Data& data)
 {
     // Write and commit header, data
     try {
+        // Serialize once, into memory: data is only locked for that long, and
+        // what is written is exactly what was hashed even if data changes
+        CDataStream ssData(SER_DISK, CLIENT_VERSION);
+        ssData << FLATDATA(Params().MessageStart()) << data;
         CHashWriter hasher(SER_DISK, CLIENT_VERSION);
-        stream << FLATDATA(Params().MessageStart()) << data;
-        hasher << FLATDATA(Params().MessageStart()) << data;
+        hasher.write(ssData.data(), ssData.size());
+        stream.write(ssData.data(), ssData.size());
         stream << hasher.GetHash();
     } catch (const std::exception& e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
@@ -132,20 +132,39 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
     }
 }
 
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    vvNew[nUBucket][nUBucketPos] = nId;
+    newOccupancy.Set(nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos, nId != -1);
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    vvTried[nKBucket][nKBucketPos] = nId;
+    triedOccupancy.Set(nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos, nId != -1);
+}
+
+void CAddrMan::GetNewPosition(const uint256& nKeyIn, const CAddress& addr, const CNetAddr& source, int& nUBucket, int& nUBucketPos) const
+{
+    const CAddrInfo info(addr, source);
+    nUBucket = info.GetNewBucket(nKeyIn, source);
+    nUBucketPos = info.GetBucketPosition(nKeyIn, true, nUBucket);
+}
+
 void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 {
     // remove the entry from all new buckets
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -166,7 +185,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -177,12 +196,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -239,7 +258,7 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime)
     MakeTried(info, nId);
 }
 
-bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty)
+bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, int nUBucket, int nUBucketPos)
 {
     if (!addr.IsRoutable())
         return false;
@@ -288,8 +307,14 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    if (nUBucket == -1) {
+        nUBucket = pinfo->GetNewBucket(nKey, source);
+        nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    } else if (pinfo->GetPort() != addr.GetPort()) {
+        // The entry found has the same address but another port, and the
+        // position within the bucket depends on the port
+        nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    }
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
@@ -302,7 +327,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -346,15 +371,11 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
     if (!newOnly &&
        (nTried > 0 && (nNew == 0 || RandomInt(2) == 0))) { 
         // use a tried node
+        // Every occupied position is as likely, as with probing random positions until one is occupied
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
+            int nPosition = triedOccupancy[RandomInt(triedOccupancy.size())];
+            int nId = vvTried[nPosition / ADDRMAN_BUCKET_SIZE][nPosition % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -365,13 +386,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
+            int nPosition = newOccupancy[RandomInt(newOccupancy.size())];
+            int nId = vvNew[nPosition / ADDRMAN_BUCKET_SIZE][nPosition % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -421,9 +437,12 @@ int CAddrMan::Check_()
     if (mapNew.size() != nNew)
         return -10;
 
+    int nTriedPositions = 0;
+    int nNewPositions = 0;
     for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
              if (vvTried[n][i] != -1) {
+                 nTriedPositions++;
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
                  if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
@@ -438,6 +457,7 @@ int CAddrMan::Check_()
     for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
             if (vvNew[n][i] != -1) {
+                nNewPositions++;
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
                 if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
@@ -448,6 +468,11 @@ int CAddrMan::Check_()
         }
     }
 
+    if (triedOccupancy.size() != (size_t)nTriedPositions)
+        return -20;
+    if (newOccupancy.size() != (size_t)nNewPositions)
+        return -21;
+
     if (setTried.size())
         return -13;
     if (mapNew.size())
@@ -13,6 +13,7 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -176,6 +177,47 @@ public:
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
 
+/**
+ * The occupied positions of a bucket table, so that a random one can be picked
+ * in constant time however sparse the table is.
+ */
+class CAddrTableOccupancy
+{
+private:
+    //! occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position), in no particular order
+    std::vector<int> vOccupied;
+    //! index of every position in vOccupied, -1 if it is empty
+    std::vector<int> vIndex;
+
+public:
+    explicit CAddrTableOccupancy(int nPositions) : vIndex(nPositions, -1) {}
+
+    void Set(int nPosition, bool fOccupied)
+    {
+        if (fOccupied == (vIndex[nPosition] != -1))
+            return;
+        if (fOccupied) {
+            vIndex[nPosition] = vOccupied.size();
+            vOccupied.push_back(nPosition);
+        } else {
+            const int nLast = vOccupied.back();
+            vOccupied[vIndex[nPosition]] = nLast;
+            vIndex[nLast] = vIndex[nPosition];
+            vOccupied.pop_back();
+            vIndex[nPosition] = -1;
+        }
+    }
+
+    void Clear()
+    {
+        vOccupied.clear();
+        std::fill(vIndex.begin(), vIndex.end(), -1);
+    }
+
+    size_t size() const { return vOccupied.size(); }
+    int operator[](size_t n) const { return vOccupied[n]; }
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -209,6 +251,10 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions of vvTried and vvNew, to select from
+    CAddrTableOccupancy triedOccupancy;
+    CAddrTableOccupancy newOccupancy;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
@@ -238,11 +284,19 @@ protected:
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos);
 
+    //! Store nId (or -1 for none) at a position of the "new" or "tried" table; all writes to them go through these.
+    void SetNew(int nUBucket, int nUBucketPos, int nId);
+    void SetTried(int nKBucket, int nKBucketPos, int nId);
+
+    //! Where addr, heard about from source, goes in the "new" table.
+    void GetNewPosition(const uint256& nKeyIn, const CAddress& addr, const CNetAddr& source, int& nUBucket, int& nUBucketPos) const;
+
     //! Mark an entry "good", possibly moving it from "new" to "tried".
     void Good_(const CService &addr, int64_t nTime);
 
-    //! Add an entry to the "new" table.
-    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty);
+    //! Add an entry to the "new" table. nUBucket and nUBucketPos may give its
+    //! position as found by GetNewPosition with the current nKey, or be -1.
+    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty, int nUBucket = -1, int nUBucketPos = -1);
 
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime);
@@ -389,7 +443,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -409,7 +463,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -429,7 +483,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -467,6 +521,8 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        newOccupancy.Clear();
+        triedOccupancy.Clear();
 
         nIdCount = 0;
         nTried = 0;
@@ -476,7 +532,9 @@ public:
         mapAddr.clear();
     }
 
-    CAddrMan()
+    CAddrMan() :
+        triedOccupancy(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE),
+        newOccupancy(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE)
     {
         Clear();
     }
@@ -523,11 +581,29 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        // Hashing out the positions is most of the work; do it before taking the lock
+        uint256 nKeyUsed;
+        {
+            LOCK(cs);
+            nKeyUsed = nKey;
+        }
+        std::vector<std::pair<int, int>> vPositions(vAddr.size(), std::make_pair(-1, -1));
+        for (size_t i = 0; i < vAddr.size(); i++) {
+            if (vAddr[i].IsRoutable())
+                GetNewPosition(nKeyUsed, vAddr[i], source, vPositions[i].first, vPositions[i].second);
+        }
+
         LOCK(cs);
+        // Unless the table was cleared meanwhile
+        const bool fPositionsValid = nKeyUsed == nKey;
         int nAdd = 0;
         Check();
-        for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-            nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+        for (size_t i = 0; i < vAddr.size(); i++) {
+            if (fPositionsValid)
+                nAdd += Add_(vAddr[i], source, nTimePenalty, vPositions[i].first, vPositions[i].second) ? 1 : 0;
+            else
+                nAdd += Add_(vAddr[i], source, nTimePenalty) ? 1 : 0;
+        }
         Check();
         if (nAdd) {
             LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bantrie.h"
+
+#include <algorithm>
+#include <string.h>
+
+static inline int GetBit(const uint8_t* vchKey, int nBit)
+{
+    return (vchKey[nBit >> 3] >> (7 - (nBit & 7))) & 1;
+}
+
+/** Number of leading bits, up to nMax, that two keys share */
+static int CommonPrefix(const uint8_t* a, const uint8_t* b, int nMax)
+{
+    int n = 0;
+    while (n < nMax) {
+        const uint8_t x = a[n >> 3] ^ b[n >> 3];
+        if (x == 0) {
+            n += 8;
+            continue;
+        }
+        int nBit = 0;
+        while (!(x & (0x80 >> nBit)))
+            nBit++;
+        return std::min(n + nBit, nMax);
+    }
+    return nMax;
+}
+
+/** Whether the key has no bits set past the first nBits */
+static bool IsPrefix(const uint8_t* vchKey, int nBits)
+{
+    for (int nBit = nBits; nBit < 128; nBit++) {
+        if (GetBit(vchKey, nBit))
+            return false;
+    }
+    return true;
+}
+
+static void GetAddressBytes(const CNetAddr& addr, uint8_t* vchKey)
+{
+    for (int i = 0; i < 16; i++)
+        vchKey[i] = addr.GetByte(15 - i);
+}
+
+void CBanTrie::Clear()
+{
+    vNodes.clear();
+    vOther.clear();
+    const uint8_t vchEmpty[16] = {};
+    NewNode(vchEmpty, 0);
+}
+
+void CBanTrie::Reset(const banmap_t& banMap)
+{
+    Clear();
+    for (const std::pair<const CSubNet, CBanEntry>& item : banMap)
+        Insert(item.first, item.second.nBanUntil);
+}
+
+int32_t CBanTrie::NewNode(const uint8_t* vchKey, int nBits)
+{
+    Node node;
+    memset(node.vchPrefix, 0, sizeof(node.vchPrefix));
+    memcpy(node.vchPrefix, vchKey, (nBits + 7) / 8);
+    if (nBits % 8)
+        node.vchPrefix[nBits / 8] &= (uint8_t)(0xff << (8 - nBits % 8));
+    node.nBanUntil = 0;
+    node.children[0] = node.children[1] = -1;
+    node.nBits = nBits;
+    node.fBanned = false;
+    vNodes.push_back(node);
+    return vNodes.size() - 1;
+}
+
+void CBanTrie::Insert(const CSubNet& subNet, int64_t nBanUntil)
+{
+    if (!subNet.IsValid())
+        return;
+
+    // A netmask that is not a prefix, or a network with bits outside of it
+    // (never matched by CSubNet), cannot be placed in the trie
+    const int nBits = subNet.GetPrefixLength();
+    uint8_t vchKey[16];
+    GetAddressBytes(subNet.GetNetwork(), vchKey);
+    if (nBits < 0 || !IsPrefix(vchKey, nBits)) {
+        for (std::pair<CSubNet, int64_t>& item : vOther) {
+            if (item.first == subNet) {
+                item.second = nBanUntil;
+                return;
+            }
+        }
+        vOther.emplace_back(subNet, nBanUntil);
+        return;
+    }
+
+    // Nodes are referred to by index, as adding one may move the others
+    int32_t nNode = 0;
+    while (true) {
+        if (vNodes[nNode].nBits == nBits) {
+            vNodes[nNode].fBanned = true;
+            vNodes[nNode].nBanUntil = nBanUntil;
+            return;
+        }
+        const int nBranch = GetBit(vchKey, vNodes[nNode].nBits);
+        const int32_t nChild = vNodes[nNode].children[nBranch];
+        if (nChild < 0) {
+            const int32_t nLeaf = NewNode(vchKey, nBits);
+            vNodes[nLeaf].fBanned = true;
+            vNodes[nLeaf].nBanUntil = nBanUntil;
+            vNodes[nNode].children[nBranch] = nLeaf;
+            return;
+        }
+        const int nChildBits = vNodes[nChild].nBits;
+        const int nCommon = CommonPrefix(vchKey, vNodes[nChild].vchPrefix, std::min(nBits, nChildBits));
+        if (nCommon == nChildBits) {
+            nNode = nChild;
+            continue;
+        }
+
+        // The new prefix branches off inside the child's; split it there
+        const int32_t nSplit = NewNode(vchKey, nCommon);
+        vNodes[nSplit].children[GetBit(vNodes[nChild].vchPrefix, nCommon)] = nChild;
+        vNodes[nNode].children[nBranch] = nSplit;
+        if (nCommon == nBits) {
+            vNodes[nSplit].fBanned = true;
+            vNodes[nSplit].nBanUntil = nBanUntil;
+        } else {
+            const int32_t nLeaf = NewNode(vchKey, nBits);
+            vNodes[nLeaf].fBanned = true;
+            vNodes[nLeaf].nBanUntil = nBanUntil;
+            vNodes[nSplit].children[GetBit(vchKey, nCommon)] = nLeaf;
+        }
+        return;
+    }
+}
+
+bool CBanTrie::Match(const CNetAddr& addr, int64_t nNow) const
+{
+    if (!addr.IsValid())
+        return false;
+
+    uint8_t vchKey[16];
+    GetAddressBytes(addr, vchKey);
+    int32_t nNode = 0;
+    while (nNode >= 0) {
+        const Node& node = vNodes[nNode];
+        if (CommonPrefix(vchKey, node.vchPrefix, node.nBits) < node.nBits)
+            break;
+        if (node.fBanned && nNow < node.nBanUntil)
+            return true;
+        if (node.nBits == 128)
+            break;
+        nNode = node.children[GetBit(vchKey, node.nBits)];
+    }
+
+    for (const std::pair<CSubNet, int64_t>& item : vOther) {
+        if (nNow < item.second && item.first.Match(addr))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BANTRIE_H
+#define BITCOIN_BANTRIE_H
+
+#include "addrdb.h"
+#include "netaddress.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Index of banned subnets for looking up whether an address is banned.
+ * Subnets are kept in a path-compressed binary trie over the 128 bits of the
+ * address (IPv4 addresses being IPv4-mapped, like in CNetAddr), so a lookup
+ * follows one path from the root and costs O(prefix length) no matter how
+ * many subnets are banned. The rare netmasks that are not a prefix are
+ * checked one by one.
+ *
+ * Expired bans are skipped by lookups and only dropped when the index is
+ * rebuilt from the ban list after a sweep. Not thread-safe; CConnman keeps it
+ * next to setBanned under cs_setBanned.
+ */
+class CBanTrie
+{
+public:
+    CBanTrie() { Clear(); }
+
+    void Clear();
+    /** Replace the index with the subnets of a ban list */
+    void Reset(const banmap_t& banMap);
+    /** Ban a subnet until nBanUntil, replacing any earlier time for it */
+    void Insert(const CSubNet& subNet, int64_t nBanUntil);
+    /** Whether a subnet containing addr is banned beyond nNow */
+    bool Match(const CNetAddr& addr, int64_t nNow) const;
+
+    size_t GetNodeCount() const { return vNodes.size(); }
+
+private:
+    struct Node {
+        //! Bits of the prefix this node stands for; those past nBits are zero
+        uint8_t vchPrefix[16];
+        int64_t nBanUntil;
+        //! Indices in vNodes of the subtrees continuing with a 0 and a 1 bit, or -1
+        int32_t children[2];
+        uint8_t nBits;
+        //! Whether the prefix itself is banned
+        bool fBanned;
+    };
+
+    //! vNodes[0] is the root, the empty prefix
+    std::vector<Node> vNodes;
+    std::vector<std::pair<CSubNet, int64_t>> vOther;
+
+    int32_t NewNode(const uint8_t* vchKey, int nBits);
+};
+
+#endif // BITCOIN_BANTRIE_H
@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bloom.h"
+#include "merkleblock.h"
+#include "random.h"
+
+#include <limits>
+#include <vector>
+
+static const int FILTERING_PEERS = 300;
+static const int BLOCK_TXS = 1000;
+
+static std::vector<unsigned char> RandomBytes(FastRandomContext& rand, size_t nSize)
+{
+    std::vector<unsigned char> vch(nSize);
+    for (unsigned char& ch : vch)
+        ch = rand.randbits(8);
+    return vch;
+}
+
+// A block of typical P2PKH spends, and one wallet filter per peer with a
+// handful of the block's addresses in a few of them
+static void MakeBlockAndFilters(CBlock& block, std::vector<CBloomFilter>& vFilters)
+{
+    FastRandomContext rand(true);
+    std::vector<std::vector<unsigned char> > vKeyIds;
+    for (int i = 0; i < BLOCK_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        for (CTxIn& txin : tx.vin) {
+            txin.prevout = COutPoint(rand.rand256(), rand.randrange(3));
+            txin.scriptSig = CScript() << RandomBytes(rand, 72) << RandomBytes(rand, 33);
+        }
+        tx.vout.resize(2);
+        for (CTxOut& txout : tx.vout) {
+            vKeyIds.push_back(RandomBytes(rand, 20));
+            txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vKeyIds.back() << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    for (int i = 0; i < FILTERING_PEERS; i++) {
+        CBloomFilter filter(100, 0.0001, rand.rand32(), BLOOM_UPDATE_ALL);
+        for (int j = 0; j < 20; j++)
+            filter.insert(RandomBytes(rand, 20));
+        if (i % 10 == 0)
+            filter.insert(vKeyIds[rand.randrange(vKeyIds.size())]);
+        vFilters.push_back(filter);
+    }
+}
+
+static void BloomFilterBlock(benchmark::State& state)
+{
+    CBlock block;
+    std::vector<CBloomFilter> vFilters;
+    MakeBlockAndFilters(block, vFilters);
+    while (state.KeepRunning()) {
+        for (const CBloomFilter& filter : vFilters) {
+            CBloomFilter peerFilter(filter);
+            CMerkleBlock merkleBlock(block, peerFilter);
+        }
+    }
+}
+
+static void BloomFilterBlockShared(benchmark::State& state)
+{
+    CBlock block;
+    std::vector<CBloomFilter> vFilters;
+    MakeBlockAndFilters(block, vFilters);
+    while (state.KeepRunning()) {
+        CBloomElementsCache cache(BLOCK_TXS, std::numeric_limits<size_t>::max());
+        std::vector<uint256> vTxid;
+        for (const CTransactionRef& tx : block.vtx)
+            vTxid.push_back(tx->GetHash());
+        const std::vector<std::vector<uint256> > vTreeLevels = CPartialMerkleTree::CalcTreeLevels(vTxid);
+        for (const CBloomFilter& filter : vFilters) {
+            CBloomFilter peerFilter(filter);
+            CMerkleBlock merkleBlock(block, peerFilter, &cache, &vTreeLevels);
+        }
+    }
+}
+
+BENCHMARK(BloomFilterBlock);
+BENCHMARK(BloomFilterBlockShared);
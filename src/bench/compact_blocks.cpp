@@ -0,0 +1,82 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "blockencodings.h"
+#include "txmempool.h"
+
+#include <vector>
+
+static const size_t MEMPOOL_SIZE = 20000;
+static const size_t BLOCK_TXS = 2000;
+
+// A mempool of independent transactions and a block made of the ones with
+// the best feerate, as a miner with the same mempool would build it.
+static void FillMempoolAndBlock(CTxMemPool& pool, CBlock& block)
+{
+    block.nBits = 0x207fffff;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    LockPoints lp;
+    for (size_t i = 0; i < MEMPOOL_SIZE; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        CAmount nFee = 1000 + (MEMPOOL_SIZE - i);
+        pool.addUnchecked(ptx->GetHash(), CTxMemPoolEntry(ptx, nFee, 0, 1, false, 4, lp));
+        if (i < BLOCK_TXS)
+            block.vtx.push_back(ptx);
+    }
+}
+
+// Reconstruct a compact block whose transactions are all in the mempool.
+static void CompactBlockReconstruct(benchmark::State& state)
+{
+    CTxMemPool pool;
+    CBlock block;
+    FillMempoolAndBlock(pool, block);
+    CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partialBlock(&pool);
+        bool ret = partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK;
+        assert(ret);
+        assert(partialBlock.IsTxAvailable(BLOCK_TXS));
+    }
+}
+
+// Reconstruct a compact block with one transaction we have not seen, which
+// requires looking at the whole mempool.
+static void CompactBlockReconstructMissing(benchmark::State& state)
+{
+    CTxMemPool pool;
+    CBlock block;
+    FillMempoolAndBlock(pool, block);
+    CMutableTransaction unknown;
+    unknown.vin.resize(1);
+    unknown.vout.resize(1);
+    unknown.vout[0].nValue = 42;
+    block.vtx.push_back(MakeTransactionRef(unknown));
+    CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partialBlock(&pool);
+        bool ret = partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK;
+        assert(ret);
+        assert(!partialBlock.IsTxAvailable(BLOCK_TXS + 1));
+    }
+}
+
+BENCHMARK(CompactBlockReconstruct);
+BENCHMARK(CompactBlockReconstructMissing);
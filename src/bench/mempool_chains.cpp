@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        MakeTransactionRef(tx), nFee, nTime, nHeight,
+                                        spendsCoinbase, sigOpCost, lp));
+}
+
+// A chain of transactions each spending the change output of the previous
+// one, as created by a busy hot wallet.
+static std::vector<CTransactionRef> CreateChain(size_t nLength)
+{
+    std::vector<CTransactionRef> chain;
+    chain.reserve(nLength);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(2);
+    for (size_t i = 0; i < nLength; i++) {
+        tx.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[1].nValue = 1000 * COIN - i * COIN;
+        chain.push_back(MakeTransactionRef(tx));
+        tx.vin[0].prevout = COutPoint(chain.back()->GetHash(), 1);
+    }
+    return chain;
+}
+
+// Add a long unconfirmed chain one transaction at a time, then confirm it
+// block by block from the front, as happens for an exchange hot wallet.
+static void MempoolChainAddAndConfirm(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> chain = CreateChain(100);
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : chain) {
+            AddTx(*tx, 1000LL, pool);
+        }
+        for (size_t i = 0; i < chain.size(); i += 10) {
+            std::vector<CTransactionRef> block(chain.begin() + i, chain.begin() + std::min(i + 10, chain.size()));
+            pool.removeForBlock(block, 1);
+        }
+    }
+}
+
+// Repeatedly compute the ancestor set of the tail of a long chain, as
+// getmempoolancestors and package limit checks do.
+static void MempoolChainAncestors(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> chain = CreateChain(100);
+    CTxMemPool pool;
+    for (const CTransactionRef& tx : chain) {
+        AddTx(*tx, 1000LL, pool);
+    }
+
+    LOCK(pool.cs);
+    CTxMemPool::txiter tail = pool.mapTx.find(chain.back()->GetHash());
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries setAncestors;
+        pool.CalculateMemPoolAncestors(*tail, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        assert(setAncestors.size() == chain.size() - 1);
+    }
+}
+
+BENCHMARK(MempoolChainAddAndConfirm);
+BENCHMARK(MempoolChainAncestors);
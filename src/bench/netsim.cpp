@@ -0,0 +1,549 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Transaction relay over a small network of nodes on this machine.
+ *
+ * Every node is a child process with its own regtest chainstate, listening on
+ * loopback and connected to a few of the nodes started before it. All nodes
+ * begin with the same made-up coins, so transactions spending them are valid
+ * everywhere without mining. Node 0 submits such transactions at a fixed rate;
+ * every node tells when each one reached its mempool, how many bytes it sent
+ * and received and how much CPU time it used meanwhile.
+ *
+ * The parent process only steers the nodes through pipes and prints the
+ * results, so nothing of one node's global state leaks into another.
+ */
+
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "fs.h"
+#include "key.h"
+#include "keystore.h"
+#include "net.h"
+#include "net_processing.h"
+#include "netbase.h"
+#include "pubkey.h"
+#include "random.h"
+#include "scheduler.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "validationinterface.h"
+#include "version.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const int DEFAULT_NODES = 4;
+static const int DEFAULT_PEERS = 2;
+static const int DEFAULT_TXS = 200;
+static const int DEFAULT_TX_RATE = 20;
+static const int DEFAULT_BASE_PORT = 29500;
+static const int DEFAULT_TIMEOUT = 120;
+
+//! Outpoints of the coins every node starts with; no transaction has this id
+static const uint256 hashFunding = uint256S("6e657473696d");
+static const CAmount FUNDING_VALUE = COIN;
+static const CAmount TX_FEE = COIN / 1000;
+
+//! One-byte messages between the parent and the nodes
+enum : char {
+    MSG_READY = 'R',
+    MSG_CONNECT = 'C',
+    MSG_GO = 'G',
+    MSG_DONE = 'D',
+    MSG_STOP = 'S',
+    MSG_FAILED = 'F',
+};
+
+//! A node's own, as in init.cpp; node processes end with _exit, so these are
+//! never torn down while its threads still use them
+static CScheduler scheduler;
+static std::unique_ptr<PeerLogicValidation> peerLogic;
+
+struct SimConfig {
+    int nNodes;
+    int nTxs;
+    int nTxRate;
+    int nBasePort;
+    int nTimeout;
+    //! Nodes each node connects out to
+    std::vector<std::vector<int>> vOutbound;
+    //! Connections each node ends up with, in and out
+    std::vector<int> vDegree;
+};
+
+struct NodeReport {
+    //! When each transaction entered the mempool, in microseconds since the epoch
+    std::vector<std::pair<uint256, int64_t>> vArrivals;
+    uint64_t nBytesSent;
+    uint64_t nBytesRecv;
+    int64_t nCpuMicros;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(vArrivals);
+        READWRITE(nBytesSent);
+        READWRITE(nBytesRecv);
+        READWRITE(nCpuMicros);
+    }
+};
+
+static bool WriteAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool SendMsg(int fd, char msg)
+{
+    return WriteAll(fd, &msg, 1);
+}
+
+static bool ExpectMsg(int fd, char msg)
+{
+    char received;
+    return ReadAll(fd, &received, 1) && received == msg;
+}
+
+static int64_t GetCpuMicros()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static CKey GetFundingKey()
+{
+    std::vector<unsigned char> vchSecret(32, 1);
+    CKey key;
+    key.Set(vchSecret.begin(), vchSecret.end(), true);
+    return key;
+}
+
+/** Spend funding coin n to two outputs, signed like a wallet would */
+static CTransactionRef MakeTransaction(const CKeyStore& keystore, const CScript& scriptFunding, uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(hashFunding, n));
+    tx.vout.emplace_back((FUNDING_VALUE - TX_FEE) / 2, scriptFunding);
+    tx.vout.emplace_back((FUNDING_VALUE - TX_FEE) / 2, scriptFunding);
+    if (!SignSignature(keystore, scriptFunding, tx, 0, FUNDING_VALUE, SIGHASH_ALL))
+        throw std::runtime_error("SignSignature failed");
+    return MakeTransactionRef(std::move(tx));
+}
+
+static size_t CountPeers(CConnman& connman)
+{
+    size_t nPeers = 0;
+    connman.ForEachNode([&nPeers](CNode* pnode) { nPeers++; });
+    return nPeers;
+}
+
+/** Run node nNode until told to stop; throws on failure */
+static void RunNode(const SimConfig& config, int nNode, const fs::path& pathNode, int fdCtl, int fdRep)
+{
+    SHA256AutoDetect();
+    RandomInit();
+    ECC_Start();
+    ECCVerifyHandle globalVerifyHandle;
+    SetupEnvironment();
+    SetupNetworking();
+    InitSignatureCache();
+    InitScriptExecutionCache();
+    fPrintToDebugLog = false;
+    SelectParams(CBaseChainParams::REGTEST);
+    const CChainParams& chainparams = Params();
+
+    fs::create_directories(pathNode);
+    gArgs.ForceSetArg("-datadir", pathNode.string());
+    ClearDatadirCache();
+    // Only the connections made below, never seeds or addresses learnt from peers
+    gArgs.ForceSetArg("-dnsseed", "0");
+    gArgs.ForceSetArg("-connect", "0");
+    // The regtest genesis block is old; nodes that believe they are still in
+    // initial block download would not ask for transactions
+    nMaxTipAge = std::numeric_limits<int64_t>::max() / 2;
+
+    std::thread threadScheduler(std::bind(&CScheduler::serviceQueue, &scheduler));
+    threadScheduler.detach();
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    if (!LoadGenesisBlock(chainparams))
+        throw std::runtime_error("LoadGenesisBlock failed");
+    {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams))
+            throw std::runtime_error("ActivateBestChain failed");
+    }
+
+    const CKey key = GetFundingKey();
+    const CScript scriptFunding = GetScriptForDestination(key.GetPubKey().GetID());
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < config.nTxs; i++)
+            pcoinsTip->AddCoin(COutPoint(hashFunding, i), Coin(CTxOut(FUNDING_VALUE, scriptFunding), 1, false), false);
+    }
+
+    CCriticalSection cs_arrivals;
+    NodeReport report;
+    mempool.NotifyEntryAdded.connect([&cs_arrivals, &report](CTransactionRef tx) {
+        const int64_t nNow = GetTimeMicros();
+        LOCK(cs_arrivals);
+        report.vArrivals.emplace_back(tx->GetHash(), nNow);
+    });
+
+    g_connman = std::unique_ptr<CConnman>(new CConnman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())));
+    CConnman& connman = *g_connman;
+    peerLogic.reset(new PeerLogicValidation(&connman, scheduler));
+    RegisterValidationInterface(peerLogic.get());
+
+    CConnman::Options connOptions;
+    connOptions.nLocalServices = ServiceFlags(NODE_NETWORK | NODE_WITNESS);
+    connOptions.nRelevantServices = NODE_NETWORK;
+    connOptions.nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
+    connOptions.nMaxOutbound = MAX_OUTBOUND_CONNECTIONS;
+    connOptions.nMaxAddnode = MAX_ADDNODE_CONNECTIONS;
+    connOptions.nBestHeight = 0;
+    connOptions.m_msgproc = peerLogic.get();
+    connOptions.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    connOptions.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    connOptions.vBinds.push_back(CService(CNetAddr(in_addr{htonl(INADDR_LOOPBACK)}), config.nBasePort + nNode));
+    if (!connman.Start(scheduler, connOptions))
+        throw std::runtime_error(strprintf("cannot listen on port %d", config.nBasePort + nNode));
+
+    // Everyone listens before anyone connects
+    if (!SendMsg(fdRep, MSG_READY) || !ExpectMsg(fdCtl, MSG_CONNECT))
+        return;
+    for (int nPeer : config.vOutbound[nNode]) {
+        const std::string strDest = strprintf("127.0.0.1:%d", config.nBasePort + nPeer);
+        connman.OpenNetworkConnection(CAddress(), false, nullptr, strDest.c_str(), false, false, true);
+    }
+    const int64_t nConnectDeadline = GetTimeMillis() + config.nTimeout * 1000;
+    while (CountPeers(connman) < (size_t)config.vDegree[nNode]) {
+        if (GetTimeMillis() > nConnectDeadline)
+            throw std::runtime_error("timed out connecting to peers");
+        MilliSleep(10);
+    }
+
+    std::vector<CTransactionRef> vTxs;
+    if (nNode == 0) {
+        CBasicKeyStore keystore;
+        keystore.AddKey(key);
+        for (int i = 0; i < config.nTxs; i++)
+            vTxs.push_back(MakeTransaction(keystore, scriptFunding, i));
+    }
+
+    if (!SendMsg(fdRep, MSG_CONNECT) || !ExpectMsg(fdCtl, MSG_GO))
+        return;
+    const int64_t nCpuStart = GetCpuMicros();
+    const uint64_t nSentStart = connman.GetTotalBytesSent();
+    const uint64_t nRecvStart = connman.GetTotalBytesRecv();
+    const int64_t nStart = GetTimeMicros();
+
+    for (size_t i = 0; i < vTxs.size(); i++) {
+        const int64_t nDue = nStart + (int64_t)i * 1000000 / config.nTxRate;
+        const int64_t nNow = GetTimeMicros();
+        if (nDue > nNow)
+            std::this_thread::sleep_for(std::chrono::microseconds(nDue - nNow));
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            bool fMissingInputs;
+            if (!AcceptToMemoryPool(mempool, state, vTxs[i], false, &fMissingInputs))
+                throw std::runtime_error("transaction rejected: " + FormatStateMessage(state));
+        }
+        // As sendrawtransaction does
+        const CInv inv(MSG_TX, vTxs[i]->GetHash());
+        connman.ForEachNode([&inv](CNode* pnode) { pnode->PushInventory(inv); });
+    }
+
+    // Keep relaying until every node has everything, or time runs out
+    const int64_t nDeadline = nStart + (int64_t)config.nTimeout * 1000000;
+    while (GetTimeMicros() < nDeadline) {
+        {
+            LOCK(cs_arrivals);
+            if (report.vArrivals.size() >= (size_t)config.nTxs)
+                break;
+        }
+        MilliSleep(10);
+    }
+    if (!SendMsg(fdRep, MSG_DONE) || !ExpectMsg(fdCtl, MSG_STOP))
+        return;
+
+    report.nBytesSent = connman.GetTotalBytesSent() - nSentStart;
+    report.nBytesRecv = connman.GetTotalBytesRecv() - nRecvStart;
+    report.nCpuMicros = GetCpuMicros() - nCpuStart;
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(cs_arrivals);
+        ss << report;
+    }
+    const uint32_t nSize = ss.size();
+    WriteAll(fdRep, (const char*)&nSize, sizeof(nSize));
+    WriteAll(fdRep, ss.data(), ss.size());
+}
+
+/** Each node connects to up to nPeers random nodes started before it */
+static void MakeTopology(SimConfig& config, int nPeers)
+{
+    FastRandomContext rng(true);
+    config.vOutbound.assign(config.nNodes, std::vector<int>());
+    config.vDegree.assign(config.nNodes, 0);
+    for (int i = 1; i < config.nNodes; i++) {
+        std::vector<int> vCandidates;
+        for (int j = 0; j < i; j++)
+            vCandidates.push_back(j);
+        while (!vCandidates.empty() && (int)config.vOutbound[i].size() < nPeers) {
+            const size_t nPick = rng.randrange(vCandidates.size());
+            const int nPeer = vCandidates[nPick];
+            vCandidates.erase(vCandidates.begin() + nPick);
+            config.vOutbound[i].push_back(nPeer);
+            config.vDegree[i]++;
+            config.vDegree[nPeer]++;
+        }
+    }
+}
+
+/** Hops from node 0 to every node */
+static std::vector<int> GetHops(const SimConfig& config)
+{
+    std::vector<std::vector<int>> vAdjacent(config.nNodes);
+    for (int i = 0; i < config.nNodes; i++) {
+        for (int nPeer : config.vOutbound[i]) {
+            vAdjacent[i].push_back(nPeer);
+            vAdjacent[nPeer].push_back(i);
+        }
+    }
+    std::vector<int> vHops(config.nNodes, -1);
+    std::queue<int> queue;
+    vHops[0] = 0;
+    queue.push(0);
+    while (!queue.empty()) {
+        const int nNode = queue.front();
+        queue.pop();
+        for (int nPeer : vAdjacent[nNode]) {
+            if (vHops[nPeer] < 0) {
+                vHops[nPeer] = vHops[nNode] + 1;
+                queue.push(nPeer);
+            }
+        }
+    }
+    return vHops;
+}
+
+static double Percentile(std::vector<int64_t>& vValues, double dFraction)
+{
+    if (vValues.empty())
+        return 0;
+    std::sort(vValues.begin(), vValues.end());
+    const size_t nIndex = std::min(vValues.size() - 1, (size_t)(dFraction * vValues.size()));
+    return vValues[nIndex];
+}
+
+static void PrintReports(const SimConfig& config, const std::vector<NodeReport>& vReports)
+{
+    std::map<uint256, int64_t> mapSubmitted(vReports[0].vArrivals.begin(), vReports[0].vArrivals.end());
+    const std::vector<int> vHops = GetHops(config);
+    const double nTxs = std::max<size_t>(1, mapSubmitted.size());
+
+    uint64_t nTotalSent = 0;
+    int64_t nTotalCpu = 0;
+    printf("#Node,hops,txs,median_ms,p90_ms,max_ms,sent_per_tx,recv_per_tx,cpu_ms\n");
+    for (int i = 0; i < config.nNodes; i++) {
+        const NodeReport& report = vReports[i];
+        std::vector<int64_t> vLatencies;
+        for (const std::pair<uint256, int64_t>& arrival : report.vArrivals) {
+            auto it = mapSubmitted.find(arrival.first);
+            if (it != mapSubmitted.end())
+                vLatencies.push_back(arrival.second - it->second);
+        }
+        const size_t nReceived = vLatencies.size();
+        const double dMedian = Percentile(vLatencies, 0.5);
+        const double dP90 = Percentile(vLatencies, 0.9);
+        const double dMax = vLatencies.empty() ? 0 : vLatencies.back();
+        printf("%d,%d,%u,%.2f,%.2f,%.2f,%.1f,%.1f,%.1f\n", i, vHops[i], (unsigned int)nReceived,
+            dMedian / 1000, dP90 / 1000, dMax / 1000,
+            report.nBytesSent / nTxs, report.nBytesRecv / nTxs, report.nCpuMicros / 1000.0);
+        nTotalSent += report.nBytesSent;
+        nTotalCpu += report.nCpuMicros;
+    }
+    printf("#Total,bytes_per_tx,cpu_us_per_tx\n");
+    printf("%d,%.1f,%.1f\n", config.nNodes, nTotalSent / nTxs, nTotalCpu / nTxs);
+}
+
+struct ChildNode {
+    pid_t pid;
+    int fdCtl;
+    int fdRep;
+};
+
+static bool ExpectFromAll(const std::vector<ChildNode>& vChildren, char msg)
+{
+    for (const ChildNode& child : vChildren) {
+        if (!ExpectMsg(child.fdRep, msg))
+            return false;
+    }
+    return true;
+}
+
+static void SendToAll(const std::vector<ChildNode>& vChildren, char msg)
+{
+    for (const ChildNode& child : vChildren)
+        SendMsg(child.fdCtl, msg);
+}
+
+static bool RunSimulation(const SimConfig& config, const fs::path& pathSim, std::vector<NodeReport>& vReports)
+{
+    std::vector<ChildNode> vChildren;
+    for (int i = 0; i < config.nNodes; i++) {
+        int fdsCtl[2], fdsRep[2];
+        if (pipe(fdsCtl) != 0 || pipe(fdsRep) != 0)
+            return false;
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0)
+            return false;
+        if (pid == 0) {
+            close(fdsCtl[1]);
+            close(fdsRep[0]);
+            try {
+                RunNode(config, i, pathSim / strprintf("node%d", i), fdsCtl[0], fdsRep[1]);
+            } catch (const std::exception& e) {
+                fprintf(stderr, "node %d: %s\n", i, e.what());
+            }
+            // Whatever the parent was waiting for, this is not it
+            SendMsg(fdsRep[1], MSG_FAILED);
+            _exit(0);
+        }
+        close(fdsCtl[0]);
+        close(fdsRep[1]);
+        vChildren.push_back(ChildNode{pid, fdsCtl[1], fdsRep[0]});
+    }
+
+    bool fSuccess = ExpectFromAll(vChildren, MSG_READY);
+    if (fSuccess) {
+        SendToAll(vChildren, MSG_CONNECT);
+        fSuccess = ExpectFromAll(vChildren, MSG_CONNECT);
+    }
+    if (fSuccess) {
+        SendToAll(vChildren, MSG_GO);
+        fSuccess = ExpectFromAll(vChildren, MSG_DONE);
+    }
+    if (fSuccess) {
+        SendToAll(vChildren, MSG_STOP);
+        for (const ChildNode& child : vChildren) {
+            uint32_t nSize;
+            if (!ReadAll(child.fdRep, (char*)&nSize, sizeof(nSize))) {
+                fSuccess = false;
+                break;
+            }
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.resize(nSize);
+            if (!ReadAll(child.fdRep, ss.data(), nSize)) {
+                fSuccess = false;
+                break;
+            }
+            vReports.emplace_back();
+            ss >> vReports.back();
+        }
+    }
+
+    for (const ChildNode& child : vChildren) {
+        kill(child.pid, SIGKILL);
+        waitpid(child.pid, nullptr, 0);
+        close(child.fdCtl);
+        close(child.fdRep);
+    }
+    return fSuccess;
+}
+
+int
+main(int argc, char** argv)
+{
+    gArgs.ParseParameters(argc, argv);
+    if (gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help")) {
+        printf("Usage: bench_ovato_netsim [options]\n\n"
+               "Relay transactions over a network of regtest nodes on loopback and report\n"
+               "their propagation latency, bytes per transaction and CPU time per node.\n\n"
+               "  -numnodes=<n>  Nodes to run (default: %d)\n"
+               "  -peers=<n>     Outbound connections per node (default: %d)\n"
+               "  -txs=<n>       Transactions to relay (default: %d)\n"
+               "  -txrate=<n>    Transactions submitted per second (default: %d)\n"
+               "  -port=<port>   First of the ports the nodes listen on (default: %d)\n"
+               "  -timeout=<n>   Seconds to wait for connections and relay (default: %d)\n",
+               DEFAULT_NODES, DEFAULT_PEERS, DEFAULT_TXS, DEFAULT_TX_RATE, DEFAULT_BASE_PORT, DEFAULT_TIMEOUT);
+        return 0;
+    }
+
+    SimConfig config;
+    config.nNodes = std::max<int64_t>(2, gArgs.GetArg("-numnodes", DEFAULT_NODES));
+    config.nTxs = std::max<int64_t>(1, gArgs.GetArg("-txs", DEFAULT_TXS));
+    config.nTxRate = std::max<int64_t>(1, gArgs.GetArg("-txrate", DEFAULT_TX_RATE));
+    config.nBasePort = gArgs.GetArg("-port", DEFAULT_BASE_PORT);
+    config.nTimeout = std::max<int64_t>(1, gArgs.GetArg("-timeout", DEFAULT_TIMEOUT));
+    MakeTopology(config, std::max<int64_t>(1, gArgs.GetArg("-peers", DEFAULT_PEERS)));
+
+    // A node that died must not take the parent with it
+    signal(SIGPIPE, SIG_IGN);
+
+    const fs::path pathSim = fs::temp_directory_path() / strprintf("netsim_ovato_%lu_%d", (unsigned long)GetTime(), (int)getpid());
+    std::vector<NodeReport> vReports;
+    const bool fSuccess = RunSimulation(config, pathSim, vReports);
+    fs::remove_all(pathSim);
+    if (!fSuccess) {
+        fprintf(stderr, "Error: a node failed to start, connect or relay\n");
+        return 1;
+    }
+    PrintReports(config, vReports);
+    return 0;
+}
@@ -6,6 +6,7 @@
 
 #include "bench.h"
 #include "bloom.h"
+#include "knowninventory.h"
 #include "utiltime.h"
 
 static void RollingBloom(benchmark::State& state)
@@ -40,4 +41,29 @@ static void RollingBloom(benchmark::State& state)
     }
 }
 
+// The same workload against the shared-slot known-inventory set that replaced
+// the per-peer rolling bloom filter for inventory relay
+static void KnownInventory(benchmark::State& state)
+{
+    CKnownInventoryTable table(120000);
+    CKnownInventory known(table);
+    uint256 data;
+    uint32_t count = 0;
+    uint64_t match = 0;
+    while (state.KeepRunning()) {
+        count++;
+        data.begin()[0] = count;
+        data.begin()[1] = count >> 8;
+        data.begin()[2] = count >> 16;
+        data.begin()[3] = count >> 24;
+        known.insert(data);
+        data.begin()[0] = count >> 24;
+        data.begin()[1] = count >> 16;
+        data.begin()[2] = count >> 8;
+        data.begin()[3] = count;
+        match += known.contains(data);
+    }
+}
+
 BENCHMARK(RollingBloom);
+BENCHMARK(KnownInventory);
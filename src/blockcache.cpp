@@ -0,0 +1,291 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "blockencodings.h"
+#include "chain.h"
+#include "core_memusage.h"
+#include "memusage.h"
+#include "streams.h"
+#include "version.h"
+
+static size_t DataUsage(const CBlockCache::DataRef& data)
+{
+    return data ? memusage::DynamicUsage(*data) : 0;
+}
+
+CBlockCache::CBlockCache(size_t nMaxBlocksIn, size_t nMaxBytesIn) : nMaxBlocks(nMaxBlocksIn), nMaxBytes(nMaxBytesIn), nBytes(0), nHits(0), nMisses(0)
+{
+}
+
+void CBlockCache::SetMaxBlocks(size_t nMaxBlocksIn)
+{
+    LOCK(cs);
+    nMaxBlocks = nMaxBlocksIn;
+    Trim();
+}
+
+void CBlockCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+CBlockCache::Entry* CBlockCache::Touch(const uint256& hash)
+{
+    std::map<uint256, Entry>::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return nullptr;
+    lru.splice(lru.begin(), lru, it->second.itLru);
+    return &it->second;
+}
+
+CBlockCache::Entry& CBlockCache::Insert(const uint256& hash)
+{
+    Entry* entry = Touch(hash);
+    if (entry)
+        return *entry;
+    lru.push_front(hash);
+    Entry& newEntry = mapEntries[hash];
+    newEntry.itLru = lru.begin();
+    return newEntry;
+}
+
+void CBlockCache::SetBlock(Entry& entry, const std::shared_ptr<const CBlock>& pblock, size_t nBlockBytes)
+{
+    nBytes = nBytes - entry.nBlockBytes + nBlockBytes;
+    entry.pblock = pblock;
+    entry.nBlockBytes = nBlockBytes;
+}
+
+void CBlockCache::SetData(Entry& entry, Format format, const DataRef& data)
+{
+    nBytes = nBytes - DataUsage(entry.data[format]) + DataUsage(data);
+    entry.data[format] = data;
+}
+
+void CBlockCache::Erase(std::map<uint256, Entry>::iterator it)
+{
+    nBytes -= it->second.nBlockBytes;
+    for (const DataRef& data : it->second.data)
+        nBytes -= DataUsage(data);
+    lru.erase(it->second.itLru);
+    mapEntries.erase(it);
+}
+
+void CBlockCache::Trim()
+{
+    // A block that alone holds more than the byte limit is not kept either
+    while (!lru.empty() && (lru.size() > nMaxBlocks || nBytes > nMaxBytes))
+        Erase(mapEntries.find(lru.back()));
+}
+
+void CBlockCache::Add(const std::shared_ptr<const CBlock>& pblock)
+{
+    // Walking the block's transactions is left out of the lock
+    const size_t nBlockBytes = RecursiveDynamicUsage(pblock);
+    LOCK(cs);
+    if (nMaxBlocks == 0)
+        return;
+    SetBlock(Insert(pblock->GetHash()), pblock, nBlockBytes);
+    Trim();
+}
+
+void CBlockCache::Add(const uint256& hash, Format format, const DataRef& data)
+{
+    assert(format < FORMAT_COUNT);
+    LOCK(cs);
+    if (nMaxBlocks == 0)
+        return;
+    SetData(Insert(hash), format, data);
+    Trim();
+}
+
+CBlockCache::DataRef CBlockCache::Get(const uint256& hash, Format format)
+{
+    assert(format < FORMAT_COUNT);
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs);
+        Entry* entry = Touch(hash);
+        if (entry && entry->data[format]) {
+            nHits++;
+            return entry->data[format];
+        }
+        if (!entry || (!entry->pblock && !entry->data[BLOCK_WITNESS])) {
+            nMisses++;
+            return nullptr;
+        }
+    }
+
+    // Build the encoding without holding the lock, so other peers can be
+    // served from the cache in the meantime.
+    pblock = GetBlock(hash);
+    DataRef data;
+    if (pblock)
+        data = Serialize(*pblock, format);
+
+    LOCK(cs);
+    if (!data) {
+        nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    std::map<uint256, Entry>::iterator it = mapEntries.find(hash);
+    if (it != mapEntries.end()) {
+        SetData(it->second, format, data);
+        Trim();
+    }
+    return data;
+}
+
+std::shared_ptr<const CBlock> CBlockCache::GetBlock(const uint256& hash)
+{
+    DataRef witnessData;
+    {
+        LOCK(cs);
+        std::map<uint256, Entry>::iterator it = mapEntries.find(hash);
+        if (it == mapEntries.end())
+            return nullptr;
+        if (it->second.pblock)
+            return it->second.pblock;
+        witnessData = it->second.data[BLOCK_WITNESS];
+    }
+    if (!witnessData)
+        return nullptr;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    try {
+        CDataStream ss(*witnessData, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> *pblock;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+    const size_t nBlockBytes = RecursiveDynamicUsage(pblock);
+
+    LOCK(cs);
+    std::map<uint256, Entry>::iterator it = mapEntries.find(hash);
+    if (it != mapEntries.end() && !it->second.pblock) {
+        SetBlock(it->second, pblock, nBlockBytes);
+        Trim();
+    }
+    return pblock;
+}
+
+CBlockCache::Stats CBlockCache::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nBlocks = mapEntries.size();
+    stats.nBytes = nBytes;
+    return stats;
+}
+
+CBlockCache::DataRef CBlockCache::Serialize(const CBlock& block, Format format)
+{
+    std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>();
+    switch (format) {
+    case BLOCK_WITNESS:
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *data, 0, block);
+        break;
+    case BLOCK_NO_WITNESS:
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, *data, 0, block);
+        break;
+    case CMPCT_WITNESS:
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *data, 0, CBlockHeaderAndShortTxIDs(block, true));
+        break;
+    case CMPCT_NO_WITNESS:
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, *data, 0, CBlockHeaderAndShortTxIDs(block, false));
+        break;
+    case FORMAT_COUNT:
+        assert(false);
+    }
+    return data;
+}
+
+CHeadersCache::CHeadersCache(size_t nMaxChunksIn) : nMaxChunks(nMaxChunksIn)
+{
+}
+
+CHeadersCache::DataRef CHeadersCache::Serialize(const CChain& chain, int nFirst, int nLast)
+{
+    std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>();
+    data->reserve((nLast - nFirst + 1) * HEADER_SIZE);
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, *data, 0);
+    for (int nHeight = nFirst; nHeight <= nLast; nHeight++) {
+        // Same as a CBlock without transactions
+        writer << chain[nHeight]->GetBlockHeader() << (uint8_t)0;
+    }
+    assert(data->size() == (size_t)(nLast - nFirst + 1) * HEADER_SIZE);
+    return data;
+}
+
+CHeadersCache::DataRef CHeadersCache::GetChunk(const CChain& chain, int nChunk)
+{
+    const int nFirst = nChunk * CHUNK_SIZE;
+    const int nLast = nFirst + CHUNK_SIZE - 1;
+    if (nLast > chain.Height())
+        return nullptr;
+    const uint256 hashLast = chain[nLast]->GetBlockHash();
+
+    LOCK(cs);
+    std::map<int, Chunk>::iterator it = mapChunks.find(nChunk);
+    if (it != mapChunks.end()) {
+        lru.splice(lru.begin(), lru, it->second.itLru);
+        if (it->second.hashLast == hashLast)
+            return it->second.data;
+    } else {
+        if (nMaxChunks == 0)
+            return nullptr;
+        lru.push_front(nChunk);
+        it = mapChunks.emplace(nChunk, Chunk()).first;
+        it->second.itLru = lru.begin();
+        while (lru.size() > nMaxChunks) {
+            mapChunks.erase(lru.back());
+            lru.pop_back();
+        }
+    }
+    it->second.hashLast = hashLast;
+    it->second.data = Serialize(chain, nFirst, nLast);
+    return it->second.data;
+}
+
+std::vector<CHeadersCache::Range> CHeadersCache::GetHeaders(const CChain& chain, int nFirst, int nLast)
+{
+    std::vector<Range> ranges;
+    int nHeight = nFirst;
+    while (nHeight <= nLast) {
+        const int nChunk = nHeight / CHUNK_SIZE;
+        const int nChunkLast = std::min(nLast, (nChunk + 1) * CHUNK_SIZE - 1);
+        DataRef chunk = GetChunk(chain, nChunk);
+        if (chunk) {
+            const size_t nOffset = nHeight - nChunk * CHUNK_SIZE;
+            ranges.push_back({chunk, nOffset * HEADER_SIZE, (nOffset + nChunkLast - nHeight + 1) * HEADER_SIZE});
+        } else {
+            DataRef data = Serialize(chain, nHeight, nChunkLast);
+            ranges.push_back({data, 0, data->size()});
+        }
+        nHeight = nChunkLast + 1;
+    }
+    return ranges;
+}
+
+std::vector<unsigned char> CHeadersCache::MakeHeadersMessage(const std::vector<Range>& ranges)
+{
+    size_t nBytes = 0;
+    for (const Range& range : ranges)
+        nBytes += range.nEnd - range.nBegin;
+
+    std::vector<unsigned char> data;
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, data, 0);
+    WriteCompactSize(writer, nBytes / HEADER_SIZE);
+    data.reserve(data.size() + nBytes);
+    for (const Range& range : ranges)
+        data.insert(data.end(), range.data->begin() + range.nBegin, range.data->begin() + range.nEnd);
+    return data;
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class CChain;
+
+/** Default number of recent blocks kept serialized for serving to peers */
+static const unsigned int DEFAULT_BLOCK_CACHE_SIZE = 32;
+/** Default limit in MiB of the memory those blocks may hold */
+static const unsigned int DEFAULT_MAX_BLOCK_CACHE_SIZE = 64;
+/** Default number of header chunks kept serialized for answering getheaders */
+static const unsigned int DEFAULT_HEADERS_CACHE_CHUNKS = 64;
+
+/**
+ * Least-recently-used cache of recent blocks in the serialized forms they are
+ * sent to peers in. Each entry holds the block itself (when known) and lazily
+ * built encodings of it, so peers asking for the same recent block in the same
+ * form share one serialization instead of each hitting disk. It is limited both
+ * by number of blocks and by the memory they hold, so a few large blocks can
+ * not pin more than the byte limit.
+ */
+class CBlockCache
+{
+public:
+    enum Format {
+        BLOCK_WITNESS,      //!< block message including witness data
+        BLOCK_NO_WITNESS,   //!< block message with witness data stripped
+        CMPCT_WITNESS,      //!< cmpctblock using wtxid short IDs
+        CMPCT_NO_WITNESS,   //!< cmpctblock using txid short IDs
+        FORMAT_COUNT
+    };
+
+    typedef std::shared_ptr<const std::vector<unsigned char>> DataRef;
+
+    struct Stats {
+        uint64_t nHits;
+        uint64_t nMisses;
+        size_t nBlocks;
+        size_t nBytes;
+    };
+
+    explicit CBlockCache(size_t nMaxBlocksIn = DEFAULT_BLOCK_CACHE_SIZE, size_t nMaxBytesIn = (size_t)DEFAULT_MAX_BLOCK_CACHE_SIZE << 20);
+
+    /** Change the number of blocks kept, evicting the oldest as needed. 0 disables the cache. */
+    void SetMaxBlocks(size_t nMaxBlocksIn);
+    /** Change the memory the blocks may hold, evicting the oldest as needed */
+    void SetMaxBytes(size_t nMaxBytesIn);
+
+    /** Add or refresh a block; its encodings are built on first request. */
+    void Add(const std::shared_ptr<const CBlock>& pblock);
+    /** Add one encoding of a block, e.g. as read from disk. */
+    void Add(const uint256& hash, Format format, const DataRef& data);
+
+    /**
+     * Return the given encoding of a cached block, building it from the
+     * block or its witness serialization if needed. Returns nullptr and
+     * counts a miss if the block is not cached.
+     */
+    DataRef Get(const uint256& hash, Format format);
+    /** Return a cached block, deserializing it if only its bytes are cached. */
+    std::shared_ptr<const CBlock> GetBlock(const uint256& hash);
+
+    Stats GetStats() const;
+
+    /** Serialize a block in the given format, as sent in the corresponding message. */
+    static DataRef Serialize(const CBlock& block, Format format);
+
+private:
+    struct Entry {
+        std::shared_ptr<const CBlock> pblock;
+        //! Memory held by pblock
+        size_t nBlockBytes = 0;
+        DataRef data[FORMAT_COUNT];
+        std::list<uint256>::iterator itLru;
+    };
+
+    mutable CCriticalSection cs;
+    size_t nMaxBlocks;
+    size_t nMaxBytes;
+    //! Memory held by the blocks and encodings of all entries
+    size_t nBytes;
+    std::map<uint256, Entry> mapEntries;
+    //! Most recently used hash at the front
+    std::list<uint256> lru;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    Entry* Touch(const uint256& hash);
+    Entry& Insert(const uint256& hash);
+    void SetBlock(Entry& entry, const std::shared_ptr<const CBlock>& pblock, size_t nBlockBytes);
+    void SetData(Entry& entry, Format format, const DataRef& data);
+    void Erase(std::map<uint256, Entry>::iterator it);
+    void Trim();
+};
+
+/**
+ * Headers of the active chain serialized as they appear in a headers
+ * message, in chunks covering fixed height ranges, so getheaders replies can
+ * be assembled by copying. A chunk is only used while its last block is
+ * still in the active chain, so a reorg makes the chunks above the fork
+ * stale and they are rebuilt on next use.
+ */
+class CHeadersCache
+{
+public:
+    static const int CHUNK_SIZE = 2000;
+    //! A header followed by an empty transaction count, as in a headers message
+    static const size_t HEADER_SIZE = 81;
+
+    typedef std::shared_ptr<const std::vector<unsigned char>> DataRef;
+
+    //! Bytes [nBegin, nEnd) of a shared buffer
+    struct Range {
+        DataRef data;
+        size_t nBegin;
+        size_t nEnd;
+    };
+
+    explicit CHeadersCache(size_t nMaxChunksIn = DEFAULT_HEADERS_CACHE_CHUNKS);
+
+    /**
+     * Return the serialized headers of chain[nFirst] through chain[nLast].
+     * Complete chunks are cached; headers past the last complete chunk are
+     * serialized on each call. Requires that chain is not modified
+     * concurrently (cs_main for chainActive). The returned ranges stay valid
+     * without it.
+     */
+    std::vector<Range> GetHeaders(const CChain& chain, int nFirst, int nLast);
+
+    /** Build a headers message payload from ranges returned by GetHeaders. */
+    static std::vector<unsigned char> MakeHeadersMessage(const std::vector<Range>& ranges);
+
+private:
+    struct Chunk {
+        uint256 hashLast;
+        DataRef data;
+        std::list<int>::iterator itLru;
+    };
+
+    CCriticalSection cs;
+    size_t nMaxChunks;
+    std::map<int, Chunk> mapChunks;
+    //! Most recently used chunk number at the front
+    std::list<int> lru;
+
+    DataRef GetChunk(const CChain& chain, int nChunk);
+    static DataRef Serialize(const CChain& chain, int nFirst, int nLast);
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
@@ -15,6 +15,9 @@
 
 #include <unordered_map>
 
+/** How many times the number of short IDs in a block to look at among the best mempool entries before scanning all of it */
+static const size_t MAX_BEST_MEMPOOL_SCAN_FACTOR = 4;
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
@@ -102,18 +105,15 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
-    {
-    LOCK(pool->cs);
-    const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
+    auto match_mempool_tx = [&](const std::pair<uint256, CTxMemPool::txiter>& txhash) {
+        uint64_t shortid = cmpctblock.GetShortID(txhash.first);
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
+                txn_available[idit->second] = txhash.second->GetSharedTx();
                 have_txn[idit->second]  = true;
                 mempool_count++;
-            } else {
+            } else if (txn_available[idit->second] != txhash.second->GetSharedTx()) {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
@@ -123,12 +123,29 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 }
             }
         }
+    };
+    {
+    LOCK(pool->cs);
+    const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    // Blocks are mostly made of the transactions with the best ancestor
+    // feerate, so look at those first. When we have all of the block's
+    // transactions this finds them after hashing about a block's worth of
+    // the mempool rather than all of it.
+    const size_t nBestToScan = MAX_BEST_MEMPOOL_SCAN_FACTOR * shorttxids.size();
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::const_iterator mi = pool->mapTx.get<ancestor_score>().begin();
+    for (size_t i = 0; i < nBestToScan && mi != pool->mapTx.get<ancestor_score>().end(); i++, mi++) {
+        match_mempool_tx(vTxHashes[mi->vTxHashesIdx]);
         // Though ideally we'd continue scanning for the two-txn-match-shortid case,
         // the performance win of an early exit here is too good to pass up and worth
         // the extra risk.
         if (mempool_count == shorttxids.size())
             break;
     }
+    // Otherwise fall back to looking at the whole mempool. Transactions
+    // already matched above are recognized and not mistaken for collisions.
+    for (size_t i = 0; i < vTxHashes.size() && mempool_count != shorttxids.size(); i++) {
+        match_mempool_tx(vTxHashes[i]);
+    }
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockpropagation.h"
+
+CBlockPropagation::CBlockPropagation() :
+    nHeight(-1),
+    nAnnounceTime(0), nAnnouncePeer(-1),
+    nCompactTime(0), nCompactPeer(-1),
+    nTxs(0), nPrefilledTxs(0), nMempoolTxs(0), nExtraTxs(0), nMissingTxs(0),
+    nReceivedTime(0), nReceivedPeer(-1),
+    nProcessedTime(0)
+{
+}
+
+CBlockPropagationLog::CBlockPropagationLog(size_t nMaxBlocksIn) : nMaxBlocks(nMaxBlocksIn)
+{
+}
+
+CBlockPropagation* CBlockPropagationLog::Find(const uint256& hash)
+{
+    // Events are nearly always about the newest blocks
+    for (auto it = vBlocks.rbegin(); it != vBlocks.rend(); ++it) {
+        if (it->hash == hash)
+            return &*it;
+    }
+    return nullptr;
+}
+
+void CBlockPropagationLog::Announced(const uint256& hash, int nHeight, NodeId peer, const std::string& strVia, int64_t nTime)
+{
+    LOCK(cs);
+    if (nMaxBlocks == 0)
+        return;
+    if (CBlockPropagation* block = Find(hash)) {
+        if (block->nHeight < 0)
+            block->nHeight = nHeight;
+        return;
+    }
+    if (vBlocks.size() >= nMaxBlocks)
+        vBlocks.pop_front();
+    vBlocks.emplace_back();
+    CBlockPropagation& block = vBlocks.back();
+    block.hash = hash;
+    block.nHeight = nHeight;
+    block.nAnnounceTime = nTime;
+    block.nAnnouncePeer = peer;
+    block.strAnnounceVia = strVia;
+}
+
+void CBlockPropagationLog::CompactReceived(const uint256& hash, NodeId peer, int nTxs, int nPrefilledTxs, int nMempoolTxs, int nExtraTxs, int nMissingTxs, int64_t nTime)
+{
+    LOCK(cs);
+    CBlockPropagation* block = Find(hash);
+    if (!block || block->nCompactTime)
+        return;
+    block->nCompactTime = nTime;
+    block->nCompactPeer = peer;
+    block->nTxs = nTxs;
+    block->nPrefilledTxs = nPrefilledTxs;
+    block->nMempoolTxs = nMempoolTxs;
+    block->nExtraTxs = nExtraTxs;
+    block->nMissingTxs = nMissingTxs;
+}
+
+void CBlockPropagationLog::Received(const uint256& hash, NodeId peer, const std::string& strVia, int64_t nTime)
+{
+    LOCK(cs);
+    CBlockPropagation* block = Find(hash);
+    if (!block || block->nReceivedTime)
+        return;
+    block->nReceivedTime = nTime;
+    block->nReceivedPeer = peer;
+    block->strReceivedVia = strVia;
+}
+
+void CBlockPropagationLog::Processed(const uint256& hash, int64_t nTime)
+{
+    LOCK(cs);
+    CBlockPropagation* block = Find(hash);
+    if (!block || block->nProcessedTime)
+        return;
+    block->nProcessedTime = nTime;
+}
+
+void CBlockPropagationLog::Relayed(const uint256& hash, NodeId peer, int64_t nTime)
+{
+    LOCK(cs);
+    CBlockPropagation* block = Find(hash);
+    if (!block)
+        return;
+    for (const std::pair<NodeId, int64_t>& relay : block->vRelays) {
+        if (relay.first == peer)
+            return;
+    }
+    block->vRelays.emplace_back(peer, nTime);
+}
+
+std::vector<CBlockPropagation> CBlockPropagationLog::GetBlocks() const
+{
+    LOCK(cs);
+    return std::vector<CBlockPropagation>(vBlocks.begin(), vBlocks.end());
+}
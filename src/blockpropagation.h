@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPROPAGATION_H
+#define BITCOIN_BLOCKPROPAGATION_H
+
+#include "net.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Number of recent blocks whose propagation is kept for getblockpropagation */
+static const size_t BLOCK_PROPAGATION_LOG_SIZE = 100;
+
+/**
+ * How one block reached us and was passed on. Times are in microseconds since
+ * the epoch, 0 for what has not happened; peers are -1 when unknown.
+ */
+struct CBlockPropagation
+{
+    uint256 hash;
+    int nHeight;
+
+    //! First announcement: when, by whom and in which message
+    int64_t nAnnounceTime;
+    NodeId nAnnouncePeer;
+    std::string strAnnounceVia;
+
+    //! First compact block for it and how much of it we could fill in
+    int64_t nCompactTime;
+    NodeId nCompactPeer;
+    int nTxs;
+    int nPrefilledTxs;
+    int nMempoolTxs;
+    int nExtraTxs;
+    int nMissingTxs;
+
+    //! When we had all of the block's transactions, from whom and by which message
+    int64_t nReceivedTime;
+    NodeId nReceivedPeer;
+    std::string strReceivedVia;
+    //! When ProcessNewBlock returned for it
+    int64_t nProcessedTime;
+
+    //! First cmpctblock relay to each high-bandwidth peer
+    std::vector<std::pair<NodeId, int64_t>> vRelays;
+
+    CBlockPropagation();
+};
+
+/**
+ * Ring of the most recent blocks' propagation. Entries are created by the
+ * first announcement of a block once its header is accepted, so only work
+ * that passed proof of work can take one, and filled in as it arrives, is
+ * processed and is relayed; events for blocks without an entry are dropped.
+ * Thread-safe.
+ */
+class CBlockPropagationLog
+{
+public:
+    explicit CBlockPropagationLog(size_t nMaxBlocksIn = BLOCK_PROPAGATION_LOG_SIZE);
+
+    /** Record an announcement of a block; only the first one of a block counts, but can fill in its height */
+    void Announced(const uint256& hash, int nHeight, NodeId peer, const std::string& strVia, int64_t nTime);
+    /** Record a compact block and what reconstructing it from our mempool and extra transactions gave */
+    void CompactReceived(const uint256& hash, NodeId peer, int nTxs, int nPrefilledTxs, int nMempoolTxs, int nExtraTxs, int nMissingTxs, int64_t nTime);
+    /** Record having all of the block's transactions */
+    void Received(const uint256& hash, NodeId peer, const std::string& strVia, int64_t nTime);
+    void Processed(const uint256& hash, int64_t nTime);
+    /** Record relaying the block to a high-bandwidth peer; only the first relay to each peer counts */
+    void Relayed(const uint256& hash, NodeId peer, int64_t nTime);
+
+    /** The recorded blocks, oldest first */
+    std::vector<CBlockPropagation> GetBlocks() const;
+
+private:
+    mutable CCriticalSection cs;
+    const size_t nMaxBlocks;
+    std::deque<CBlockPropagation> vBlocks;
+
+    CBlockPropagation* Find(const uint256& hash);
+};
+
+#endif // BITCOIN_BLOCKPROPAGATION_H
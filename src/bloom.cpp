@@ -6,6 +6,7 @@
 
 #include "primitives/transaction.h"
 #include "hash.h"
+#include "memusage.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "random.h"
@@ -49,6 +50,57 @@ CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, c
 {
 }
 
+CBloomTxElements::CBloomTxElements(const CTransaction& tx)
+{
+    const uint256& hash = tx.GetHash();
+    Add(hash.begin(), hash.size());
+
+    for (const CTxOut& txout : tx.vout) {
+        vOutputBegin.push_back(vElements.size());
+        CScript::const_iterator pc = txout.scriptPubKey.begin();
+        std::vector<unsigned char> data;
+        while (pc < txout.scriptPubKey.end()) {
+            opcodetype opcode;
+            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
+                break;
+            if (data.size() != 0)
+                Add(data.data(), data.size());
+        }
+    }
+    vOutputBegin.push_back(vElements.size());
+
+    for (const CTxIn& txin : tx.vin) {
+        vInputBegin.push_back(vElements.size());
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << txin.prevout;
+        Add((const unsigned char*)stream.data(), stream.size());
+        CScript::const_iterator pc = txin.scriptSig.begin();
+        std::vector<unsigned char> data;
+        while (pc < txin.scriptSig.end()) {
+            opcodetype opcode;
+            if (!txin.scriptSig.GetOp(pc, opcode, data))
+                break;
+            if (data.size() != 0)
+                Add(data.data(), data.size());
+        }
+    }
+    vInputBegin.push_back(vElements.size());
+}
+
+void CBloomTxElements::Add(const unsigned char* pData, size_t nSize)
+{
+    Element element;
+    element.nSize = nSize;
+    element.nMixPos = vMixes.size();
+    vElements.push_back(element);
+    MurmurHash3Premix(pData, nSize, vMixes);
+}
+
+size_t CBloomTxElements::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vMixes) + memusage::DynamicUsage(vElements) + memusage::DynamicUsage(vOutputBegin) + memusage::DynamicUsage(vInputBegin);
+}
+
 inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
@@ -98,6 +150,24 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
     return true;
 }
 
+bool CBloomFilter::contains(const CBloomTxElements& elements, size_t nElement) const
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    const CBloomTxElements::Element& element = elements.vElements[nElement];
+    const uint32_t* pMixes = elements.vMixes.data() + element.nMixPos;
+    for (unsigned int i = 0; i < nHashFuncs; i++)
+    {
+        // Same as Hash()
+        unsigned int nIndex = MurmurHash3Premixed(i * 0xFBA4C795 + nTweak, pMixes, element.nSize) % (vData.size() * 8);
+        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+            return false;
+    }
+    return true;
+}
+
 bool CBloomFilter::contains(const COutPoint& outpoint) const
 {
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
@@ -132,15 +202,29 @@ bool CBloomFilter::IsWithinSizeConstraints() const
 
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
 {
-    bool fFound = false;
-    // Match if the filter contains the hash of tx
-    //  for finding tx when they appear in a block
     if (isFull)
         return true;
     if (isEmpty)
         return false;
+    return IsRelevantAndUpdate(tx, CBloomTxElements(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx, CBloomElementsCache& elementsCache)
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    return IsRelevantAndUpdate(tx, *elementsCache.Get(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx, const CBloomTxElements& elements)
+{
+    bool fFound = false;
+    // Match if the filter contains the hash of tx
+    //  for finding tx when they appear in a block
     const uint256& hash = tx.GetHash();
-    if (contains(hash))
+    if (contains(elements, 0))
         fFound = true;
 
     for (unsigned int i = 0; i < tx.vout.size(); i++)
@@ -150,14 +234,9 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
         // If this matches, also add the specific output that was matched.
         // This means clients don't have to update the filter themselves when a new relevant tx 
         // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
-        std::vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end())
+        for (uint32_t nElement = elements.vOutputBegin[i]; nElement < elements.vOutputBegin[i + 1]; nElement++)
         {
-            opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            if (contains(elements, nElement))
             {
                 fFound = true;
                 if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
@@ -178,21 +257,13 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (fFound)
         return true;
 
-    for (const CTxIn& txin : tx.vin)
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
-            return true;
-
-        // Match if the filter contains any arbitrary script data element in any scriptSig in tx
-        CScript::const_iterator pc = txin.scriptSig.begin();
-        std::vector<unsigned char> data;
-        while (pc < txin.scriptSig.end())
+        // Match if the filter contains an outpoint tx spends, or any
+        // arbitrary script data element in any scriptSig in tx
+        for (uint32_t nElement = elements.vInputBegin[i]; nElement < elements.vInputBegin[i + 1]; nElement++)
         {
-            opcodetype opcode;
-            if (!txin.scriptSig.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            if (contains(elements, nElement))
                 return true;
         }
     }
@@ -213,6 +284,33 @@ void CBloomFilter::UpdateEmptyFull()
     isEmpty = empty;
 }
 
+size_t CBloomElementsCache::UsageOf(const CBloomTxElements& elements)
+{
+    // The shared_ptr's control block and the map node are left out
+    return memusage::MallocUsage(sizeof(CBloomTxElements)) + elements.DynamicMemoryUsage();
+}
+
+std::shared_ptr<const CBloomTxElements> CBloomElementsCache::Get(const CTransaction& tx)
+{
+    std::map<uint256, std::shared_ptr<const CBloomTxElements>>::iterator it = mapElements.find(tx.GetHash());
+    if (it != mapElements.end())
+        return it->second;
+    std::shared_ptr<const CBloomTxElements> elements = std::make_shared<const CBloomTxElements>(tx);
+    const size_t nUsage = UsageOf(*elements);
+    if (nMaxTxs == 0 || nUsage > nMaxBytes)
+        return elements;
+    while (mapElements.size() >= nMaxTxs || nBytes + nUsage > nMaxBytes) {
+        std::map<uint256, std::shared_ptr<const CBloomTxElements>>::iterator itOldest = mapElements.find(vOrder.front());
+        nBytes -= UsageOf(*itOldest->second);
+        mapElements.erase(itOldest);
+        vOrder.pop_front();
+    }
+    mapElements.emplace(tx.GetHash(), elements);
+    vOrder.push_back(tx.GetHash());
+    nBytes += nUsage;
+    return elements;
+}
+
 CRollingBloomFilter::CRollingBloomFilter(const unsigned int nElements, const double fpRate)
 {
     double logFpRate = log(fpRate);
@@ -310,3 +408,8 @@ void CRollingBloomFilter::reset()
         *it = 0;
     }
 }
+
+size_t CRollingBloomFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(data);
+}
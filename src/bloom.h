@@ -6,12 +6,16 @@
 #define BITCOIN_BLOOM_H
 
 #include "serialize.h"
+#include "uint256.h"
 
+#include <deque>
+#include <map>
+#include <memory>
 #include <vector>
 
+class CBloomElementsCache;
 class COutPoint;
 class CTransaction;
-class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -30,6 +34,39 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The data elements of a transaction CBloomFilter::IsRelevantAndUpdate looks
+ * for, with the part of their hashing that does not depend on the filter
+ * done (see MurmurHash3Premix). Checking a transaction against each further
+ * filter then skips parsing its scripts and most of the hashing.
+ */
+class CBloomTxElements
+{
+public:
+    explicit CBloomTxElements(const CTransaction& tx);
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    friend class CBloomFilter;
+
+    struct Element {
+        uint32_t nSize;
+        //! Position of the element's mixed blocks in vMixes
+        uint32_t nMixPos;
+    };
+
+    std::vector<uint32_t> vMixes;
+    //! The txid, the pushes in each output's script, then for each input its prevout and the pushes in its scriptSig
+    std::vector<Element> vElements;
+    //! Index in vElements of each output's first element, plus one past the last output's
+    std::vector<uint32_t> vOutputBegin;
+    //! Index in vElements of each input's prevout, plus one past the last input's elements
+    std::vector<uint32_t> vInputBegin;
+
+    void Add(const unsigned char* pData, size_t nSize);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -52,6 +89,8 @@ private:
     unsigned char nFlags;
 
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    bool contains(const CBloomTxElements& elements, size_t nElement) const;
+    bool IsRelevantAndUpdate(const CTransaction& tx, const CBloomTxElements& elements);
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweak);
@@ -97,11 +136,40 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! Same, sharing the hashing of tx's data elements with other filters through the cache
+    bool IsRelevantAndUpdate(const CTransaction& tx, CBloomElementsCache& elementsCache);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
 };
 
+/**
+ * CBloomTxElements of the most recently filtered transactions, so that each
+ * transaction relayed to or included in a block for many peers with filters
+ * is only parsed and hashed once. Limited both in number of transactions and
+ * in the memory their elements use. Not thread-safe.
+ */
+class CBloomElementsCache
+{
+public:
+    CBloomElementsCache(size_t nMaxTxsIn, size_t nMaxBytesIn) : nMaxTxs(nMaxTxsIn), nMaxBytes(nMaxBytesIn), nBytes(0) {}
+
+    std::shared_ptr<const CBloomTxElements> Get(const CTransaction& tx);
+    size_t size() const { return mapElements.size(); }
+    size_t DynamicMemoryUsage() const { return nBytes; }
+
+private:
+    const size_t nMaxTxs;
+    const size_t nMaxBytes;
+    //! Memory used by the cached elements, counted by UsageOf
+    size_t nBytes;
+    std::map<uint256, std::shared_ptr<const CBloomTxElements>> mapElements;
+    //! Txids in mapElements, oldest first
+    std::deque<uint256> vOrder;
+
+    static size_t UsageOf(const CBloomTxElements& elements);
+};
+
 /**
  * RollingBloomFilter is a probabilistic "keep track of most recently inserted" set.
  * Construct it with the number of items to keep track of, and a false-positive
@@ -131,6 +199,8 @@ public:
 
     void reset();
 
+    size_t DynamicMemoryUsage() const;
+
 private:
     int nEntriesPerGeneration;
     int nEntriesThisGeneration;
@@ -72,6 +72,17 @@ typedef unsigned int SOCKET;
 #define MAX_PATH            1024
 #endif
 
+// poll() has no limit on descriptor values; epoll additionally keeps
+// registrations across calls so that only ready sockets are reported.
+#ifndef WIN32
+#define USE_POLL
+#include <poll.h>
+#endif
+#ifdef __linux__
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #if HAVE_DECL_STRNLEN == 0
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
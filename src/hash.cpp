@@ -69,6 +69,58 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+void MurmurHash3Premix(const unsigned char* pData, size_t nSize, std::vector<uint32_t>& vMixes)
+{
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+
+    const size_t nblocks = nSize / 4;
+    for (size_t i = 0; i < nblocks; ++i) {
+        uint32_t k1 = ReadLE32(pData + i*4);
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        k1 *= c2;
+        vMixes.push_back(k1);
+    }
+
+    const uint8_t* tail = pData + nblocks * 4;
+    uint32_t k1 = 0;
+    switch (nSize & 3) {
+        case 3:
+            k1 ^= tail[2] << 16;
+        case 2:
+            k1 ^= tail[1] << 8;
+        case 1:
+            k1 ^= tail[0];
+            k1 *= c1;
+            k1 = ROTL32(k1, 15);
+            k1 *= c2;
+            vMixes.push_back(k1);
+    }
+}
+
+unsigned int MurmurHash3Premixed(unsigned int nHashSeed, const uint32_t* pMixes, size_t nSize)
+{
+    uint32_t h1 = nHashSeed;
+    const size_t nblocks = nSize / 4;
+    for (size_t i = 0; i < nblocks; ++i) {
+        h1 ^= pMixes[i];
+        h1 = ROTL32(h1, 13);
+        h1 = h1 * 5 + 0xe6546b64;
+    }
+    if (nSize & 3)
+        h1 ^= pMixes[nblocks];
+
+    h1 ^= nSize;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+
+    return h1;
+}
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
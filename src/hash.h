@@ -206,6 +206,15 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/**
+ * MurmurHash3 split in two, for data hashed with many seeds: the seed only
+ * enters after each 4-byte block has been mixed, so the mixed blocks can be
+ * computed once (one word per started block appended to vMixes) and then
+ * combined with each seed.
+ */
+void MurmurHash3Premix(const unsigned char* pData, size_t nSize, std::vector<uint32_t>& vMixes);
+unsigned int MurmurHash3Premixed(unsigned int nHashSeed, const uint32_t* pMixes, size_t nSize);
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
 /** SipHash-2-4 */
@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -185,14 +186,56 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
+            // Methods may stream large results; the reply is then sent in
+            // chunks as soon as there is a buffer full of it. Methods stream
+            // while holding cs_main or wallet locks, so the chunks are only
+            // queued here, and waiting for the client to read them is left
+            // until the method has returned.
+            const std::string strResultStart = "{\"result\":";
+            bool fStarted = false;
+            JSONStreamWriter writer([req, &strResultStart, &fStarted](const std::string& strChunk) {
+                if (!fStarted) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->WriteReplyStart(HTTP_OK);
+                    req->WriteReplyChunk(strResultStart, false);
+                    fStarted = true;
+                }
+                if (!req->WriteReplyChunk(strChunk, false))
+                    throw std::runtime_error("Client stopped reading the reply");
+            });
+            jreq.stream = &writer;
+
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+            } catch (...) {
+                if (!fStarted)
+                    throw;
+                // Too late for an error reply; dropping the connection before
+                // the final chunk shows the client the result is incomplete
+                LogPrintf("Error while streaming result of %s\n", jreq.strMethod);
+                req->WriteReplyAbort();
+                return false;
+            }
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            if (!writer.IsUsed()) {
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            } else {
+                const std::string strResultEnd = ",\"error\":null,\"id\":" + jreq.id.write() + "}\n";
+                if (!fStarted) {
+                    strReply = strResultStart + writer.GetBuffer() + strResultEnd;
+                } else {
+                    writer.Flush();
+                    req->WriteReplyChunk(strResultEnd);
+                    req->WriteReplyEnd();
+                    return true;
+                }
+            }
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS) - 1, QueueHTTPWork);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
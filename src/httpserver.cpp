@@ -70,10 +70,17 @@ private:
     /** Mutex protects entire object */
     std::mutex cs;
     std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    /** Queued items and when they were queued */
+    std::deque<std::pair<std::unique_ptr<WorkItem>, int64_t>> queue;
     bool running;
     size_t maxDepth;
     int numThreads;
+    /** Counters for GetStats */
+    size_t peakDepth;
+    uint64_t processed;
+    uint64_t rejected;
+    int64_t totalWaitMicros;
+    int64_t maxWaitMicros;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -96,7 +103,12 @@ private:
 public:
     WorkQueue(size_t _maxDepth) : running(true),
                                  maxDepth(_maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 peakDepth(0),
+                                 processed(0),
+                                 rejected(0),
+                                 totalWaitMicros(0),
+                                 maxWaitMicros(0)
     {
     }
     /** Precondition: worker threads have all stopped
@@ -105,14 +117,17 @@ public:
     ~WorkQueue()
     {
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item, unless that would leave fewer than reserve free places */
+    bool Enqueue(WorkItem* item, size_t reserve = 0)
     {
         std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        if (queue.size() + reserve >= maxDepth) {
+            if (reserve == 0)
+                rejected++;
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        queue.emplace_back(std::unique_ptr<WorkItem>(item), GetTimeMicros());
+        peakDepth = std::max(peakDepth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -128,8 +143,12 @@ public:
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = std::move(queue.front());
+                i = std::move(queue.front().first);
+                const int64_t wait = GetTimeMicros() - queue.front().second;
                 queue.pop_front();
+                processed++;
+                totalWaitMicros += wait;
+                maxWaitMicros = std::max(maxWaitMicros, wait);
             }
             (*i)();
         }
@@ -148,6 +167,38 @@ public:
         while (numThreads > 0)
             cond.wait(lock);
     }
+    size_t MaxDepth() const
+    {
+        return maxDepth;
+    }
+    void GetStats(HTTPWorkQueueStats& stats)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        stats.threads = numThreads;
+        stats.depth = queue.size();
+        stats.maxDepth = maxDepth;
+        stats.peakDepth = peakDepth;
+        stats.processed = processed;
+        stats.rejected = rejected;
+        stats.totalWaitMicros = totalWaitMicros;
+        stats.maxWaitMicros = maxWaitMicros;
+    }
+};
+
+/** Work item that just calls a function */
+class HTTPFunctionItem : public HTTPClosure
+{
+public:
+    explicit HTTPFunctionItem(const std::function<void()>& _func) : func(_func)
+    {
+    }
+    void operator()() override
+    {
+        func();
+    }
+
+private:
+    std::function<void()> func;
 };
 
 struct HTTPPathHandler
@@ -164,18 +215,27 @@ struct HTTPPathHandler
 
 /** HTTP module state */
 
-//! libevent event loop
-static struct event_base* eventBase = 0;
-//! HTTP server
-struct evhttp* eventHTTP = 0;
+/** A libevent event loop, the HTTP server on it and its thread */
+struct HTTPEventLoop
+{
+    struct event_base* base = nullptr;
+    struct evhttp* http = nullptr;
+    //! Listening sockets it accepts connections from
+    std::vector<evhttp_bound_socket *> boundSockets;
+    std::thread thread;
+    std::future<bool> result;
+};
+
+//! Event loops; connections are served by the loop that accepted them
+static std::vector<HTTPEventLoop> eventLoops;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-std::vector<evhttp_bound_socket *> boundSockets;
+//! Seconds connections may stay idle, or stall while reading or writing
+static int httpServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -317,11 +377,52 @@ static bool ThreadHTTP(struct event_base* base, struct evhttp* http)
     return event_base_got_break(base) == 0;
 }
 
-/** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp* http)
+typedef std::pair<std::string, uint16_t> HTTPEndpoint;
+
+/**
+ * Bind a listening socket with SO_REUSEPORT, so that every event loop can
+ * have its own and the kernel spreads new connections between them, rather
+ * than waking every loop for each one. Returns nullptr where unsupported.
+ */
+static evhttp_bound_socket* HTTPBindReusePort(struct evhttp* http, const HTTPEndpoint& endpoint)
+{
+#ifdef SO_REUSEPORT
+    CService addr;
+    if (!Lookup(endpoint.first.empty() ? "0.0.0.0" : endpoint.first.c_str(), addr, endpoint.second, false))
+        return nullptr;
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addr.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return nullptr;
+    evutil_socket_t fd = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+        return nullptr;
+    int one = 1;
+    bool fOk = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+               setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == 0;
+    // IPv4 is bound separately, so keep IPv6 sockets from taking it too
+    if (fOk && addr.IsIPv6())
+        fOk = setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one)) == 0;
+    fOk = fOk && evutil_make_socket_nonblocking(fd) == 0 && evutil_make_socket_closeonexec(fd) == 0 &&
+          bind(fd, (struct sockaddr*)&sockaddr, len) == 0 && listen(fd, SOMAXCONN) == 0;
+    evhttp_bound_socket* handle = fOk ? evhttp_accept_socket_with_handle(http, fd) : nullptr;
+    if (!handle)
+        close(fd);
+    return handle;
+#else
+    return nullptr;
+#endif
+}
+
+/**
+ * Bind HTTP server to specified addresses, recording the endpoints bound.
+ * With fReusePort, other event loops can bind the same endpoints where
+ * supported.
+ */
+static bool HTTPBindAddresses(struct evhttp* http, bool fReusePort, std::vector<evhttp_bound_socket *>& boundSockets, std::vector<HTTPEndpoint>& boundEndpoints)
 {
     int defaultPort = gArgs.GetArg("-rpcport", BaseParams().RPCPort());
-    std::vector<std::pair<std::string, uint16_t> > endpoints;
+    std::vector<HTTPEndpoint> endpoints;
 
     // Determine what addresses to bind to
     if (!gArgs.IsArgSet("-rpcallowip")) { // Default to loopback if not allowing external IPs
@@ -343,11 +444,14 @@ static bool HTTPBindAddresses(struct evhttp* http)
     }
 
     // Bind addresses
-    for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+    for (std::vector<HTTPEndpoint>::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint(BCLog::HTTP, "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? nullptr : i->first.c_str(), i->second);
+        evhttp_bound_socket *bind_handle = fReusePort ? HTTPBindReusePort(http, *i) : nullptr;
+        if (!bind_handle)
+            bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? nullptr : i->first.c_str(), i->second);
         if (bind_handle) {
             boundSockets.push_back(bind_handle);
+            boundEndpoints.push_back(*i);
         } else {
             LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
         }
@@ -355,6 +459,47 @@ static bool HTTPBindAddresses(struct evhttp* http)
     return !boundSockets.empty();
 }
 
+/**
+ * Have http accept connections on the endpoints bound for another server too.
+ * Each endpoint gets its own SO_REUSEPORT socket where possible. Otherwise
+ * the loop listens on a duplicate of the other server's socket, and whichever
+ * loop accepts a connection serves it.
+ */
+static bool HTTPShareBoundSockets(const std::vector<evhttp_bound_socket *>& bound, const std::vector<HTTPEndpoint>& endpoints, struct evhttp* http, std::vector<evhttp_bound_socket *>& boundSockets)
+{
+    for (size_t i = 0; i < bound.size(); i++) {
+        evhttp_bound_socket *handle = HTTPBindReusePort(http, endpoints[i]);
+#ifndef WIN32
+        if (!handle) {
+            evutil_socket_t fd = dup(evhttp_bound_socket_get_fd(bound[i]));
+            if (fd < 0)
+                return false;
+            handle = evhttp_accept_socket_with_handle(http, fd);
+            if (!handle)
+                close(fd);
+        }
+#endif
+        if (!handle)
+            return false;
+        boundSockets.push_back(handle);
+    }
+    return true;
+}
+
+/** Create an HTTP server on base with our settings */
+static raii_evhttp CreateHTTP(struct event_base* base)
+{
+    raii_evhttp http_ctr = obtain_evhttp(base);
+    struct evhttp* http = http_ctr.get();
+    if (http) {
+        evhttp_set_timeout(http, httpServerTimeout);
+        evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(http, MAX_SIZE);
+        evhttp_set_gencb(http, http_request_cb, nullptr);
+    }
+    return http_ctr;
+}
+
 /** Simple wrapper to set thread name and run work queue */
 static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
 {
@@ -402,24 +547,35 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    raii_event_base base_ctr = obtain_event_base();
-
-    /* Create a new evhttp object to handle requests. */
-    raii_evhttp http_ctr = obtain_evhttp(base_ctr.get());
-    struct evhttp* http = http_ctr.get();
-    if (!http) {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        return false;
-    }
-
-    evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(http, MAX_SIZE);
-    evhttp_set_gencb(http, http_request_cb, nullptr);
+    httpServerTimeout = gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    int eventThreads = std::max((long)gArgs.GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS), 1L);
+#ifdef WIN32
+    // Sockets cannot be shared between loops with dup()
+    eventThreads = 1;
+#endif
+    std::vector<raii_event_base> base_ctrs;
+    std::vector<raii_evhttp> http_ctrs;
+    std::vector<std::vector<evhttp_bound_socket *>> boundSockets(eventThreads);
+    std::vector<HTTPEndpoint> boundEndpoints;
+    for (int i = 0; i < eventThreads; i++) {
+        base_ctrs.push_back(obtain_event_base());
+
+        /* Create a new evhttp object to handle requests. */
+        http_ctrs.push_back(CreateHTTP(base_ctrs.back().get()));
+        if (!http_ctrs.back()) {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            return false;
+        }
 
-    if (!HTTPBindAddresses(http)) {
-        LogPrintf("Unable to bind any endpoint for RPC server\n");
-        return false;
+        if (i == 0) {
+            if (!HTTPBindAddresses(http_ctrs[0].get(), eventThreads > 1, boundSockets[0], boundEndpoints)) {
+                LogPrintf("Unable to bind any endpoint for RPC server\n");
+                return false;
+            }
+        } else if (!HTTPShareBoundSockets(boundSockets[0], boundEndpoints, http_ctrs[i].get(), boundSockets[i])) {
+            LogPrintf("Unable to share RPC server sockets with event thread %d\n", i);
+            return false;
+        }
     }
 
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
@@ -427,9 +583,13 @@ bool InitHTTPServer()
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    // tranfer ownership to eventBase/HTTP via .release()
-    eventBase = base_ctr.release();
-    eventHTTP = http_ctr.release();
+    // tranfer ownership to eventLoops via .release()
+    eventLoops.resize(eventThreads);
+    for (int i = 0; i < eventThreads; i++) {
+        eventLoops[i].base = base_ctrs[i].release();
+        eventLoops[i].http = http_ctrs[i].release();
+        eventLoops[i].boundSockets = boundSockets[i];
+    }
     return true;
 }
 
@@ -447,17 +607,16 @@ bool UpdateHTTPServerLogging(bool enable) {
 #endif
 }
 
-std::thread threadHTTP;
-std::future<bool> threadResult;
-
 bool StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
     int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
-    threadResult = task.get_future();
-    threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
+    LogPrintf("HTTP: starting %d event threads and %d worker threads\n", eventLoops.size(), rpcThreads);
+    for (HTTPEventLoop& loop : eventLoops) {
+        std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
+        loop.result = task.get_future();
+        loop.thread = std::thread(std::move(task), loop.base, loop.http);
+    }
 
     for (int i = 0; i < rpcThreads; i++) {
         std::thread rpc_worker(HTTPWorkQueueRun, workQueue);
@@ -469,13 +628,14 @@ bool StartHTTPServer()
 void InterruptHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Interrupting HTTP server\n");
-    if (eventHTTP) {
+    for (HTTPEventLoop& loop : eventLoops) {
         // Unlisten sockets
-        for (evhttp_bound_socket *socket : boundSockets) {
-            evhttp_del_accept_socket(eventHTTP, socket);
+        for (evhttp_bound_socket *socket : loop.boundSockets) {
+            evhttp_del_accept_socket(loop.http, socket);
         }
+        loop.boundSockets.clear();
         // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, nullptr);
+        evhttp_set_gencb(loop.http, http_reject_request_cb, nullptr);
     }
     if (workQueue)
         workQueue->Interrupt();
@@ -490,34 +650,53 @@ void StopHTTPServer()
         delete workQueue;
         workQueue = nullptr;
     }
-    if (eventBase) {
-        LogPrint(BCLog::HTTP, "Waiting for HTTP event thread to exit\n");
+    LogPrint(BCLog::HTTP, "Waiting for HTTP event threads to exit\n");
+    for (HTTPEventLoop& loop : eventLoops) {
         // Give event loop a few seconds to exit (to send back last RPC responses), then break it
         // Before this was solved with event_base_loopexit, but that didn't work as expected in
         // at least libevent 2.0.21 and always introduced a delay. In libevent
         // master that appears to be solved, so in the future that solution
         // could be used again (if desirable).
         // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
-        if (threadResult.valid() && threadResult.wait_for(std::chrono::milliseconds(2000)) == std::future_status::timeout) {
+        if (loop.result.valid() && loop.result.wait_for(std::chrono::milliseconds(2000)) == std::future_status::timeout) {
             LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
-            event_base_loopbreak(eventBase);
+            event_base_loopbreak(loop.base);
         }
-        threadHTTP.join();
+        if (loop.thread.joinable())
+            loop.thread.join();
     }
-    if (eventHTTP) {
-        evhttp_free(eventHTTP);
-        eventHTTP = 0;
-    }
-    if (eventBase) {
-        event_base_free(eventBase);
-        eventBase = 0;
+    for (HTTPEventLoop& loop : eventLoops) {
+        evhttp_free(loop.http);
+        event_base_free(loop.base);
     }
+    eventLoops.clear();
     LogPrint(BCLog::HTTP, "Stopped HTTP server\n");
 }
 
 struct event_base* EventBase()
 {
-    return eventBase;
+    return eventLoops.empty() ? nullptr : eventLoops[0].base;
+}
+
+bool QueueHTTPWork(const std::function<void()>& func)
+{
+    if (!workQueue)
+        return false;
+    std::unique_ptr<HTTPFunctionItem> item(new HTTPFunctionItem(func));
+    // Leave half the queue to incoming requests
+    if (!workQueue->Enqueue(item.get(), workQueue->MaxDepth() / 2))
+        return false;
+    item.release();
+    return true;
+}
+
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats)
+{
+    if (!workQueue)
+        return false;
+    workQueue->GetStats(stats);
+    stats.eventThreads = eventLoops.size();
+    return true;
 }
 
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
@@ -556,6 +735,10 @@ HTTPRequest::~HTTPRequest()
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
+    } else if (req) {
+        // A chunked reply that was not ended must not look complete to the client
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyAbort();
     }
     // evhttpd cleans up the request, as long as a reply was sent.
 }
@@ -598,6 +781,56 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** How much of a chunked reply was sent. The event loop updates nAppended and
+ * nSent; the sending thread waits on them.
+ */
+struct HTTPReplyProgress
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Bytes given to WriteReplyChunk
+    uint64_t nPosted = 0;
+    //! Bytes added to the connection's output
+    uint64_t nAppended = 0;
+    //! Bytes the connection finished writing
+    uint64_t nSent = 0;
+    bool fClosed = false;
+};
+
+/** Called by evhttp when a connection's output was completely written */
+static void http_reply_sent_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyProgress* progress = static_cast<HTTPReplyProgress*>(arg);
+    std::unique_lock<std::mutex> lock(progress->cs);
+    progress->nSent = progress->nAppended;
+    progress->cond.notify_all();
+}
+
+/** The event loop serving the request's connection, which replies must go out on */
+static struct event_base* GetReplyEventBase(struct evhttp_request* req)
+{
+    evhttp_connection* conn = evhttp_request_get_connection(req);
+    if (conn)
+        return evhttp_connection_get_base(conn);
+    return EventBase();
+}
+
+/** Re-enable reading from the socket. This is the second part of the libevent
+ * workaround in http_request_cb.
+ */
+static void ReenableRead(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -611,25 +844,112 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
     auto req_copy = req;
-    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+    HTTPEvent* ev = new HTTPEvent(GetReplyEventBase(req), true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
-        }
+        ReenableRead(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
     req = nullptr; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req);
+    progress = std::make_shared<HTTPReplyProgress>();
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(GetReplyEventBase(req), true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk, bool fWait)
+{
+    assert(replySent && req && progress);
+    // Events on one base run in the order they were triggered, so chunks go out in order
+    auto req_copy = req;
+    auto progress_copy = progress;
+    HTTPEvent* ev = new HTTPEvent(GetReplyEventBase(req), true, [req_copy, progress_copy, strChunk]{
+        if (!evhttp_request_get_connection(req_copy)) {
+            // The connection failed; evhttp frees the request once the reply is ended
+            std::unique_lock<std::mutex> lock(progress_copy->cs);
+            progress_copy->fClosed = true;
+            progress_copy->cond.notify_all();
+            return;
+        }
+        struct evbuffer* evb = evbuffer_new();
+        assert(evb);
+        evbuffer_add(evb, strChunk.data(), strChunk.size());
+        {
+            std::unique_lock<std::mutex> lock(progress_copy->cs);
+            progress_copy->nAppended += strChunk.size();
+#if LIBEVENT_VERSION_NUMBER < 0x02010100
+            // No way to learn when it was sent, so do not hold the sender back
+            progress_copy->nSent = progress_copy->nAppended;
+#endif
+        }
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_sent_cb, progress_copy.get());
+        // Nothing may have been added, e.g. for HEAD requests
+        bufferevent* bev = evhttp_connection_get_bufferevent(evhttp_request_get_connection(req_copy));
+        if (bev && evbuffer_get_length(bufferevent_get_output(bev)) == 0)
+            http_reply_sent_cb(nullptr, progress_copy.get());
+#else
+        evhttp_send_reply_chunk(req_copy, evb);
+#endif
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+
+    std::unique_lock<std::mutex> lock(progress->cs);
+    progress->nPosted += strChunk.size();
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(httpServerTimeout);
+    while (fWait && !progress->fClosed && progress->nPosted - progress->nSent > MAX_HTTP_REPLY_BUFFERED) {
+        if (progress->cond.wait_until(lock, deadline) == std::cv_status::timeout) {
+            LogPrint(BCLog::HTTP, "Client stopped reading reply to %s\n", GetURI());
+            progress->fClosed = true;
+        }
+    }
+    return !progress->fClosed;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(replySent && req);
+    auto req_copy = req;
+    // The connection's write callback may still point at the progress; it is
+    // only replaced by evhttp_send_reply_end, so keep the progress alive until then
+    auto progress_copy = progress;
+    HTTPEvent* ev = new HTTPEvent(GetReplyEventBase(req), true, [req_copy, progress_copy]{
+        // Before ending, which may free the request and its connection
+        ReenableRead(req_copy);
+        evhttp_send_reply_end(req_copy);
+    });
+    ev->trigger(nullptr);
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::WriteReplyAbort()
+{
+    assert(replySent && req);
+    auto req_copy = req;
+    auto progress_copy = progress;
+    HTTPEvent* ev = new HTTPEvent(GetReplyEventBase(req), true, [req_copy, progress_copy]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) {
+            // Frees the request along with the connection
+            evhttp_connection_free(conn);
+        } else {
+            // The connection already failed; ending frees the request
+            evhttp_send_reply_end(req_copy);
+        }
+    });
+    ev->trigger(nullptr);
+    req = nullptr; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -8,15 +8,20 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_EVENT_THREADS=1;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Bytes of a chunked reply that may wait to be sent before WriteReplyChunk blocks */
+static const size_t MAX_HTTP_REPLY_BUFFERED = 4 * 1024 * 1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyProgress;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -51,6 +56,29 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Run func on a worker thread, if that leaves at least half of the work
+ * queue free for incoming requests. Returns false if it was not queued.
+ */
+bool QueueHTTPWork(const std::function<void()>& func);
+
+/** Work queue state and counters since the server started */
+struct HTTPWorkQueueStats
+{
+    int threads;
+    int eventThreads;
+    size_t depth;
+    size_t maxDepth;
+    size_t peakDepth;
+    uint64_t processed;
+    //! Requests turned away because the queue was full
+    uint64_t rejected;
+    //! Time items spent queued before a worker picked them up
+    int64_t totalWaitMicros;
+    int64_t maxWaitMicros;
+};
+/** Get work queue stats. Returns false if the HTTP server is not running. */
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats);
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -59,6 +87,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! How much of a chunked reply was sent, shared with the event loop
+    std::shared_ptr<HTTPReplyProgress> progress;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -114,6 +144,33 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write a reply in pieces, for bodies too large to build in memory first:
+     * WriteReplyStart once, then WriteReplyChunk for each piece, then
+     * WriteReplyEnd. HTTP/1.1 clients get a chunked reply.
+     *
+     * @note call WriteHeader before WriteReplyStart. The request is given back
+     * to the main thread by WriteReplyEnd or WriteReplyAbort, or by the
+     * destructor, which aborts the reply, if neither was called.
+     */
+    void WriteReplyStart(int nStatus);
+    /**
+     * Queue a chunk of the reply. While more than MAX_HTTP_REPLY_BUFFERED
+     * bytes are waiting to be sent, this waits for the client to read them,
+     * unless fWait is false. Pass false while holding locks such as cs_main,
+     * so that a slow client cannot stall others; the chunks then queue up
+     * until a later call that waits. Returns false if the client went away
+     * or stopped reading, after which it is pointless to send more.
+     */
+    bool WriteReplyChunk(const std::string& strChunk, bool fWait = true);
+    void WriteReplyEnd();
+    /**
+     * Give up on a reply that was started, by closing the connection without
+     * the final chunk, so the client can tell it is incomplete. Use instead
+     * of WriteReplyEnd.
+     */
+    void WriteReplyAbort();
 };
 
 /** Event handler closure.
@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "knowninventory.h"
+
+#include "memusage.h"
+#include "random.h"
+
+#include <algorithm>
+#include <limits>
+
+CKnownInventoryTable::CKnownInventoryTable(uint32_t nSlots) :
+    mapSlots(0, SaltedHasher{GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())}),
+    nNext(0)
+{
+    const uint32_t nChunks = std::max<uint32_t>(1, (nSlots + CHUNK_SLOTS - 1) / CHUNK_SLOTS);
+    vSlotHash.resize(nChunks * CHUNK_SLOTS);
+    vChunkEpoch.resize(nChunks);
+    mapSlots.reserve(vSlotHash.size());
+}
+
+CKnownInventoryTable::Slot CKnownInventoryTable::Assign(const uint256& hash)
+{
+    Slot slot;
+    if (Find(hash, slot))
+        return slot;
+
+    boost::unique_lock<boost::shared_mutex> lock(mutex);
+    // Another thread may have assigned it in between
+    auto it = mapSlots.find(hash);
+    if (it != mapSlots.end())
+        return Slot{it->second, vChunkEpoch[it->second / CHUNK_SLOTS]};
+
+    const uint32_t nChunk = nNext / CHUNK_SLOTS;
+    if (nNext % CHUNK_SLOTS == 0) {
+        // Starting on a chunk: whatever its slots held before is forgotten,
+        // and the new epoch tells peers their bits for it no longer apply
+        for (uint32_t i = nNext; i < nNext + CHUNK_SLOTS; i++) {
+            auto itOld = mapSlots.find(vSlotHash[i]);
+            if (itOld != mapSlots.end() && itOld->second == i)
+                mapSlots.erase(itOld);
+        }
+        vChunkEpoch[nChunk]++;
+    }
+    mapSlots.emplace(hash, nNext);
+    vSlotHash[nNext] = hash;
+    slot = Slot{nNext, vChunkEpoch[nChunk]};
+    if (++nNext == vSlotHash.size())
+        nNext = 0;
+    return slot;
+}
+
+bool CKnownInventoryTable::Find(const uint256& hash, Slot& slot) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    auto it = mapSlots.find(hash);
+    if (it == mapSlots.end())
+        return false;
+    slot.nIndex = it->second;
+    slot.nEpoch = vChunkEpoch[it->second / CHUNK_SLOTS];
+    return true;
+}
+
+size_t CKnownInventoryTable::DynamicMemoryUsage() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    return memusage::DynamicUsage(mapSlots) + memusage::DynamicUsage(vSlotHash) + memusage::DynamicUsage(vChunkEpoch);
+}
+
+CKnownInventory::CKnownInventory(CKnownInventoryTable& tableIn) : table(tableIn), filterFromPeer(PEER_FILTER_SIZE, 0.000001)
+{
+    reset();
+}
+
+void CKnownInventory::SetBit(const CKnownInventoryTable::Slot& slot)
+{
+    const uint32_t nChunk = slot.nIndex / CKnownInventoryTable::CHUNK_SLOTS;
+    if (vEpochs[nChunk] != slot.nEpoch) {
+        vEpochs[nChunk] = slot.nEpoch;
+        vBits[nChunk] = 0;
+    }
+    vBits[nChunk] |= uint64_t{1} << (slot.nIndex % CKnownInventoryTable::CHUNK_SLOTS);
+}
+
+void CKnownInventory::insert(const uint256& hash)
+{
+    SetBit(table.Assign(hash));
+}
+
+void CKnownInventory::insertFromPeer(const uint256& hash)
+{
+    CKnownInventoryTable::Slot slot;
+    if (table.Find(hash, slot))
+        SetBit(slot);
+    else
+        filterFromPeer.insert(hash);
+}
+
+bool CKnownInventory::contains(const uint256& hash) const
+{
+    CKnownInventoryTable::Slot slot;
+    if (table.Find(hash, slot)) {
+        const uint32_t nChunk = slot.nIndex / CKnownInventoryTable::CHUNK_SLOTS;
+        if (vEpochs[nChunk] == slot.nEpoch && ((vBits[nChunk] >> (slot.nIndex % CKnownInventoryTable::CHUNK_SLOTS)) & 1))
+            return true;
+    }
+    return filterFromPeer.contains(hash);
+}
+
+void CKnownInventory::reset()
+{
+    const uint32_t nChunks = table.GetSlotCount() / CKnownInventoryTable::CHUNK_SLOTS;
+    vBits.assign(nChunks, 0);
+    vEpochs.assign(nChunks, 0);
+    filterFromPeer.reset();
+}
+
+size_t CKnownInventory::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vBits) + memusage::DynamicUsage(vEpochs) + filterFromPeer.DynamicMemoryUsage();
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_KNOWNINVENTORY_H
+#define BITCOIN_KNOWNINVENTORY_H
+
+#include "bloom.h"
+#include "hash.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
+
+/**
+ * The most recently seen inventory hashes, shared by every peer's
+ * CKnownInventory. Each hash is given a slot in a ring; once the ring is full
+ * the oldest slots are handed out again, 64 at a time, and the epoch of such a
+ * chunk of slots is bumped so that peers notice their bits for it are stale.
+ *
+ * A hash is stored once however many peers know it, so the per-peer state
+ * shrinks to a bit per slot. Only inventory we announce is given a slot, so
+ * what fills the ring is paced by our own relay rather than by any one peer.
+ * Thread-safe; lookups only take the lock shared.
+ */
+class CKnownInventoryTable
+{
+public:
+    struct Slot {
+        uint32_t nIndex;
+        uint32_t nEpoch;
+    };
+
+    //! Slots are handed out in chunks of this many, one bitset word per peer
+    static const uint32_t CHUNK_SLOTS = 64;
+
+    /** nSlots is rounded up to a whole number of chunks */
+    explicit CKnownInventoryTable(uint32_t nSlots);
+
+    /** The slot of hash, giving it the next one in the ring if it has none */
+    Slot Assign(const uint256& hash);
+    /** The slot of hash, if it has one */
+    bool Find(const uint256& hash, Slot& slot) const;
+
+    uint32_t GetSlotCount() const { return vSlotHash.size(); }
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct SaltedHasher {
+        uint64_t k0, k1;
+        size_t operator()(const uint256& hash) const { return SipHashUint256(k0, k1, hash); }
+    };
+
+    mutable boost::shared_mutex mutex;
+    std::unordered_map<uint256, uint32_t, SaltedHasher> mapSlots;
+    std::vector<uint256> vSlotHash;
+    std::vector<uint32_t> vChunkEpoch;
+    //! Next slot to hand out
+    uint32_t nNext;
+};
+
+/**
+ * The inventory a peer is known to have, as a set of slots of a shared
+ * CKnownInventoryTable. Unlike a rolling bloom filter it has no false
+ * positives; hashes are forgotten instead when the table recycles their slots,
+ * that is after a table's worth of newer hashes was announced to any peer.
+ * What the peer told us about that has no slot yet goes in a small rolling
+ * bloom filter of its own, so a peer announcing made-up hashes only pushes out
+ * its own entries.
+ *
+ * Not thread-safe; CNode keeps it under cs_inventory.
+ */
+class CKnownInventory
+{
+public:
+    //! Hashes without a slot the peer's own filter holds
+    static const unsigned int PEER_FILTER_SIZE = 1000;
+
+    explicit CKnownInventory(CKnownInventoryTable& tableIn);
+
+    /** A hash we announce to the peer, which is given a slot if it has none */
+    void insert(const uint256& hash);
+    /** A hash the peer announced or sent, which is never given a slot */
+    void insertFromPeer(const uint256& hash);
+    bool contains(const uint256& hash) const;
+    void reset();
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    CKnownInventoryTable& table;
+    //! A bit per slot of the table, and the epoch of each chunk they belong to
+    std::vector<uint64_t> vBits;
+    std::vector<uint32_t> vEpochs;
+    CRollingBloomFilter filterFromPeer;
+
+    void SetBit(const CKnownInventoryTable::Slot& slot);
+};
+
+#endif // BITCOIN_KNOWNINVENTORY_H
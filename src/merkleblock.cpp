@@ -9,7 +9,7 @@
 #include "consensus/consensus.h"
 #include "utilstrencodings.h"
 
-CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
+CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter, CBloomElementsCache* pelementsCache, const std::vector<std::vector<uint256> >* pvTreeLevels)
 {
     header = block.GetBlockHeader();
 
@@ -22,7 +22,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const uint256& hash = block.vtx[i]->GetHash();
-        if (filter.IsRelevantAndUpdate(*block.vtx[i]))
+        if (pelementsCache ? filter.IsRelevantAndUpdate(*block.vtx[i], *pelementsCache) : filter.IsRelevantAndUpdate(*block.vtx[i]))
         {
             vMatch.push_back(true);
             vMatchedTxn.push_back(std::make_pair(i, hash));
@@ -32,7 +32,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
         vHashes.push_back(hash);
     }
 
-    txn = CPartialMerkleTree(vHashes, vMatch);
+    txn = pvTreeLevels ? CPartialMerkleTree(*pvTreeLevels, vMatch) : CPartialMerkleTree(vHashes, vMatch);
 }
 
 CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
@@ -78,7 +78,7 @@ uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::ve
     }
 }
 
-void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch, const std::vector<std::vector<uint256> > *pvLevels) {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
     for (unsigned int p = pos << height; p < (pos+1) << height && p < nTransactions; p++)
@@ -87,12 +87,12 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     vBits.push_back(fParentOfMatch);
     if (height==0 || !fParentOfMatch) {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(pvLevels ? (*pvLevels)[height][pos] : CalcHash(height, pos, vTxid));
     } else {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height-1, pos*2, vTxid, vMatch);
+        TraverseAndBuild(height-1, pos*2, vTxid, vMatch, pvLevels);
         if (pos*2+1 < CalcTreeWidth(height-1))
-            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch);
+            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch, pvLevels);
     }
 }
 
@@ -145,7 +145,29 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
         nHeight++;
 
     // traverse the partial tree
-    TraverseAndBuild(nHeight, 0, vTxid, vMatch);
+    TraverseAndBuild(nHeight, 0, vTxid, vMatch, nullptr);
+}
+
+CPartialMerkleTree::CPartialMerkleTree(const std::vector<std::vector<uint256> > &vLevels, const std::vector<bool> &vMatch) : nTransactions(vLevels[0].size()), fBad(false) {
+    // the top level is the root
+    TraverseAndBuild(vLevels.size() - 1, 0, vLevels[0], vMatch, &vLevels);
+}
+
+std::vector<std::vector<uint256> > CPartialMerkleTree::CalcTreeLevels(const std::vector<uint256> &vTxid) {
+    assert(vTxid.size() != 0);
+    std::vector<std::vector<uint256> > vLevels(1, vTxid);
+    while (vLevels.back().size() > 1) {
+        const std::vector<uint256> &vBelow = vLevels.back();
+        std::vector<uint256> vLevel((vBelow.size() + 1) / 2);
+        for (unsigned int pos = 0; pos < vLevel.size(); pos++) {
+            // as in CalcHash, a missing right child is a copy of the left one
+            const uint256 &left = vBelow[pos*2];
+            const uint256 &right = pos*2+1 < vBelow.size() ? vBelow[pos*2+1] : left;
+            vLevel[pos] = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+        }
+        vLevels.push_back(std::move(vLevel));
+    }
+    return vLevels;
 }
 
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
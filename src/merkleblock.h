@@ -70,8 +70,8 @@ protected:
     /** calculate the hash of a node in the merkle tree (at leaf level: the txid's themselves) */
     uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid);
 
-    /** recursive function that traverses tree nodes, storing the data as bits and hashes */
-    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    /** recursive function that traverses tree nodes, storing the data as bits and hashes (taken from pvLevels if given) */
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch, const std::vector<std::vector<uint256> > *pvLevels);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -107,6 +107,12 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** Same, from the hashes of the whole tree as returned by CalcTreeLevels, which can be shared by many partial trees */
+    CPartialMerkleTree(const std::vector<std::vector<uint256> > &vLevels, const std::vector<bool> &vMatch);
+
+    /** All node hashes of the merkle tree over vTxid, level by level from the txids up to the root */
+    static std::vector<std::vector<uint256> > CalcTreeLevels(const std::vector<uint256> &vTxid);
+
     CPartialMerkleTree();
 
     /**
@@ -139,8 +145,11 @@ public:
      * Create from a CBlock, filtering transactions according to filter
      * Note that this will call IsRelevantAndUpdate on the filter for each transaction,
      * thus the filter will likely be modified.
+     * When the block is filtered for many peers, pelementsCache shares the
+     * hashing of the transactions' data elements and pvTreeLevels (from
+     * CPartialMerkleTree::CalcTreeLevels) the merkle tree hashes.
      */
-    CMerkleBlock(const CBlock& block, CBloomFilter& filter);
+    CMerkleBlock(const CBlock& block, CBloomFilter& filter, CBloomElementsCache* pelementsCache = nullptr, const std::vector<std::vector<uint256> >* pvTreeLevels = nullptr);
 
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
@@ -36,6 +36,7 @@
 #endif
 
 
+#include <algorithm>
 #include <math.h>
 
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
@@ -44,6 +45,15 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for socket events in one round, in
+// milliseconds. This is also the frequency to poll pnode->vSend.
+static const int SOCKET_EVENTS_TIMEOUT = 50;
+
+#ifdef USE_EPOLL
+// Maximum number of events fetched by one epoll_wait() call
+static const int MAX_EPOLL_EVENTS = 1024;
+#endif
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -386,7 +396,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsWatchableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return nullptr;
@@ -464,6 +474,7 @@ void CConnman::ClearBanned()
     {
         LOCK(cs_setBanned);
         setBanned.clear();
+        banTrie.Clear();
         setBannedIsDirty = true;
     }
     DumpBanlist(); //store banlist to disk
@@ -474,16 +485,7 @@ void CConnman::ClearBanned()
 bool CConnman::IsBanned(CNetAddr ip)
 {
     LOCK(cs_setBanned);
-    for (banmap_t::iterator it = setBanned.begin(); it != setBanned.end(); it++)
-    {
-        CSubNet subNet = (*it).first;
-        CBanEntry banEntry = (*it).second;
-
-        if (subNet.Match(ip) && GetTime() < banEntry.nBanUntil) {
-            return true;
-        }
-    }
-    return false;
+    return banTrie.Match(ip, GetTime());
 }
 
 bool CConnman::IsBanned(CSubNet subnet)
@@ -519,6 +521,7 @@ void CConnman::Ban(const CSubNet& subNet, const BanReason &banReason, int64_t ba
         LOCK(cs_setBanned);
         if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
             setBanned[subNet] = banEntry;
+            banTrie.Insert(subNet, banEntry.nBanUntil);
             setBannedIsDirty = true;
         }
         else
@@ -547,6 +550,7 @@ bool CConnman::Unban(const CSubNet &subNet) {
         LOCK(cs_setBanned);
         if (!setBanned.erase(subNet))
             return false;
+        banTrie.Reset(setBanned);
         setBannedIsDirty = true;
     }
     if(clientInterface)
@@ -567,14 +571,48 @@ void CConnman::SetBanned(const banmap_t &banMap)
 {
     LOCK(cs_setBanned);
     setBanned = banMap;
+    banTrie.Reset(setBanned);
     setBannedIsDirty = true;
 }
 
+size_t CConnman::ImportBanned(const banmap_t &banMap)
+{
+    size_t nChanged = 0;
+    {
+        LOCK(cs_setBanned);
+        for (const std::pair<const CSubNet, CBanEntry>& item : banMap) {
+            if (!item.first.IsValid())
+                continue;
+            CBanEntry& banEntry = setBanned[item.first];
+            if (banEntry.nBanUntil < item.second.nBanUntil) {
+                banEntry = item.second;
+                banTrie.Insert(item.first, banEntry.nBanUntil);
+                nChanged++;
+            }
+        }
+        if (nChanged == 0)
+            return 0;
+        setBannedIsDirty = true;
+    }
+    if(clientInterface)
+        clientInterface->BannedListChanged();
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            if (IsBanned((CNetAddr)pnode->addr))
+                pnode->fDisconnect = true;
+        }
+    }
+    DumpBanlist();
+    return nChanged;
+}
+
 void CConnman::SweepBanned()
 {
     int64_t now = GetTime();
 
     LOCK(cs_setBanned);
+    bool fErased = false;
     banmap_t::iterator it = setBanned.begin();
     while(it != setBanned.end())
     {
@@ -584,11 +622,15 @@ void CConnman::SweepBanned()
         {
             setBanned.erase(it++);
             setBannedIsDirty = true;
+            fErased = true;
             LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
         }
         else
             ++it;
     }
+    // Lookups already skip expired bans; the index only needs to shrink
+    if (fErased)
+        banTrie.Reset(setBanned);
 }
 
 bool CConnman::BannedSetIsDirty()
@@ -673,6 +715,11 @@ void CNode::copyStats(CNodeStats &stats)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_msgCost);
+        X(mapCostPerMsgCmd);
+        X(sendMessagesCost);
+    }
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -706,10 +753,17 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     nRecvBytes += nBytes;
     while (nBytes > 0) {
 
-        // get current incomplete message, or create a new one
+        // get current incomplete message, or reuse or create a new one
         if (vRecvMsg.empty() ||
-            vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.back().complete()) {
+            LOCK(cs_vProcessMsg);
+            if (!vRecvPool.empty()) {
+                nRecvPoolSize -= vRecvPool.front().GetMemoryUsage();
+                vRecvMsg.splice(vRecvMsg.end(), vRecvPool, vRecvPool.begin());
+            } else {
+                vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+            }
+        }
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -749,6 +803,50 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::RecycleMessages(std::list<CNetMessage>& msgs)
+{
+    // Messages that do not fit are freed after releasing the lock
+    std::list<CNetMessage> msgsFree;
+    for (CNetMessage& msg : msgs)
+        msg.Reset();
+    {
+        LOCK(cs_vProcessMsg);
+        while (!msgs.empty()) {
+            const size_t nUsage = msgs.front().GetMemoryUsage();
+            if (vRecvPool.size() < MAX_RECV_POOL_MSGS && nRecvPoolSize + nUsage <= MAX_RECV_POOL_SIZE) {
+                nRecvPoolSize += nUsage;
+                vRecvPool.splice(vRecvPool.end(), msgs, msgs.begin());
+            } else {
+                msgsFree.splice(msgsFree.end(), msgs, msgs.begin());
+            }
+        }
+    }
+}
+
+void CNode::AddMsgCost(const std::string& strCommand, int64_t nMicros, int64_t nMainLockMicros, bool fNew)
+{
+    LOCK(cs_msgCost);
+    if (strCommand.empty()) {
+        sendMessagesCost.Add(nMicros, nMainLockMicros, fNew);
+        return;
+    }
+    mapMsgCmdCost::iterator it = mapCostPerMsgCmd.find(strCommand);
+    if (it == mapCostPerMsgCmd.end())
+        it = mapCostPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(it != mapCostPerMsgCmd.end());
+    it->second.Add(nMicros, nMainLockMicros, fNew);
+}
+
+void CNode::GetMsgCosts(mapMsgCmdCost& mapCost, CMsgCost& sendCost)
+{
+    LOCK(cs_msgCost);
+    for (const mapMsgCmdCost::value_type& item : mapCostPerMsgCmd) {
+        if (item.second.nCount > 0 || item.second.nTotalMicros > 0)
+            mapCost[item.first] += item.second;
+    }
+    sendCost += sendMessagesCost;
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -812,13 +910,14 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
+    if (vRecv.capacity() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.reserve(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
 
+    // Append rather than resize and overwrite, so the space is not zeroed first
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -832,6 +931,20 @@ const uint256& CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
+void CNetMessage::Reset()
+{
+    hasher.Reset();
+    data_hash.SetNull();
+    in_data = false;
+    hdrbuf.clear();
+    hdrbuf.resize(24);
+    nHdrPos = 0;
+    vRecv.clear();
+    nDataPos = 0;
+    nTime = 0;
+    SetVersion(INIT_PROTO_VERSION);
+}
+
 
 
 
@@ -1075,7 +1188,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!IsWatchableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1116,13 +1229,479 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     {
         LOCK(cs_vNodes);
+        RegisterSocketEvents(pnode);
         vNodes.push_back(pnode);
     }
 }
 
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == "select") {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef USE_POLL
+    if (str == "poll") {
+        mode = SOCKETEVENTS_POLL;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SOCKETEVENTS_SELECT: return "select";
+    case SOCKETEVENTS_POLL: return "poll";
+    case SOCKETEVENTS_EPOLL: return "epoll";
+    default: return "";
+    }
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string strModes = "select";
+#ifdef USE_POLL
+    strModes += ", poll";
+#endif
+#ifdef USE_EPOLL
+    strModes += ", epoll";
+#endif
+    return strModes;
+}
+
+bool CConnman::IsWatchableSocket(const SOCKET& hSocket) const
+{
+    return socketEventsMode != SOCKETEVENTS_SELECT || IsSelectableSocket(hSocket);
+}
+
+void CConnman::StartSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        // Listening sockets are level-triggered, so that connections queued
+        // behind the first one are accepted in the following rounds.
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (epollfd == -1)
+                break;
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = const_cast<ListenSocket*>(&hListenSocket);
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1) {
+                close(epollfd);
+                epollfd = -1;
+            }
+        }
+        if (epollfd == -1) {
+            LogPrintf("Setting up epoll failed (%s), falling back to poll\n", NetworkErrorString(WSAGetLastError()));
+            socketEventsMode = SOCKETEVENTS_POLL;
+        }
+    }
+#endif
+    LogPrintf("Using %s to wait for socket events\n", GetSocketEventsModeName(socketEventsMode));
+}
+
+void CConnman::StopSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+    setRecvReadyNodes.clear();
+#endif
+}
+
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+    AssertLockHeld(cs_vNodes);
+#ifdef USE_EPOLL
+    if (epollfd == -1)
+        return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+        return;
+    }
+    pnode->AddRef();
+    pnode->fSocketEventsRegistered = true;
+#endif
+}
+
+void CConnman::UnregisterSocketEvents(CNode* pnode)
+{
+    AssertLockHeld(cs_vNodes);
+#ifdef USE_EPOLL
+    setRecvReadyNodes.erase(pnode);
+    if (!pnode->fSocketEventsRegistered)
+        return;
+
+    {
+        LOCK(pnode->cs_hSocket);
+        // A socket closed elsewhere already left the epoll set, and its
+        // descriptor may belong to another connection by now.
+        if (pnode->hSocket != INVALID_SOCKET)
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, pnode->hSocket, nullptr);
+    }
+    pnode->fSocketEventsRegistered = false;
+    pnode->Release();
+#endif
+}
+
+bool CConnman::GetSocketInterest(CNode* pnode, SOCKET& hSocket, bool& fWantRecv, bool& fWantSend)
+{
+    // Implement the following logic:
+    // * If there is data to send, wait for sending data. As this only
+    //   happens when optimistic write failed, we choose to first drain the
+    //   write buffer in this case before receiving more. This avoids
+    //   needlessly queueing received data, if the remote peer is not themselves
+    //   receiving data. This means properly utilizing TCP flow control signalling.
+    // * Otherwise, if there is space left in the receive buffer, wait for
+    //   receiving data.
+    // * Hand off all complete messages to the processor, to be handled without
+    //   blocking here.
+    {
+        LOCK(pnode->cs_vSend);
+        fWantSend = !pnode->vSendMsg.empty();
+    }
+    fWantRecv = !fWantSend && !pnode->fPauseRecv;
+
+    LOCK(pnode->cs_hSocket);
+    hSocket = pnode->hSocket;
+    return hSocket != INVALID_SOCKET;
+}
+
+void CConnman::WaitForSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set)
+{
+    switch (socketEventsMode) {
+#ifdef USE_EPOLL
+    case SOCKETEVENTS_EPOLL:
+        EpollSocketEvents(recv_set, send_set, error_set, listen_set);
+        return;
+#endif
+#ifdef USE_POLL
+    case SOCKETEVENTS_POLL:
+        PollSocketEvents(recv_set, send_set, error_set, listen_set);
+        return;
+#endif
+    default:
+        SelectSocketEvents(recv_set, send_set, error_set, listen_set);
+        return;
+    }
+}
+
+void CConnman::SelectSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set)
+{
+    struct timeval timeout = MillisToTimeval(SOCKET_EVENTS_TIMEOUT);
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    std::vector<std::pair<CNode*, SOCKET>> vNodeSockets;
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            SOCKET hSocket;
+            bool fWantRecv, fWantSend;
+            if (!GetSocketInterest(pnode, hSocket, fWantRecv, fWantSend))
+                continue;
+
+            vNodeSockets.emplace_back(pnode, hSocket);
+            FD_SET(hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, hSocket);
+            have_fds = true;
+
+            if (fWantSend)
+                FD_SET(hSocket, &fdsetSend);
+            if (fWantRecv)
+                FD_SET(hSocket, &fdsetRecv);
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT)))
+            return;
+    }
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            listen_set.push_back(&hListenSocket);
+    }
+    for (const auto& it : vNodeSockets) {
+        if (FD_ISSET(it.second, &fdsetRecv))
+            recv_set.insert(it.first);
+        if (FD_ISSET(it.second, &fdsetSend))
+            send_set.insert(it.first);
+        if (FD_ISSET(it.second, &fdsetError))
+            error_set.insert(it.first);
+    }
+}
+
+#ifdef USE_POLL
+void CConnman::PollSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set)
+{
+    // The listening sockets come first, followed by one entry per node
+    std::vector<struct pollfd> vPollFds;
+    std::vector<CNode*> vPollNodes;
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        struct pollfd pollfd = {};
+        pollfd.fd = hListenSocket.socket;
+        pollfd.events = POLLIN;
+        vPollFds.push_back(pollfd);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            SOCKET hSocket;
+            bool fWantRecv, fWantSend;
+            if (!GetSocketInterest(pnode, hSocket, fWantRecv, fWantSend))
+                continue;
+
+            // POLLERR and POLLHUP are always reported
+            struct pollfd pollfd = {};
+            pollfd.fd = hSocket;
+            pollfd.events = (fWantRecv ? POLLIN : 0) | (fWantSend ? POLLOUT : 0);
+            vPollFds.push_back(pollfd);
+            vPollNodes.push_back(pnode);
+        }
+    }
+
+    int nRet = poll(vPollFds.data(), vPollFds.size(), SOCKET_EVENTS_TIMEOUT);
+    if (interruptNet)
+        return;
+
+    if (nRet == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket poll error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT));
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < vPollFds.size(); i++) {
+        if (vPollFds[i].revents == 0)
+            continue;
+        if (i < vhListenSocket.size()) {
+            listen_set.push_back(&vhListenSocket[i]);
+            continue;
+        }
+        CNode* pnode = vPollNodes[i - vhListenSocket.size()];
+        if (vPollFds[i].revents & POLLIN)
+            recv_set.insert(pnode);
+        if (vPollFds[i].revents & POLLOUT)
+            send_set.insert(pnode);
+        if (vPollFds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            error_set.insert(pnode);
+    }
+}
+#endif
+
+#ifdef USE_EPOLL
+void CConnman::EpollSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set)
+{
+    // Sockets stay registered for both directions, so unlike with select()
+    // and poll() the interest in receiving is applied to what epoll reports.
+    auto wants_recv = [](CNode* pnode) {
+        if (pnode->fPauseRecv)
+            return false;
+        LOCK(pnode->cs_vSend);
+        return pnode->vSendMsg.empty();
+    };
+
+    // Don't block if data is still waiting to be read from an earlier round
+    int nTimeout = SOCKET_EVENTS_TIMEOUT;
+    for (CNode* pnode : setRecvReadyNodes) {
+        if (wants_recv(pnode)) {
+            nTimeout = 0;
+            break;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, nTimeout);
+    if (interruptNet)
+        return;
+
+    if (nEvents == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        const ListenSocket* pListenSocket = nullptr;
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (events[i].data.ptr == &hListenSocket)
+                pListenSocket = &hListenSocket;
+        }
+        if (pListenSocket) {
+            listen_set.push_back(pListenSocket);
+            continue;
+        }
+
+        // Registered nodes hold a reference until UnregisterSocketEvents,
+        // which only this thread calls.
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            setRecvReadyNodes.insert(pnode);
+        if (events[i].events & EPOLLOUT)
+            send_set.insert(pnode);
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            error_set.insert(pnode);
+    }
+
+    for (CNode* pnode : setRecvReadyNodes) {
+        if (wants_recv(pnode))
+            recv_set.insert(pnode);
+    }
+}
+#endif
+
+bool CConnman::SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                if (!it->complete())
+                    break;
+                nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize + pnode->nRecvPoolSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler(pnode);
+        }
+        return true;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed\n");
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+        return nErr == WSAEINTR;
+    }
+    return false;
+}
+
+void CConnman::InactivityCheck(CNode* pnode, int64_t nTime)
+{
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+        else if (!pnode->fSuccessfullyConnected)
+        {
+            LogPrintf("version handshake timeout from %d\n", pnode->GetId());
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
     while (!interruptNet)
     {
         //
@@ -1142,7 +1721,8 @@ void CConnman::ThreadSocketHandler()
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
+                    // stop watching the socket, then close it and cleanup
+                    UnregisterSocketEvents(pnode);
                     pnode->CloseSocketDisconnect();
 
                     // hold in disconnected pool until all refs are released
@@ -1187,109 +1767,32 @@ void CConnman::ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Find which sockets are ready
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<CNode*> recv_set;
+        std::set<CNode*> send_set;
+        std::set<CNode*> error_set;
+        std::vector<const ListenSocket*> listen_set;
+        WaitForSocketEvents(recv_set, send_set, error_set, listen_set);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket)
+        for (const ListenSocket* hListenSocket : listen_set)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            AcceptConnection(*hListenSocket);
         }
 
         //
-        // Service each socket
+        // Service each ready socket. Nodes only leave vNodes in this thread,
+        // so the reported ones stay alive until the next round.
         //
-        std::vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
-                pnode->AddRef();
-        }
-        for (CNode* pnode : vNodesCopy)
+        std::set<CNode*> service_set(recv_set);
+        service_set.insert(send_set.begin(), send_set.end());
+        service_set.insert(error_set.begin(), error_set.end());
+        for (CNode* pnode : service_set)
         {
             if (interruptNet)
                 return;
@@ -1297,76 +1800,19 @@ void CConnman::ThreadSocketHandler()
             //
             // Receive
             //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
+            if (recv_set.count(pnode) || error_set.count(pnode))
             {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
-            }
-            if (recvSet || errorSet)
-            {
-                // typical socket buffer is 8K-64K
-                char pchBuf[0x10000];
-                int nBytes = 0;
-                {
-                    LOCK(pnode->cs_hSocket);
-                    if (pnode->hSocket == INVALID_SOCKET)
-                        continue;
-                    nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                }
-                if (nBytes > 0)
-                {
-                    bool notify = false;
-                    if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                        pnode->CloseSocketDisconnect();
-                    RecordBytesRecv(nBytes);
-                    if (notify) {
-                        size_t nSizeAdded = 0;
-                        auto it(pnode->vRecvMsg.begin());
-                        for (; it != pnode->vRecvMsg.end(); ++it) {
-                            if (!it->complete())
-                                break;
-                            nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                        }
-                        {
-                            LOCK(pnode->cs_vProcessMsg);
-                            pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                            pnode->nProcessQueueSize += nSizeAdded;
-                            pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                        }
-                        WakeMessageHandler();
-                    }
-                }
-                else if (nBytes == 0)
-                {
-                    // socket closed gracefully
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket closed\n");
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-                else if (nBytes < 0)
-                {
-                    // error
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                    {
-                        if (!pnode->fDisconnect)
-                            LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                        pnode->CloseSocketDisconnect();
-                    }
-                }
+                bool fMoreData = SocketRecvData(pnode);
+#ifdef USE_EPOLL
+                if (!fMoreData)
+                    setRecvReadyNodes.erase(pnode);
+#endif
             }
 
             //
             // Send
             //
-            if (sendSet)
+            if (send_set.count(pnode))
             {
                 LOCK(pnode->cs_vSend);
                 size_t nBytes = SocketSendData(pnode);
@@ -1374,55 +1820,53 @@ void CConnman::ThreadSocketHandler()
                     RecordBytesSent(nBytes);
                 }
             }
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetSystemTimeInSeconds();
-            if (nTime - pnode->nTimeConnected > 60)
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetSystemTimeInSeconds();
+        if (nTime != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = nTime;
+            std::vector<CNode*> vNodesCopy;
             {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->GetId());
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-                else if (!pnode->fSuccessfullyConnected)
-                {
-                    LogPrintf("version handshake timeout from %d\n", pnode->GetId());
-                    pnode->fDisconnect = true;
-                }
+                LOCK(cs_vNodes);
+                vNodesCopy = vNodes;
+                for (CNode* pnode : vNodesCopy)
+                    pnode->AddRef();
             }
-        }
-        {
-            LOCK(cs_vNodes);
             for (CNode* pnode : vNodesCopy)
-                pnode->Release();
+                InactivityCheck(pnode, nTime);
+            {
+                LOCK(cs_vNodes);
+                for (CNode* pnode : vNodesCopy)
+                    pnode->Release();
+            }
         }
     }
 }
 
 void CConnman::WakeMessageHandler()
 {
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        MessageHandler& handler = *vMessageHandlers[i];
+        {
+            std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+            handler.fMsgProcWake = true;
+        }
+        handler.condMsgProc.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(const CNode* pnode)
+{
+    MessageHandler& handler = *vMessageHandlers[pnode->GetId() % nMessageHandlerThreads];
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+        handler.fMsgProcWake = true;
     }
-    condMsgProc.notify_one();
+    handler.condMsgProc.notify_one();
 }
 
 
@@ -1997,24 +2441,49 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     m_msgproc->InitializeNode(pnode);
     {
         LOCK(cs_vNodes);
+        RegisterSocketEvents(pnode);
         vNodes.push_back(pnode);
     }
 
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+/**
+ * Whether the next message queued for a peer is part of block propagation.
+ * Such peers are served first in each round of their message handler, so a
+ * new block is not kept waiting behind transaction traffic from other peers.
+ */
+static bool HasBlockRelayMessage(CNode* pnode)
 {
+    LOCK(pnode->cs_vProcessMsg);
+    if (pnode->vProcessMsg.empty())
+        return false;
+    const std::string strCommand = pnode->vProcessMsg.front().hdr.GetCommand();
+    return strCommand == NetMsgType::BLOCK ||
+           strCommand == NetMsgType::CMPCTBLOCK ||
+           strCommand == NetMsgType::BLOCKTXN ||
+           strCommand == NetMsgType::GETBLOCKTXN ||
+           strCommand == NetMsgType::HEADERS;
+}
+
+void CConnman::ThreadMessageHandler(int nHandler)
+{
+    MessageHandler& handler = *vMessageHandlers[nHandler];
     while (!flagInterruptMsgProc)
     {
+        // Each peer is handled by a single thread, so its messages are still
+        // processed in order. Shared state is protected by cs_main as before.
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
-                pnode->AddRef();
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % nMessageHandlerThreads == nHandler) {
+                    vNodesCopy.push_back(pnode);
+                    pnode->AddRef();
+                }
             }
         }
+        std::stable_partition(vNodesCopy.begin(), vNodesCopy.end(), HasBlockRelayMessage);
 
         bool fMoreWork = false;
 
@@ -2031,7 +2500,10 @@ void CConnman::ThreadMessageHandler()
             // Send messages
             {
                 LOCK(pnode->cs_sendProcessing);
+                const int64_t nStart = GetTimeMicros();
+                const int64_t nMainLockStart = GetTimedLockHeldMicros();
                 m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
+                pnode->AddMsgCost("", GetTimeMicros() - nStart, GetTimedLockHeldMicros() - nMainLockStart);
             }
 
             if (flagInterruptMsgProc)
@@ -2044,11 +2516,11 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
+        std::unique_lock<std::mutex> lock(handler.mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            handler.condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&handler] { return handler.fMsgProcWake; });
         }
-        fMsgProcWake = false;
+        handler.fMsgProcWake = false;
     }
 }
 
@@ -2079,7 +2551,7 @@ bool CConnman::BindListenPort(const CService &addrBind, std::string& strError, b
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!IsWatchableSocket(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
@@ -2240,6 +2712,12 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     semAddnode = nullptr;
     flagInterruptMsgProc = false;
     SetTryNewOutboundPeer(false);
+    for (int i = 0; i < MAX_MSGHAND_THREADS; i++) {
+        vMessageHandlers.emplace_back(new MessageHandler());
+    }
+#ifdef USE_EPOLL
+    epollfd = -1;
+#endif
 
     Options connOptions;
     Init(connOptions);
@@ -2299,6 +2777,8 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+    StartSocketEvents();
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2358,9 +2838,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        std::unique_lock<std::mutex> lock(vMessageHandlers[i]->mutexMsgProc);
+        vMessageHandlers[i]->fMsgProcWake = false;
     }
 
     // Send and receive from sockets, accept connections
@@ -2379,7 +2859,11 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        MessageHandler& handler = *vMessageHandlers[i];
+        handler.strName = nMessageHandlerThreads == 1 ? "msghand" : strprintf("msghand.%d", i);
+        handler.thread = std::thread(&TraceThread<std::function<void()> >, handler.strName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2404,11 +2888,13 @@ instance_of_cnetcleanup;
 
 void CConnman::Interrupt()
 {
-    {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        flagInterruptMsgProc = true;
+    for (const auto& handler : vMessageHandlers) {
+        {
+            std::lock_guard<std::mutex> lock(handler->mutexMsgProc);
+            flagInterruptMsgProc = true;
+        }
+        handler->condMsgProc.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2428,8 +2914,10 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (const auto& handler : vMessageHandlers) {
+        if (handler->thread.joinable())
+            handler->thread.join();
+    }
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2446,6 +2934,7 @@ void CConnman::Stop()
     }
 
     // Close sockets
+    StopSocketEvents();
     for (CNode* pnode : vNodes)
         pnode->CloseSocketDisconnect();
     for (ListenSocket& hListenSocket : vhListenSocket)
@@ -2477,6 +2966,10 @@ void CConnman::DeleteNode(CNode* pnode)
     if(fUpdateConnectionTime) {
         addrman.Connected(pnode->addr);
     }
+    {
+        LOCK(cs_msgCost);
+        pnode->GetMsgCosts(mapCostPerMsgCmd, sendMessagesCost);
+    }
     delete pnode;
 }
 
@@ -2549,6 +3042,18 @@ size_t CConnman::GetNodeCount(NumConnections flags)
     return nNum;
 }
 
+void CConnman::GetMsgCosts(mapMsgCmdCost& mapCost, CMsgCost& sendCost)
+{
+    {
+        LOCK(cs_msgCost);
+        mapCost = mapCostPerMsgCmd;
+        sendCost = sendMessagesCost;
+    }
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes)
+        pnode->GetMsgCosts(mapCost, sendCost);
+}
+
 void CConnman::GetNodeStats(std::vector<CNodeStats>& vstats)
 {
     vstats.clear();
@@ -2707,6 +3212,13 @@ int CConnman::GetBestHeight() const
 
 unsigned int CConnman::GetReceiveFloodSize() const { return nReceiveFloodSize; }
 
+/** Created with the first peer, once the random number generator is set up */
+static CKnownInventoryTable& GetKnownInventoryTable()
+{
+    static CKnownInventoryTable table(KNOWN_INVENTORY_SLOTS);
+    return table;
+}
+
 CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress &addrBindIn, const std::string& addrNameIn, bool fInboundIn) :
     nTimeConnected(GetSystemTimeInSeconds()),
     addr(addrIn),
@@ -2714,7 +3226,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fInbound(fInboundIn),
     nKeyedNetGroup(nKeyedNetGroupIn),
     addrKnown(5000, 0.001),
-    filterInventoryKnown(50000, 0.000001),
+    filterInventoryKnown(GetKnownInventoryTable()),
     id(idIn),
     nLocalHostNonce(nLocalHostNonceIn),
     nLocalServices(nLocalServicesIn),
@@ -2767,11 +3279,16 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fSocketEventsRegistered = false;
     nProcessQueueSize = 0;
+    nRecvPoolSize = 0;
 
-    for (const std::string &msg : getAllNetMessageTypes())
+    for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapCostPerMsgCmd[msg] = CMsgCost();
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapCostPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = CMsgCost();
 
     if (fLogIPs) {
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
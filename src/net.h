@@ -9,9 +9,11 @@
 #include "addrdb.h"
 #include "addrman.h"
 #include "amount.h"
+#include "bantrie.h"
 #include "bloom.h"
 #include "compat.h"
 #include "hash.h"
+#include "knowninventory.h"
 #include "limitedmap.h"
 #include "netaddress.h"
 #include "policy/feerate.h"
@@ -22,8 +24,10 @@
 #include "uint256.h"
 #include "threadinterrupt.h"
 
+#include <algorithm>
 #include <atomic>
 #include <deque>
+#include <set>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -71,6 +75,8 @@ static const bool DEFAULT_UPNP = false;
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of entries in setAskFor (larger due to getdata latency)*/
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
+/** The number of most recently seen inventory hashes peers' known-inventory sets can hold */
+static const uint32_t KNOWN_INVENTORY_SLOTS = 1 << 17;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 /** The default for -maxuploadtarget. 0 = Unlimited */
@@ -83,12 +89,41 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Maximum number of processed messages a peer keeps to receive new ones into */
+static const size_t MAX_RECV_POOL_MSGS = 16;
+/** Maximum receive buffer space a peer keeps for reuse; it counts against -maxreceivebuffer */
+static const size_t MAX_RECV_POOL_SIZE = 256 * 1024;
+/** -msghandthreads default: number of threads processing peer messages */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
+/** How the socket handler thread waits for sockets to become ready */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_POLL,
+    SOCKETEVENTS_EPOLL,
+};
+
+#if defined(USE_EPOLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#elif defined(USE_POLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_POLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
+
+/** Parse a -socketevents value, accepting only modes this platform supports */
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Comma separated list of the modes this platform supports, for help messages */
+std::string GetSupportedSocketEventsModes();
+
 typedef int64_t NodeId;
 
 struct AddedNodeInfo
@@ -116,6 +151,38 @@ struct CSerializedNetMsg
 };
 
 class NetEventsInterface;
+
+/** Message handler time spent on a kind of message */
+struct CMsgCost
+{
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    //! Of nTotalMicros, the time spent holding cs_main
+    int64_t nMainLockMicros;
+
+    CMsgCost() : nCount(0), nTotalMicros(0), nMaxMicros(0), nMainLockMicros(0) {}
+
+    /** Add the handling of a message, or more work on one already counted (fNew false) */
+    void Add(int64_t nMicros, int64_t nMainLockMicrosIn, bool fNew = true)
+    {
+        nCount += fNew;
+        nTotalMicros += nMicros;
+        nMaxMicros = std::max(nMaxMicros, nMicros);
+        nMainLockMicros += nMainLockMicrosIn;
+    }
+
+    CMsgCost& operator+=(const CMsgCost& other)
+    {
+        nCount += other.nCount;
+        nTotalMicros += other.nTotalMicros;
+        nMaxMicros = std::max(nMaxMicros, other.nMaxMicros);
+        nMainLockMicros += other.nMainLockMicros;
+        return *this;
+    }
+};
+typedef std::map<std::string, CMsgCost> mapMsgCmdCost;
+
 class CConnman
 {
 public:
@@ -145,6 +212,8 @@ public:
         std::vector<std::string> vSeedNodes;
         std::vector<CSubNet> vWhitelistedRange;
         std::vector<CService> vBinds, vWhiteBinds;
+        SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
+        int nMessageHandlerThreads = DEFAULT_MSGHAND_THREADS;
     };
 
     void Init(const Options& connOptions) {
@@ -162,6 +231,8 @@ public:
         nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
         nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
         vWhitelistedRange = connOptions.vWhitelistedRange;
+        socketEventsMode = connOptions.socketEventsMode;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHAND_THREADS));
     }
 
     CConnman(uint64_t seed0, uint64_t seed1);
@@ -250,6 +321,8 @@ public:
     bool Unban(const CSubNet &ip);
     void GetBanned(banmap_t &banmap);
     void SetBanned(const banmap_t &banmap);
+    //! Merge a ban list into ours, keeping the later ban time of subnets in both; returns how many bans were added or extended
+    size_t ImportBanned(const banmap_t &banmap);
 
     // This allows temporarily exceeding nMaxOutbound, with the goal of finding
     // a peer that is better than all our current peers.
@@ -270,6 +343,8 @@ public:
 
     size_t GetNodeCount(NumConnections num);
     void GetNodeStats(std::vector<CNodeStats>& vstats);
+    /** Message handler time per received command and for SendMessages, over all peers since startup */
+    void GetMsgCosts(mapMsgCmdCost& mapCost, CMsgCost& sendCost);
     bool DisconnectNode(const std::string& node);
     bool DisconnectNode(NodeId id);
 
@@ -323,9 +398,28 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nHandler);
+    void WakeMessageHandler(const CNode* pnode);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+
+    // Socket readiness, see ThreadSocketHandler
+    bool IsWatchableSocket(const SOCKET& hSocket) const;
+    void StartSocketEvents();
+    void StopSocketEvents();
+    void RegisterSocketEvents(CNode* pnode);
+    void UnregisterSocketEvents(CNode* pnode);
+    bool GetSocketInterest(CNode* pnode, SOCKET& hSocket, bool& fWantRecv, bool& fWantSend);
+    void WaitForSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set);
+    void SelectSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set);
+#ifdef USE_POLL
+    void PollSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set);
+#endif
+#ifdef USE_EPOLL
+    void EpollSocketEvents(std::set<CNode*>& recv_set, std::set<CNode*>& send_set, std::set<CNode*>& error_set, std::vector<const ListenSocket*>& listen_set);
+#endif
+    bool SocketRecvData(CNode* pnode);
+    void InactivityCheck(CNode* pnode, int64_t nTime);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -367,6 +461,11 @@ private:
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
 
+    // Message handler time of peers that have been deleted
+    CCriticalSection cs_msgCost;
+    mapMsgCmdCost mapCostPerMsgCmd;
+    CMsgCost sendMessagesCost;
+
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle;
     uint64_t nMaxOutboundCycleStartTime;
@@ -380,9 +479,23 @@ private:
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
 
+    SocketEventsMode socketEventsMode;
+#ifdef USE_EPOLL
+    /** epoll instance all sockets stay registered with, in SOCKETEVENTS_EPOLL mode */
+    int epollfd;
+    /**
+     * Nodes epoll reported readable whose data has not been fully read yet.
+     * Registrations are edge-triggered, so these are only reported again
+     * after a recv() hits EWOULDBLOCK. Owned by the socket handler thread.
+     */
+    std::set<CNode*> setRecvReadyNodes;
+#endif
+
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
+    //! Lookup index over setBanned
+    CBanTrie banTrie;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
@@ -415,11 +528,24 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /**
+     * A message handler thread, serving the peers whose id maps to it. All
+     * MAX_MSGHAND_THREADS are allocated up front so that waking one never
+     * races with Start; only the first nMessageHandlerThreads get a thread.
+     */
+    struct MessageHandler
+    {
+        std::string strName;
+        std::thread thread;
+
+        /** flag for waking the message processor. */
+        bool fMsgProcWake = false;
 
-    std::condition_variable condMsgProc;
-    std::mutex mutexMsgProc;
+        std::condition_variable condMsgProc;
+        std::mutex mutexMsgProc;
+    };
+    std::vector<std::unique_ptr<MessageHandler>> vMessageHandlers;
+    std::atomic<int> nMessageHandlerThreads;
     std::atomic<bool> flagInterruptMsgProc;
 
     CThreadInterrupt interruptNet;
@@ -428,7 +554,6 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -535,6 +660,8 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdCost mapCostPerMsgCmd;
+    CMsgCost sendMessagesCost;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -583,6 +710,11 @@ public:
 
     const uint256& GetMessageHash() const;
 
+    /** Prepare for receiving another message, keeping the allocated buffers */
+    void Reset();
+    /** Receive buffer space held by this message */
+    size_t GetMemoryUsage() const { return vRecv.capacity(); }
+
     void SetVersion(int nVersionIn)
     {
         hdrbuf.SetVersion(nVersionIn);
@@ -614,6 +746,9 @@ public:
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
+    //! Processed messages whose buffers are reused for receiving, and their total size
+    std::list<CNetMessage> vRecvPool;
+    size_t nRecvPoolSize;
 
     CCriticalSection cs_sendProcessing;
 
@@ -658,16 +793,27 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Whether the socket is registered with the socket handler's epoll
+    // instance, holding a reference to this node. Guarded by cs_vNodes.
+    bool fSocketEventsRegistered;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
 
+    // Message handler time, per received command and for SendMessages
+    CCriticalSection cs_msgCost;
+    mapMsgCmdCost mapCostPerMsgCmd;
+    CMsgCost sendMessagesCost;
+
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // cs_addrSend guards vAddrToSend and addrKnown, which other peers'
+    // message handler threads fill when relaying addresses.
+    CCriticalSection cs_addrSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -676,7 +822,7 @@ public:
     int64_t nNextLocalAddrSend;
 
     // inventory based relay
-    CRollingBloomFilter filterInventoryKnown;
+    CKnownInventory filterInventoryKnown;
     // Set of transaction ids we still have to announce.
     // They are sorted by the mempool before relay, so the order is not important.
     std::set<uint256> setInventoryTxToSend;
@@ -761,6 +907,13 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /** Take back messages the message handler is done with, to receive into their buffers */
+    void RecycleMessages(std::list<CNetMessage>& msgs);
+
+    /** Account message handler time to a received command, or to SendMessages if strCommand is empty */
+    void AddMsgCost(const std::string& strCommand, int64_t nMicros, int64_t nMainLockMicros, bool fNew = true);
+    /** Add this peer's message handler time to totals */
+    void GetMsgCosts(mapMsgCmdCost& mapCost, CMsgCost& sendCost);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -792,11 +945,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_addrSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -814,7 +969,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            filterInventoryKnown.insert(inv.hash);
+            filterInventoryKnown.insertFromPeer(inv.hash);
         }
     }
 
@@ -7,7 +7,9 @@
 
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
 #include "blockencodings.h"
+#include "blockpropagation.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
@@ -26,6 +28,7 @@
 #include "scheduler.h"
 #include "tinyformat.h"
 #include "txmempool.h"
+#include "txreconciliation.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -128,6 +131,14 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Bloom filter data elements of transactions recently matched against peers' filters, protected by cs_main. */
+    CBloomElementsCache bloomElementsCache(MAX_BLOOM_ELEMENTS_CACHE_TXS, MAX_BLOOM_ELEMENTS_CACHE_BYTES);
+    /** Merkle tree hashes of the block last filtered for a peer, protected by cs_main. */
+    std::pair<uint256, std::vector<std::vector<uint256>>> filteredBlockTree;
+
+    /** How recent blocks reached us and were relayed to high-bandwidth peers. */
+    CBlockPropagationLog blockPropagationLog;
 } // namespace
 
 namespace {
@@ -176,6 +187,8 @@ struct CNodeState {
     std::list<QueuedBlock> vBlocksInFlight;
     //! When the first entry in vBlocksInFlight started downloading. Don't care when vBlocksInFlight is empty.
     int64_t nDownloadingSince;
+    //! Moving average of how long (in microseconds) this peer takes to deliver a block we asked for, or 0 if unknown.
+    int64_t nBlockDeliveryTime;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
@@ -199,6 +212,10 @@ struct CNodeState {
      * otherwise: whether this peer sends non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Transaction reconciliation with this peer, if both sides support it
+    std::unique_ptr<CTxReconState> reconState;
+    //! When to start the next reconciliation round, if we are the initiator
+    int64_t nNextReconRequest;
 
     /** State used to enforce CHAIN_SYNC_TIMEOUT
       * Only in effect for outbound, non-manual connections, with
@@ -243,6 +260,7 @@ struct CNodeState {
         nHeadersSyncTimeout = 0;
         nStallingSince = 0;
         nDownloadingSince = 0;
+        nBlockDeliveryTime = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
@@ -252,6 +270,7 @@ struct CNodeState {
         fHaveWitness = false;
         fWantsCmpctWitness = false;
         fSupportsDesiredCmpctVersion = false;
+        nNextReconRequest = 0;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
     }
@@ -360,6 +379,36 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     return true;
 }
 
+// Requires cs_main.
+// Update a peer's measured block delivery time when it sends us a block we requested from it.
+void UpdateBlockDeliveryTime(NodeId nodeid, const uint256& hash) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    // Only measure blocks delivered in the order requested: nDownloadingSince
+    // is when the peer could start sending the first block on its queue.
+    if (state->vBlocksInFlight.begin() != itInFlight->second.second)
+        return;
+    int64_t nDeliveryTime = GetTimeMicros() - state->nDownloadingSince;
+    if (nDeliveryTime <= 0)
+        return;
+    if (state->nBlockDeliveryTime == 0)
+        state->nBlockDeliveryTime = nDeliveryTime;
+    else
+        state->nBlockDeliveryTime = (state->nBlockDeliveryTime * 7 + nDeliveryTime) / 8;
+}
+
+// Requires cs_main.
+// Number of blocks to keep in flight from a peer: enough to keep it busy
+// for BLOCK_DOWNLOAD_QUEUE_TIME at its measured speed.
+int GetBlocksInTransitLimit(const CNodeState* state) {
+    if (state->nBlockDeliveryTime == 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nLimit = BLOCK_DOWNLOAD_QUEUE_TIME / state->nBlockDeliveryTime;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER, nLimit));
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -455,7 +504,7 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalled, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
 
@@ -491,6 +540,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -526,6 +576,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -536,6 +587,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -618,6 +670,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksInTransitLimit = GetBlocksInTransitLimit(state);
+    stats.nBlockDeliveryTime = state->nBlockDeliveryTime;
     return true;
 }
 
@@ -785,7 +839,86 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
     scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000);
 }
 
+// Recent blocks in the serialized forms they are served in
+static CBlockCache blockCache;
+// Active chain headers in the form they are sent in reply to getheaders
+static CHeadersCache headersCache;
+
+void SetBlockCacheLimits(size_t nBlocks, size_t nBytes)
+{
+    blockCache.SetMaxBlocks(nBlocks);
+    blockCache.SetMaxBytes(nBytes);
+}
+
+CBlockCache::Stats GetBlockCacheStats()
+{
+    return blockCache.GetStats();
+}
+
+std::vector<CBlockPropagation> GetBlockPropagation()
+{
+    return blockPropagationLog.GetBlocks();
+}
+
+/** Return a block to serve to a peer, preferring in-memory copies over disk. */
+static std::shared_ptr<const CBlock> GetBlockForServing(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& a_recent_block, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        blockCache.Add(a_recent_block);
+        return a_recent_block;
+    }
+    std::shared_ptr<const CBlock> pblock = blockCache.GetBlock(pindex->GetBlockHash());
+    if (!pblock) {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+            assert(!"cannot load block from disk");
+        blockCache.Add(pblockRead);
+        pblock = pblockRead;
+    }
+    return pblock;
+}
+
+/** Return a block serialized as it is sent in the given format, caching the result. */
+static CBlockCache::DataRef GetSerializedBlock(const CBlockIndex* pindex, CBlockCache::Format format, const std::shared_ptr<const CBlock>& a_recent_block, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    const uint256 hash = pindex->GetBlockHash();
+    CBlockCache::DataRef data = blockCache.Get(hash, format);
+    if (data)
+        return data;
+
+    bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, consensusParams);
+    bool fInMemory = a_recent_block && a_recent_block->GetHash() == hash;
+    if (!fInMemory && (format == CBlockCache::BLOCK_WITNESS || (format == CBlockCache::BLOCK_NO_WITNESS && !fWitnessEnabled))) {
+        // The stored serialization is exactly what the peer asked for, so
+        // keep the bytes from disk as they are instead of deserializing and
+        // reserializing them.
+        std::shared_ptr<std::vector<unsigned char>> raw = std::make_shared<std::vector<unsigned char>>();
+        if (!ReadRawBlockFromDisk(*raw, pindex, Params().MessageStart()))
+            assert(!"cannot load block from disk");
+        blockCache.Add(hash, CBlockCache::BLOCK_WITNESS, raw);
+        if (!fWitnessEnabled)
+            blockCache.Add(hash, CBlockCache::BLOCK_NO_WITNESS, raw);
+        return raw;
+    }
+
+    data = CBlockCache::Serialize(*GetBlockForServing(pindex, a_recent_block, consensusParams), format);
+    blockCache.Add(hash, format, data);
+    return data;
+}
+
+static void PushSerializedMessage(CConnman* connman, CNode* pnode, const std::string& command, const CBlockCache::DataRef& data)
+{
+    CSerializedNetMsg msg;
+    msg.command = command;
+    msg.data = *data;
+    connman->PushMessage(pnode, std::move(msg));
+}
+
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
+    blockCache.Add(pblock);
+
     LOCK(cs_main);
 
     std::vector<uint256> vOrphanErase;
@@ -846,6 +979,9 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
+    // Blocks no peer announced are our own, e.g. from submitblock
+    blockPropagationLog.Announced(hashBlock, pindex->nHeight, -1, "local", GetTimeMicros());
+
     connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
         // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
@@ -860,6 +996,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
             connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            blockPropagationLog.Relayed(hashBlock, pnode->GetId(), GetTimeMicros());
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -967,11 +1104,24 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+// Requires cs_main.
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    connman->ForEachNode([&inv](CNode* pnode)
+    int nFlooded = 0;
+    connman->ForEachNode([&inv, &nFlooded](CNode* pnode)
     {
+        // Reconciling peers get the transaction in the next round; it is
+        // still flooded to a few outbound ones to keep relay latency low.
+        CNodeState* state = State(pnode->GetId());
+        if (state && state->reconState) {
+            bool fFlood = state->reconState->IsInitiator() && nFlooded < MAX_RECON_FLOOD_PEERS;
+            if (state->reconState->AddTx(inv.hash, fFlood)) {
+                if (!fFlood)
+                    return;
+                nFlooded++;
+            }
+        }
         pnode->PushInventory(inv);
     });
 }
@@ -1086,29 +1236,27 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    std::shared_ptr<const CBlock> pblock;
-                    if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
-                        pblock = a_recent_block;
-                    } else {
-                        // Send block from disk
-                        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-                        if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
-                            assert(!"cannot load block from disk");
-                        pblock = pblockRead;
-                    }
                     if (inv.type == MSG_BLOCK)
-                        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
+                        PushSerializedMessage(connman, pfrom, NetMsgType::BLOCK, GetSerializedBlock(mi->second, CBlockCache::BLOCK_NO_WITNESS, a_recent_block, consensusParams));
                     else if (inv.type == MSG_WITNESS_BLOCK)
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                        PushSerializedMessage(connman, pfrom, NetMsgType::BLOCK, GetSerializedBlock(mi->second, CBlockCache::BLOCK_WITNESS, a_recent_block, consensusParams));
                     else if (inv.type == MSG_FILTERED_BLOCK)
                     {
+                        std::shared_ptr<const CBlock> pblock = GetBlockForServing(mi->second, a_recent_block, consensusParams);
                         bool sendMerkleBlock = false;
                         CMerkleBlock merkleBlock;
                         {
                             LOCK(pfrom->cs_filter);
                             if (pfrom->pfilter) {
                                 sendMerkleBlock = true;
-                                merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
+                                // Peers following the tip all ask for the same block
+                                if (filteredBlockTree.first != pblock->GetHash()) {
+                                    std::vector<uint256> vTxid;
+                                    for (const CTransactionRef& tx : pblock->vtx)
+                                        vTxid.push_back(tx->GetHash());
+                                    filteredBlockTree = std::make_pair(pblock->GetHash(), CPartialMerkleTree::CalcTreeLevels(vTxid));
+                                }
+                                merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter, &bloomElementsCache, &filteredBlockTree.second);
                             }
                         }
                         if (sendMerkleBlock) {
@@ -1138,11 +1286,12 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                             if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
                                 connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                             } else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                                CBlockCache::Format format = fPeerWantsWitness ? CBlockCache::CMPCT_WITNESS : CBlockCache::CMPCT_NO_WITNESS;
+                                PushSerializedMessage(connman, pfrom, NetMsgType::CMPCTBLOCK, GetSerializedBlock(mi->second, format, a_recent_block, consensusParams));
                             }
                         } else {
-                            connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                            CBlockCache::Format format = fPeerWantsWitness ? CBlockCache::BLOCK_WITNESS : CBlockCache::BLOCK_NO_WITNESS;
+                            PushSerializedMessage(connman, pfrom, NetMsgType::BLOCK, GetSerializedBlock(mi->second, format, a_recent_block, consensusParams));
                         }
                     }
 
@@ -1229,7 +1378,7 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
-bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, bool punish_duplicate_invalid)
+bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, bool punish_duplicate_invalid, int64_t nTimeReceived)
 {
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     size_t nCount = headers.size();
@@ -1352,6 +1501,8 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
 
         if (received_new_header && pindexLast->nChainWork > chainActive.Tip()->nChainWork) {
             nodestate->m_last_block_announcement = GetTime();
+            if (nCount <= MAX_BLOCKS_TO_ANNOUNCE && !IsInitialBlockDownload())
+                blockPropagationLog.Announced(pindexLast->GetBlockHash(), pindexLast->nHeight, pfrom->GetId(), NetMsgType::HEADERS, nTimeReceived);
         }
 
         if (nCount == MAX_HEADERS_RESULTS) {
@@ -1390,7 +1541,7 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= GetBlocksInTransitLimit(nodestate)) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -1613,6 +1764,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             State(pfrom->GetId())->fHaveWitness = true;
         }
 
+        if ((nServices & NODE_TXRECONCILIATION) && (pfrom->GetLocalServices() & NODE_TXRECONCILIATION) && fRelay && !pfrom->fFeeler && !pfrom->fOneShot)
+        {
+            // The side that made the connection starts the rounds
+            LOCK(cs_main);
+            State(pfrom->GetId())->reconState.reset(new CTxReconState(!pfrom->fInbound));
+        }
+
         // Potentially mark this peer as a preferred download peer.
         {
         LOCK(cs_main);
@@ -2003,6 +2161,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
+        std::vector<CHeadersCache::Range> vRanges;
+        {
         LOCK(cs_main);
         if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
             LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->GetId());
@@ -2027,15 +2187,22 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 pindex = chainActive.Next(pindex);
         }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
         LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
-        for (; pindex; pindex = chainActive.Next(pindex))
-        {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
+        if (pindex && chainActive.Contains(pindex)) {
+            // Reply with a run of the active chain, copied from the headers
+            // cache after releasing cs_main.
+            int nLast = std::min(pindex->nHeight + (int)MAX_HEADERS_RESULTS - 1, chainActive.Height());
+            BlockMap::iterator mi = hashStop.IsNull() ? mapBlockIndex.end() : mapBlockIndex.find(hashStop);
+            if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second) && mi->second->nHeight >= pindex->nHeight && mi->second->nHeight < nLast)
+                nLast = mi->second->nHeight;
+            vRanges = headersCache.GetHeaders(chainActive, pindex->nHeight, nLast);
+            pindex = nLast < chainActive.Height() ? chainActive[nLast] : nullptr;
+        } else if (pindex) {
+            // A hashStop block outside the active chain is sent on its own.
+            // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+            std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>();
+            CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *data, 0, CBlock(pindex->GetBlockHeader()));
+            vRanges.push_back({data, 0, data->size()});
         }
         // pindex can be nullptr either if we sent chainActive.Tip() OR
         // if our peer has chainActive.Tip() (and thus we are sending an empty
@@ -2050,7 +2217,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        }
+
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::HEADERS;
+        msg.data = CHeadersCache::MakeHeadersMessage(vRanges);
+        connman->PushMessage(pfrom, std::move(msg));
     }
 
 
@@ -2324,6 +2496,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
+        if (!IsInitialBlockDownload())
+            blockPropagationLog.Announced(pindex->GetBlockHash(), pindex->nHeight, pfrom->GetId(), NetMsgType::CMPCTBLOCK, nTimeReceived);
+
         // If we're not close to tip yet, give up and let parallel block fetch work its magic
         if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
             return true;
@@ -2370,6 +2545,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
+                blockPropagationLog.CompactReceived(pindex->GetBlockHash(), pfrom->GetId(), cmpctblock.BlockTxCount(),
+                    partialBlock.GetPrefilledCount(), partialBlock.GetMempoolCount(), partialBlock.GetExtraCount(), req.indexes.size(), nTimeReceived);
                 if (req.indexes.empty()) {
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
@@ -2392,6 +2569,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     // TODO: don't ignore failures
                     return true;
                 }
+                size_t nMissing = 0;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++)
+                    nMissing += !tempBlock.IsTxAvailable(i);
+                blockPropagationLog.CompactReceived(pindex->GetBlockHash(), pfrom->GetId(), cmpctblock.BlockTxCount(),
+                    tempBlock.GetPrefilledCount(), tempBlock.GetMempoolCount(), tempBlock.GetExtraCount(), nMissing, nTimeReceived);
                 std::vector<CTransactionRef> dummy;
                 status = tempBlock.FillBlock(*pblock, dummy);
                 if (status == READ_STATUS_OK) {
@@ -2422,7 +2604,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // the peer if the header turns out to be for an invalid block.
             // Note that if a peer tries to build on an invalid chain, that
             // will be detected and the peer will be banned.
-            return ProcessHeadersMessage(pfrom, connman, {cmpctblock.header}, chainparams, /*punish_duplicate_invalid=*/false);
+            return ProcessHeadersMessage(pfrom, connman, {cmpctblock.header}, chainparams, /*punish_duplicate_invalid=*/false, nTimeReceived);
         }
 
         if (fBlockReconstructed) {
@@ -2432,6 +2614,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 LOCK(cs_main);
                 mapBlockSource.emplace(pblock->GetHash(), std::make_pair(pfrom->GetId(), false));
             }
+            blockPropagationLog.Received(pblock->GetHash(), pfrom->GetId(), NetMsgType::CMPCTBLOCK, nTimeReceived);
             bool fNewBlock = false;
             // Setting fForceProcessing to true means that we bypass some of
             // our anti-DoS protections in AcceptBlock, which filters
@@ -2443,6 +2626,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // compact blocks with less work than our tip, it is safe to treat
             // reconstructed compact blocks as having been requested.
             ProcessNewBlock(chainparams, pblock, /*fForceProcessing=*/true, &fNewBlock);
+            blockPropagationLog.Processed(pblock->GetHash(), GetTimeMicros());
             if (fNewBlock) {
                 pfrom->nLastBlockTime = GetTime();
             } else {
@@ -2519,6 +2703,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             }
         } // Don't hold cs_main when we call into ProcessNewBlock
         if (fBlockRead) {
+            // An empty blocktxn is the compact block handler's, for blocks it could fill in by itself
+            blockPropagationLog.Received(resp.blockhash, pfrom->GetId(), resp.txn.empty() ? NetMsgType::CMPCTBLOCK : NetMsgType::BLOCKTXN, nTimeReceived);
             bool fNewBlock = false;
             // Since we requested this block (it was in mapBlocksInFlight), force it to be processed,
             // even if it would not be a candidate for new tip (missing previous block, chain not long enough, etc)
@@ -2527,6 +2713,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // protections in the compact block handler -- see related comment
             // in compact block optimistic reconstruction handling.
             ProcessNewBlock(chainparams, pblock, /*fForceProcessing=*/true, &fNewBlock);
+            blockPropagationLog.Processed(resp.blockhash, GetTimeMicros());
             if (fNewBlock) {
                 pfrom->nLastBlockTime = GetTime();
             } else {
@@ -2559,7 +2746,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // disconnect the peer if it is using one of our outbound connection
         // slots.
         bool should_punish = !pfrom->fInbound && !pfrom->m_manual_connection;
-        return ProcessHeadersMessage(pfrom, connman, headers, chainparams, should_punish);
+        return ProcessHeadersMessage(pfrom, connman, headers, chainparams, should_punish, nTimeReceived);
     }
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
@@ -2570,9 +2757,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
 
         bool forceProcessing = false;
+        bool fNewToUs = false;
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            fNewToUs = mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA);
+            UpdateBlockDeliveryTime(pfrom->GetId(), hash);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -2582,11 +2773,22 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         bool fNewBlock = false;
         ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
-        if (fNewBlock) {
+        const int64_t nProcessedTime = GetTimeMicros();
+        if (fNewBlock)
             pfrom->nLastBlockTime = GetTime();
-        } else {
+        {
             LOCK(cs_main);
-            mapBlockSource.erase(pblock->GetHash());
+            // Only once its header is accepted, so made-up blocks can not push
+            // real ones out of the log
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end()) {
+                if (fNewToUs && !IsInitialBlockDownload())
+                    blockPropagationLog.Announced(hash, mi->second->nHeight, pfrom->GetId(), NetMsgType::BLOCK, nTimeReceived);
+                blockPropagationLog.Received(hash, pfrom->GetId(), NetMsgType::BLOCK, nTimeReceived);
+                blockPropagationLog.Processed(hash, nProcessedTime);
+            }
+            if (!fNewBlock)
+                mapBlockSource.erase(hash);
         }
     }
 
@@ -2611,7 +2813,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr)
@@ -2793,6 +2998,71 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // message would be undesirable as we transmit it ourselves.
     }
 
+    else if (strCommand == NetMsgType::REQRECON) {
+        uint64_t nSalt;
+        uint32_t nRemoteSize;
+        uint16_t nRemoteQ;
+        vRecv >> nSalt >> nRemoteSize >> nRemoteQ;
+
+        LOCK(cs_main);
+        CTxReconState* reconState = State(pfrom->GetId())->reconState.get();
+        // Rounds the peer was too slow for are not taken up again
+        if (reconState && reconState->IsFlooding())
+            return true;
+        // Only the side that made the connection starts rounds, one at a time
+        if (!reconState || reconState->IsInitiator() || reconState->IsRoundOpen()) {
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        std::vector<uint256> vAnnounce;
+        CTxSketch sketch = reconState->HandleRequest(nSalt, nRemoteSize, nRemoteQ, GetTimeMicros(), vAnnounce);
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+        for (const uint256& txid : vAnnounce)
+            pfrom->PushInventory(CInv(MSG_TX, txid));
+    }
+
+    else if (strCommand == NetMsgType::SKETCH) {
+        CTxSketch sketch;
+        vRecv >> sketch;
+
+        LOCK(cs_main);
+        CTxReconState* reconState = State(pfrom->GetId())->reconState.get();
+        if (reconState && reconState->IsFlooding())
+            return true;
+        // Rounds are only abandoned together with reconciliation, so a sketch
+        // outside one was not asked for
+        if (!reconState || !reconState->IsInitiator() || !reconState->IsRoundOpen()) {
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        std::vector<uint32_t> vWanted;
+        std::vector<uint256> vAnnounce;
+        bool fSuccess = reconState->HandleSketch(sketch, vWanted, vAnnounce);
+        LogPrint(BCLog::NET, "reconciliation with peer=%d: %s, %u wanted, %u to announce\n", pfrom->GetId(), fSuccess ? "decoded" : "failed", vWanted.size(), vAnnounce.size());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, fSuccess, vWanted));
+        for (const uint256& txid : vAnnounce)
+            pfrom->PushInventory(CInv(MSG_TX, txid));
+    }
+
+    else if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fSuccess;
+        std::vector<uint32_t> vWanted;
+        vRecv >> fSuccess >> vWanted;
+
+        LOCK(cs_main);
+        CTxReconState* reconState = State(pfrom->GetId())->reconState.get();
+        if (reconState && reconState->IsFlooding())
+            return true;
+        if (!reconState || reconState->IsInitiator() || !reconState->IsRoundOpen()) {
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        std::vector<uint256> vAnnounce;
+        reconState->HandleDiff(fSuccess, vWanted, vAnnounce);
+        for (const uint256& txid : vAnnounce)
+            pfrom->PushInventory(CInv(MSG_TX, txid));
+    }
+
     else {
         // Ignore unknown commands for extensibility
         LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->GetId());
@@ -2846,8 +3116,13 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     //
     bool fMoreWork = false;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        // Serving what is left of earlier getdata messages
+        const int64_t nStart = GetTimeMicros();
+        const int64_t nMainLockStart = GetTimedLockHeldMicros();
         ProcessGetData(pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
+        pfrom->AddMsgCost(NetMsgType::GETDATA, GetTimeMicros() - nStart, GetTimedLockHeldMicros() - nMainLockStart, false);
+    }
 
     if (pfrom->fDisconnect)
         return false;
@@ -2867,7 +3142,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
-        pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
+        pfrom->fPauseRecv = pfrom->nProcessQueueSize + pfrom->nRecvPoolSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
     CNetMessage& msg(msgs.front());
@@ -2906,6 +3181,8 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    const int64_t nStart = GetTimeMicros();
+    const int64_t nMainLockStart = GetTimedLockHeldMicros();
     try
     {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
@@ -2942,6 +3219,10 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     } catch (...) {
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
+    pfrom->AddMsgCost(strCommand, GetTimeMicros() - nStart, GetTimedLockHeldMicros() - nMainLockStart);
+
+    // Let the next received message reuse this one's buffers
+    pfrom->RecycleMessages(msgs);
 
     if (!fRet) {
         LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->GetId());
@@ -3159,6 +3440,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3293,25 +3575,23 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
 
                     bool fGotBlockFromCache = false;
+                    std::shared_ptr<const CBlock> a_recent_block;
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
+                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock) {
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
-                            else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                                fGotBlockFromCache = true;
+                            } else {
+                                a_recent_block = most_recent_block;
                             }
-                            fGotBlockFromCache = true;
                         }
                     }
                     if (!fGotBlockFromCache) {
-                        CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
-                        assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                        connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                        CBlockCache::Format format = state.fWantsCmpctWitness ? CBlockCache::CMPCT_WITNESS : CBlockCache::CMPCT_NO_WITNESS;
+                        PushSerializedMessage(connman, pto, NetMsgType::CMPCTBLOCK, GetSerializedBlock(pBestIndex, format, a_recent_block, consensusParams));
                     }
+                    blockPropagationLog.Relayed(pBestIndex->GetBlockHash(), pto->GetId(), GetTimeMicros());
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
                     if (vHeaders.size() > 1) {
@@ -3357,6 +3637,26 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             pto->vBlockHashesToAnnounce.clear();
         }
 
+        //
+        // Message: reqrecon
+        //
+        // Only once the peer answered the last round, so its sketch can not
+        // be taken for one made with a newer salt. A peer that leaves a round
+        // open for too long, on either side, gets plain INVs from then on.
+        if (state.reconState) {
+            std::vector<uint256> vAnnounce;
+            if (state.reconState->ExpireRound(nNow, vAnnounce)) {
+                LogPrint(BCLog::NET, "reconciliation round with peer=%d timed out, flooding %u transactions\n", pto->GetId(), vAnnounce.size());
+                for (const uint256& txid : vAnnounce)
+                    pto->PushInventory(CInv(MSG_TX, txid));
+            }
+        }
+        if (state.reconState && state.reconState->IsInitiator() && !state.reconState->IsRoundOpen() && !state.reconState->IsFlooding() && state.nNextReconRequest < nNow) {
+            uint64_t nSalt = state.reconState->StartRound(nNow);
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, nSalt, (uint32_t)state.reconState->GetQueueSize(), state.reconState->GetQ()));
+            state.nNextReconRequest = PoissonNextSend(nNow, RECON_INTERVAL);
+        }
+
         //
         // Message: inventory
         //
@@ -3410,7 +3710,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                             continue;
                     }
                     if (pto->pfilter) {
-                        if (!pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                        if (!pto->pfilter->IsRelevantAndUpdate(*txinfo.tx, bloomElementsCache)) continue;
                     }
                     pto->filterInventoryKnown.insert(hash);
                     vInv.push_back(inv);
@@ -3463,7 +3763,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
                         continue;
                     }
-                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx, bloomElementsCache)) continue;
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
@@ -3556,10 +3856,12 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlocksInTransitLimit = GetBlocksInTransitLimit(&state);
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInTransitLimit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalled = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalled, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -3567,6 +3869,22 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->GetId());
             }
+            if (state.nBlocksInFlight == 0 && staller != -1 && pindexStalled != nullptr) {
+                // We are idle because the download window is held up by a
+                // block in flight from another peer. If we have proven faster
+                // than that peer and it has had a fair chance to deliver, ask
+                // for the block ourselves to keep the window moving.
+                CNodeState *stateStaller = State(staller);
+                bool fFaster = state.nBlockDeliveryTime != 0 && (stateStaller->nBlockDeliveryTime == 0 || state.nBlockDeliveryTime < stateStaller->nBlockDeliveryTime);
+                int64_t nOutstanding = nNow - stateStaller->nDownloadingSince;
+                if (fFaster && nOutstanding > std::max(BLOCK_REREQUEST_MIN_TIME, 2 * stateStaller->nBlockDeliveryTime)) {
+                    uint32_t nFetchFlags = GetFetchFlags(pto);
+                    vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindexStalled->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), pindexStalled);
+                    LogPrint(BCLog::NET, "Re-requesting stalled block %s (%d) from peer=%d instead of peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, pto->GetId(), staller);
+                }
+            }
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
@@ -6,6 +6,8 @@
 #ifndef BITCOIN_NET_PROCESSING_H
 #define BITCOIN_NET_PROCESSING_H
 
+#include "blockcache.h"
+#include "blockpropagation.h"
 #include "net.h"
 #include "validationinterface.h"
 #include "consensus/params.h"
@@ -34,6 +36,10 @@ static constexpr int64_t STALE_CHECK_INTERVAL = 2.5 * 60; // 2.5 minutes
 static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 /** Minimum time an outbound-peer-eviction candidate must be connected for, in order to evict, in seconds */
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
+/** Number of transactions whose bloom filter data elements are kept for matching against further peers' filters */
+static const size_t MAX_BLOOM_ELEMENTS_CACHE_TXS = 5000;
+/** Most memory the cached bloom filter data elements may use, in bytes */
+static const size_t MAX_BLOOM_ELEMENTS_CACHE_BYTES = 8 << 20;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -74,11 +80,19 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInTransitLimit;
+    int64_t nBlockDeliveryTime;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
+/** Set how many recent blocks are kept serialized for serving to peers, and how much memory they may hold */
+void SetBlockCacheLimits(size_t nBlocks, size_t nBytes);
+/** Get hit/miss statistics of the served block cache */
+CBlockCache::Stats GetBlockCacheStats();
+/** Get how the most recent blocks reached us and were relayed, oldest first */
+std::vector<CBlockPropagation> GetBlockPropagation();
 
 #endif // BITCOIN_NET_PROCESSING_H
@@ -723,6 +723,21 @@ bool CSubNet::IsValid() const
     return valid;
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n) {}
+    if (n == 16)
+        return 128;
+    int bits = NetmaskBits(netmask[n]);
+    if (bits < 0)
+        return -1;
+    for (int x = n + 1; x < 16; ++x)
+        if (netmask[x] != 0x00)
+            return -1;
+    return n * 8 + bits;
+}
+
 bool operator==(const CSubNet& a, const CSubNet& b)
 {
     return a.valid == b.valid && a.network == b.network && !memcmp(a.netmask, b.netmask, 16);
@@ -122,6 +122,13 @@ class CSubNet
         std::string ToString() const;
         bool IsValid() const;
 
+        const CNetAddr& GetNetwork() const { return network; }
+        /**
+         * Length of the netmask as a prefix of all 128 address bits (so an
+         * IPv4 /24 gives 120), or -1 if the netmask is not a prefix.
+         */
+        int GetPrefixLength() const;
+
         friend bool operator==(const CSubNet& a, const CSubNet& b);
         friend bool operator!=(const CSubNet& a, const CSubNet& b);
         friend bool operator<(const CSubNet& a, const CSubNet& b);
@@ -240,6 +240,24 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a salt, the sender's reconciliation queue size and q.
+ * Peer should respond with a "sketch" message.
+ * Only sent to peers advertising NODE_TXRECONCILIATION, by the side that
+ * made the connection.
+ */
+extern const char *REQRECON;
+/**
+ * Contains a CTxSketch of the sender's reconciliation queue.
+ * Sent in response to a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains whether the sketch could be decoded and the short IDs wanted.
+ * Sent in response to a "sketch" message; the sender announces the
+ * transactions only it had, and the peer those that were asked for.
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -267,6 +285,10 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_TXRECONCILIATION means the node announces transactions by set
+    // reconciliation (reqrecon/sketch/reconcildiff) to peers that also set it.
+    // Experimental, see the comment below.
+    NODE_TXRECONCILIATION = (1 << 24),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -28,7 +28,7 @@ static UniValue rpcNestedTest_rpc(const JSONRPCRequest& request)
 
 static const CRPCCommand vRPCCommands[] =
 {
-    { "test", "rpcNestedTest", &rpcNestedTest_rpc, true, {} },
+    { "test", "rpcNestedTest", &rpcNestedTest_rpc, true, false, {} },
 };
 
 void RPCNestedTests::rpcNestedTests()
@@ -11,10 +11,12 @@
 #include "validation.h"
 #include "httpserver.h"
 #include "rpc/blockchain.h"
+#include "rpc/resultcache.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "util.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
@@ -23,6 +25,7 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t REST_RANGE_CHUNK_SIZE = 1024 * 1024; //send block and header ranges in chunks of about this size
 
 enum RetFormat {
     RF_UNDEF,
@@ -195,6 +198,22 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/** Whether the request's If-None-Match header lists strETag */
+static bool MatchesETag(HTTPRequest* req, const std::string& strETag)
+{
+    std::pair<bool, std::string> header = req->GetHeader("If-None-Match");
+    if (!header.first)
+        return false;
+    std::vector<std::string> vTags;
+    boost::split(vTags, header.second, boost::is_any_of(","));
+    for (std::string& tag : vTags) {
+        boost::trim(tag);
+        if (tag == "*" || tag == strETag || tag == "W/" + strETag)
+            return true;
+    }
+    return false;
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -208,8 +227,28 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    std::string strContentType;
+    switch (rf) {
+    case RF_BINARY:
+        strContentType = "application/octet-stream";
+        break;
+    case RF_HEX:
+        strContentType = "text/plain";
+        break;
+    case RF_JSON:
+        strContentType = "application/json";
+        break;
+    default:
+        break;
+    }
+
+    std::string strETag;
+    std::string strBody;
+    std::string key;
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
+    uint256 hashNext;
+    bool fCached;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -219,43 +258,55 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-    }
-
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
-
-    switch (rf) {
-    case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
-        req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryBlock);
-        return true;
-    }
+        if (strContentType.empty())
+            return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+        // The serialized block never changes; the JSON also depends on the chain around it
+        const std::string strFormat = strprintf("%s%s-%d", rf_names[rf].name, showTxDetails ? "" : "-notxdetails", RPCSerializationFlags());
+        strETag = "\"" + hash.GetHex() + "-" + strFormat;
+        if (rf == RF_JSON)
+            strETag += "-" + chainActive.Tip()->GetBlockHash().GetHex();
+        strETag += "\"";
+        if (MatchesETag(req, strETag)) {
+            req->WriteHeader("ETag", strETag);
+            req->WriteReply(HTTP_NOT_MODIFIED);
+            return true;
+        }
 
-    case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
-        req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
-        return true;
+        key = "rest/block/" + hash.GetHex() + "/" + strFormat;
+        fCached = GetCachedResult(key, strBody);
+        if (!fCached) {
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            const CBlockIndex* pnext = chainActive.Next(pblockindex);
+            if (pnext)
+                hashNext = pnext->GetBlockHash();
+        }
     }
 
-    case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
-    }
+    if (!fCached) {
+        if (rf == RF_JSON) {
+            strBody = blockToJSON(block, pblockindex, showTxDetails).write() + "\n";
+        } else {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            if (rf == RF_BINARY)
+                strBody = ssBlock.str();
+            else
+                strBody = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        }
 
-    default: {
-        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
-    }
+        // Only keep the result if the block's successor did not change while it was rendered
+        LOCK(cs_main);
+        const CBlockIndex* pnext = chainActive.Next(pblockindex);
+        if ((pnext ? pnext->GetBlockHash() : uint256()) == hashNext)
+            AddCachedResult(key, pblockindex, strBody, rf == RF_JSON);
     }
 
-    // not reached
-    return true; // continue to process further HTTP reqs on this cxn
+    req->WriteHeader("Content-Type", strContentType);
+    req->WriteHeader("ETag", strETag);
+    req->WriteReply(HTTP_OK, strBody);
+    return true;
 }
 
 static bool rest_block_extended(HTTPRequest* req, const std::string& strURIPart)
@@ -268,6 +319,128 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/**
+ * Parse "<height>/<count>.bin" and collect the active chain's blocks from that
+ * height on, up to count of them or the tip. Replies with an error and returns
+ * false if the range is invalid.
+ */
+static bool ParseBlockRange(HTTPRequest* req, const std::string& strURIPart, const std::string& strName, std::vector<const CBlockIndex*>& vIndex)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    int32_t nHeight;
+    int64_t nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nHeight) || !ParseInt64(path[1], &nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid range. Use /rest/" + strName + "/<height>/<count>.bin.");
+    if (nHeight < 0 || nCount < 1)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid range: " + param);
+
+    LOCK(cs_main);
+    if (nHeight > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Height out of range: " + path[0]);
+    // Clamp the count before adding, as it may be anything up to INT64_MAX
+    const int nEnd = nHeight + std::min<int64_t>(nCount, chainActive.Height() + 1 - nHeight);
+    vIndex.reserve(nEnd - nHeight);
+    for (int h = nHeight; h < nEnd; h++)
+        vIndex.push_back(chainActive[h]);
+    return true;
+}
+
+static bool rest_headerrange(HTTPRequest* req, const std::string& strURIPart)
+{
+    std::vector<const CBlockIndex*> vIndex;
+    if (!ParseBlockRange(req, strURIPart, "headerrange", vIndex))
+        return false;
+
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->WriteReplyStart(HTTP_OK);
+    CDataStream ssHeaders(SER_NETWORK, PROTOCOL_VERSION);
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        ssHeaders << vIndex[i]->GetBlockHeader();
+        if (ssHeaders.size() >= REST_RANGE_CHUNK_SIZE || i + 1 == vIndex.size()) {
+            // The client stalled; ending the reply normally would make it look complete
+            if (!req->WriteReplyChunk(ssHeaders.str())) {
+                req->WriteReplyAbort();
+                return true;
+            }
+            ssHeaders.clear();
+        }
+    }
+    req->WriteReplyEnd();
+    return true;
+}
+
+static bool rest_blockrange(HTTPRequest* req, const std::string& strURIPart)
+{
+    std::vector<const CBlockIndex*> vIndex;
+    if (!ParseBlockRange(req, strURIPart, "blockrange", vIndex))
+        return false;
+
+    std::vector<CDiskBlockPos> vPos;
+    vPos.reserve(vIndex.size());
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex : vIndex) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            vPos.push_back(pindex->GetBlockPos());
+        }
+    }
+
+    // Blocks are stored in the format they are sent in unless witness data is
+    // to be stripped, so they can usually be copied from the block files as is
+    const int serializeFlags = RPCSerializationFlags();
+    CRawBlockReader reader;
+    std::vector<unsigned char> vBlock;
+    std::string strChunk;
+    bool fStarted = false;
+    for (size_t i = 0; i < vPos.size(); i++) {
+        bool fRead;
+        if (serializeFlags == 0) {
+            fRead = reader.Read(vBlock, vPos[i], Params().MessageStart());
+            if (fRead)
+                strChunk.append(vBlock.begin(), vBlock.end());
+        } else {
+            CBlock block;
+            fRead = ReadBlockFromDisk(block, vPos[i], Params().GetConsensus());
+            if (fRead) {
+                CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | serializeFlags);
+                ssBlock << block;
+                strChunk.append(ssBlock.begin(), ssBlock.end());
+            }
+        }
+        if (!fRead) {
+            if (!fStarted)
+                return RESTERR(req, HTTP_NOT_FOUND, vIndex[i]->GetBlockHash().GetHex() + " not found");
+            // Possibly pruned meanwhile; the reply must not look complete
+            LogPrintf("%s: could not read block at height %d, aborting reply\n", __func__, vIndex[i]->nHeight);
+            req->WriteReplyAbort();
+            return true;
+        }
+        if (strChunk.size() >= REST_RANGE_CHUNK_SIZE || i + 1 == vPos.size()) {
+            if (!fStarted) {
+                req->WriteHeader("Content-Type", "application/octet-stream");
+                req->WriteReplyStart(HTTP_OK);
+                fStarted = true;
+            }
+            if (!req->WriteReplyChunk(strChunk)) {
+                req->WriteReplyAbort();
+                return true;
+            }
+            strChunk.clear();
+        }
+    }
+    req->WriteReplyEnd();
+    return true;
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const JSONRPCRequest& request);
 
@@ -597,6 +770,8 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockrange/", rest_blockrange},
+      {"/rest/headerrange/", rest_headerrange},
       {"/rest/getutxos", rest_getutxos},
 };
 
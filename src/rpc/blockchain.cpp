@@ -16,6 +16,8 @@
 #include "policy/feerate.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
+#include "rpc/resultcache.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -24,6 +26,7 @@
 #include "util.h"
 #include "utilstrencodings.h"
 #include "hash.h"
+#include "httpserver.h"
 
 #include <stdint.h>
 
@@ -147,6 +150,29 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+/** Stream what blockToJSON gives, encoding the transactions' details on several threads */
+static void blockToJSONStream(JSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    const UniValue header = blockToJSON(block, blockindex, false);
+    const std::vector<std::string>& keys = header.getKeys();
+    const std::vector<UniValue>& values = header.getValues();
+    writer.BeginObject();
+    for (size_t i = 0; i < keys.size(); i++) {
+        writer.Key(keys[i]);
+        if (keys[i] == "tx" && txDetails) {
+            const int serializeFlags = RPCSerializationFlags();
+            writer.EncodedArray(block.vtx.size(), [&block, serializeFlags](size_t n) {
+                UniValue objTx(UniValue::VOBJ);
+                TxToUniv(*block.vtx[n], uint256(), objTx, true, serializeFlags);
+                return objTx.write();
+            }, std::min(GetNumCores(), MAX_JSON_ENCODE_THREADS) - 1, QueueHTTPWork);
+        } else {
+            writer.Value(values[i]);
+        }
+    }
+    writer.EndObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -348,10 +374,9 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+void entryToJSON(UniValue &info, const CTxMemPoolSnapshot::Entry &snapshotEntry)
 {
-    AssertLockHeld(mempool.cs);
-
+    const CTxMemPoolEntry& e = snapshotEntry.entry;
     info.push_back(Pair("size", (int)e.GetTxSize()));
     info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
     info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
@@ -363,12 +388,10 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
     info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
     info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    const CTransaction& tx = e.GetTx();
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (const uint256& parent : snapshotEntry.vParents)
     {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -384,13 +407,15 @@ UniValue mempoolToJSON(bool fVerbose)
 {
     if (fVerbose)
     {
-        LOCK(mempool.cs);
+        // Serialize from a snapshot so mempool.cs is not held while the
+        // (potentially very large) response is built.
+        CTxMemPoolSnapshotRef snapshot = mempool.GetSnapshot();
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : mempool.mapTx)
+        for (const CTxMemPoolSnapshot::Entry& snapshotEntry : snapshot->vEntries)
         {
-            const uint256& hash = e.GetTx().GetHash();
+            const uint256& hash = snapshotEntry.entry.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
+            entryToJSON(info, snapshotEntry);
             o.push_back(Pair(hash.ToString(), info));
         }
         return o;
@@ -437,9 +462,103 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
+    if (request.stream && fVerbose) {
+        CTxMemPoolSnapshotRef snapshot = mempool.GetSnapshot();
+        JSONStreamWriter& writer = *request.stream;
+        writer.BeginObject();
+        for (const CTxMemPoolSnapshot::Entry& snapshotEntry : snapshot->vEntries)
+        {
+            UniValue info(UniValue::VOBJ);
+            entryToJSON(info, snapshotEntry);
+            writer.Key(snapshotEntry.entry.GetTx().GetHash().ToString());
+            writer.Value(info);
+        }
+        writer.EndObject();
+        return NullUniValue;
+    }
     return mempoolToJSON(fVerbose);
 }
 
+UniValue getmempoolchanges(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "getmempoolchanges ( sequence \"nonce\" )\n"
+            "\nReturns the transaction ids added to and removed from the memory pool since the given sequence number.\n"
+            "\nStart with sequence 0, then pass the \"sequence\" and \"nonce\" of each result to the next call. If the node no\n"
+            "longer remembers that far back, or the nonce does not match because the node restarted since, \"full\" is set and\n"
+            "\"added\" holds every transaction currently in the memory pool.\n"
+            "\nArguments:\n"
+            "1. sequence (numeric, optional, default=0) The \"sequence\" returned by a previous call\n"
+            "2. \"nonce\"  (string, optional) The \"nonce\" returned by that call; required for a non-zero sequence\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sequence\" : n,          (numeric) The current memory pool sequence number\n"
+            "  \"nonce\" : \"hex\",        (string) Identifies the run of the node the sequence numbers belong to\n"
+            "  \"full\" : true|false,     (boolean) Whether \"added\" is the full memory pool contents rather than a difference\n"
+            "  \"added\" : [              (json array of string)\n"
+            "    \"transactionid\"        (string) The id of a transaction that entered the memory pool\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"removed\" : [            (json array of string)\n"
+            "    \"transactionid\"        (string) The id of a transaction that left the memory pool\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmempoolchanges", "")
+            + HelpExampleCli("getmempoolchanges", "1234 \"8f6b0e1c2d3a4b5c\"")
+            + HelpExampleRpc("getmempoolchanges", "1234, \"8f6b0e1c2d3a4b5c\"")
+        );
+
+    int64_t nSequence = 0;
+    if (!request.params[0].isNull())
+        nSequence = request.params[0].get_int64();
+    if (nSequence < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative sequence");
+    std::string strNonce;
+    if (!request.params[1].isNull())
+        strNonce = request.params[1].get_str();
+
+    uint64_t nCurrent;
+    uint64_t nNonce;
+    bool fFull = false;
+    std::vector<uint256> vAdded, vRemoved;
+    {
+        // Changes are logged while mempool.cs is held, so holding it here
+        // keeps the sequence number and the txids consistent.
+        LOCK(mempool.cs);
+        nCurrent = mempool.changeLog.GetSequence();
+        nNonce = mempool.changeLog.GetNonce();
+        // A sequence number from another run of the node says nothing about
+        // this one's log, even if it is in range.
+        const bool fSameLog = nSequence == 0 || strNonce == strprintf("%016x", nNonce);
+        if (fSameLog && (uint64_t)nSequence > nCurrent)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Sequence is ahead of the memory pool");
+        if (!fSameLog || !mempool.changeLog.GetChangesSince(nSequence, vAdded, vRemoved)) {
+            fFull = true;
+            vAdded.clear();
+            vRemoved.clear();
+            mempool.queryHashes(vAdded);
+        }
+    }
+
+    UniValue added(UniValue::VARR);
+    for (const uint256& hash : vAdded)
+        added.push_back(hash.ToString());
+    UniValue removed(UniValue::VARR);
+    for (const uint256& hash : vRemoved)
+        removed.push_back(hash.ToString());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("sequence", (int64_t)nCurrent));
+    ret.push_back(Pair("nonce", strprintf("%016x", nNonce)));
+    ret.push_back(Pair("full", fFull));
+    ret.push_back(Pair("added", added));
+    ret.push_back(Pair("removed", removed));
+    return ret;
+}
+
 UniValue getmempoolancestors(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
@@ -472,32 +591,39 @@ UniValue getmempoolancestors(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    std::vector<CTxMemPoolSnapshot::Entry> vAncestors;
+    {
+        LOCK(mempool.cs);
+
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
-    }
+        CTxMemPool::setEntries setAncestors;
+        uint64_t noLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+        vAncestors.reserve(setAncestors.size());
+        for (CTxMemPool::txiter ancestorIt : setAncestors) {
+            vAncestors.push_back(mempool.GetSnapshotEntry(ancestorIt));
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        for (const CTxMemPoolSnapshot::Entry& ancestor : vAncestors) {
+            o.push_back(ancestor.entry.GetTx().GetHash().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const CTxMemPoolSnapshot::Entry& ancestor : vAncestors) {
+            const uint256& _hash = ancestor.entry.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
+            entryToJSON(info, ancestor);
             o.push_back(Pair(_hash.ToString(), info));
         }
         return o;
@@ -536,32 +662,39 @@ UniValue getmempooldescendants(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    std::vector<CTxMemPoolSnapshot::Entry> vDescendants;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
+
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(it, setDescendants);
+        // CTxMemPool::CalculateDescendants will include the given tx
+        setDescendants.erase(it);
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+        vDescendants.reserve(setDescendants.size());
+        for (CTxMemPool::txiter descendantIt : setDescendants) {
+            vDescendants.push_back(mempool.GetSnapshotEntry(descendantIt));
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        for (const CTxMemPoolSnapshot::Entry& descendant : vDescendants) {
+            o.push_back(descendant.entry.GetTx().GetHash().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const CTxMemPoolSnapshot::Entry& descendant : vDescendants) {
+            const uint256& _hash = descendant.entry.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
+            entryToJSON(info, descendant);
             o.push_back(Pair(_hash.ToString(), info));
         }
         return o;
@@ -588,16 +721,19 @@ UniValue getmempoolentry(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    std::unique_ptr<CTxMemPoolSnapshot::Entry> entry;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
+        entry.reset(new CTxMemPoolSnapshot::Entry(mempool.GetSnapshotEntry(it)));
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(info, e);
+    entryToJSON(info, *entry);
     return info;
 }
 
@@ -682,6 +818,15 @@ UniValue getblockheader(const JSONRPCRequest& request)
         return strHex;
     }
 
+    if (request.stream) {
+        const std::string key = "getblockheader/" + hash.GetHex();
+        if (!WriteCachedResult(request, key)) {
+            WriteResult(request, key, pblockindex, [pblockindex](JSONStreamWriter& writer) {
+                writer.Value(blockheaderToJSON(pblockindex));
+            });
+        }
+        return NullUniValue;
+    }
     return blockheaderToJSON(pblockindex);
 }
 
@@ -754,6 +899,11 @@ UniValue getblock(const JSONRPCRequest& request)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
+    // Results about deep blocks are cached, so check before reading the block
+    const std::string key = strprintf("getblock/%s/%d/%d", hash.GetHex(), std::max(0, std::min(verbosity, 2)), RPCSerializationFlags());
+    if (WriteCachedResult(request, key))
+        return NullUniValue;
+
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
@@ -770,9 +920,21 @@ UniValue getblock(const JSONRPCRequest& request)
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        if (request.stream && IsResultCacheable(pblockindex)) {
+            WriteResult(request, key, pblockindex, [&strHex](JSONStreamWriter& writer) {
+                writer.Value(strHex);
+            });
+            return NullUniValue;
+        }
         return strHex;
     }
 
+    if (request.stream) {
+        WriteResult(request, key, pblockindex, [&block, pblockindex, verbosity](JSONStreamWriter& writer) {
+            blockToJSONStream(writer, block, pblockindex, verbosity >= 2);
+        });
+        return NullUniValue;
+    }
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
@@ -1325,6 +1487,7 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("ancestorcacheusage", (int64_t) mempool.AncestorCacheUsage()));
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
@@ -1343,6 +1506,7 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
             "  \"bytes\": xxxxx,              (numeric) Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
+            "  \"ancestorcacheusage\": xxxxx, (numeric) Memory used by cached ancestor sets, not counted in usage or against maxmempool but capped separately\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum feerate (" + CURRENCY_UNIT + " per KB) for tx to be accepted\n"
             "}\n"
@@ -1533,35 +1697,36 @@ UniValue getchaintxstats(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafe argNames
-  //  --------------------- ------------------------  -----------------------  ------ ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  {} },
-    { "blockchain",         "getchaintxstats",        &getchaintxstats,        true,  {"nblocks", "blockhash"} },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  {} },
-    { "blockchain",         "getblockcount",          &getblockcount,          true,  {} },
-    { "blockchain",         "getblock",               &getblock,               true,  {"blockhash","verbosity|verbose"} },
-    { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
-    { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
-    { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
-    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
-    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
-    { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
-    { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
-    { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
-
-    { "blockchain",         "preciousblock",          &preciousblock,          true,  {"blockhash"} },
+{ //  category              name                      actor (function)         okSafe readOnly argNames
+  //  --------------------- ------------------------  -----------------------  ------ -------- ----------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  true,    {} },
+    { "blockchain",         "getchaintxstats",        &getchaintxstats,        true,  true,    {"nblocks", "blockhash"} },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  true,    {} },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  true,    {} },
+    { "blockchain",         "getblock",               &getblock,               true,  true,    {"blockhash","verbosity|verbose"} },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  true,    {"height"} },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  true,    {"blockhash","verbose"} },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  true,    {} },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  true,    {} },
+    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  true,    {"txid","verbose"} },
+    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  true,    {"txid","verbose"} },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  true,    {"txid"} },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  true,    {} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  true,    {"verbose"} },
+    { "blockchain",         "getmempoolchanges",      &getmempoolchanges,      true,  true,    {"sequence","nonce"} },
+    { "blockchain",         "gettxout",               &gettxout,               true,  true,    {"txid","n","include_mempool"} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  true,    {} },
+    { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  false,   {"height"} },
+    { "blockchain",         "verifychain",            &verifychain,            true,  false,   {"checklevel","nblocks"} },
+
+    { "blockchain",         "preciousblock",          &preciousblock,          true,  false,   {"blockhash"} },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true,  {"blockhash"} },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  {"blockhash"} },
-    { "hidden",             "waitfornewblock",        &waitfornewblock,        true,  {"timeout"} },
-    { "hidden",             "waitforblock",           &waitforblock,           true,  {"blockhash","timeout"} },
-    { "hidden",             "waitforblockheight",     &waitforblockheight,     true,  {"height","timeout"} },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,  false,   {"blockhash"} },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  false,   {"blockhash"} },
+    { "hidden",             "waitfornewblock",        &waitfornewblock,        true,  false,   {"timeout"} },
+    { "hidden",             "waitforblock",           &waitforblock,           true,  false,   {"blockhash","timeout"} },
+    { "hidden",             "waitforblockheight",     &waitforblockheight,     true,  false,   {"height","timeout"} },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &t)
@@ -0,0 +1,192 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+
+#include <univalue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+/** Items encoded per thread in each round of EncodedArray */
+static const size_t JSON_ENCODE_ROUND_ITEMS = 64;
+
+namespace {
+/**
+ * One round of EncodedArray, shared with the helpers working on it. Each
+ * claims the next item not yet taken until none are left; the last to finish
+ * wakes the caller. encode is only used for claimed items, which the caller
+ * waits for, so it is never used after EncodedArray returned.
+ */
+struct JSONEncodeRound
+{
+    const std::function<std::string(size_t)>& encode;
+    const size_t nStart;
+    const size_t nEnd;
+    std::vector<std::string> vEncoded;
+    std::atomic<size_t> nNext;
+    std::atomic<bool> fError;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t nDone;
+    std::exception_ptr error;
+
+    JSONEncodeRound(const std::function<std::string(size_t)>& encodeIn, size_t nStartIn, size_t nEndIn) :
+        encode(encodeIn), nStart(nStartIn), nEnd(nEndIn), vEncoded(nEndIn - nStartIn), nNext(nStartIn), fError(false), nDone(0) {}
+
+    void Run()
+    {
+        size_t nRan = 0;
+        for (size_t i = nNext++; i < nEnd; i = nNext++) {
+            if (!fError) {
+                try {
+                    vEncoded[i - nStart] = encode(i);
+                } catch (...) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (!fError.exchange(true))
+                        error = std::current_exception();
+                }
+            }
+            nRan++;
+        }
+        if (nRan > 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            nDone += nRan;
+            if (nDone == vEncoded.size())
+                cond.notify_all();
+        }
+    }
+};
+}
+
+JSONStreamWriter::JSONStreamWriter(const Sink& sinkIn, size_t nFlushSizeIn) :
+    sink(sinkIn), nFlushSize(nFlushSizeIn), nTeeStart(0), fAfterKey(false), fUsed(false), fFlushed(false)
+{
+    strBuffer.reserve(nFlushSize);
+}
+
+void JSONStreamWriter::Separate()
+{
+    fUsed = true;
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            strBuffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void JSONStreamWriter::Written()
+{
+    if (strBuffer.size() >= nFlushSize)
+        Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    vEmpty.pop_back();
+    strBuffer += '}';
+    Written();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    vEmpty.pop_back();
+    strBuffer += ']';
+    Written();
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    Separate();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    Encoded(value.write());
+}
+
+void JSONStreamWriter::Encoded(const std::string& json)
+{
+    Separate();
+    strBuffer += json;
+    Written();
+}
+
+void JSONStreamWriter::EncodedArray(size_t nItems, const std::function<std::string(size_t)>& encode, int nHelpers, const Launcher& launch)
+{
+    BeginArray();
+    nHelpers = launch ? std::min<int>(nHelpers, (nItems + JSON_ENCODE_ROUND_ITEMS - 1) / JSON_ENCODE_ROUND_ITEMS - 1) : 0;
+    if (nHelpers <= 0) {
+        for (size_t i = 0; i < nItems; i++)
+            Encoded(encode(i));
+        EndArray();
+        return;
+    }
+
+    // Encode in rounds, so that only one round's output is held at a time
+    const size_t nRound = (nHelpers + 1) * JSON_ENCODE_ROUND_ITEMS;
+    for (size_t nStart = 0; nStart < nItems; nStart += nRound) {
+        std::shared_ptr<JSONEncodeRound> round = std::make_shared<JSONEncodeRound>(encode, nStart, std::min(nItems, nStart + nRound));
+        for (int i = 0; i < nHelpers; i++) {
+            if (!launch([round] { round->Run(); }))
+                break;
+        }
+        // Work on the round here too, so it completes even if no helper gets to run
+        round->Run();
+        {
+            std::unique_lock<std::mutex> lock(round->mutex);
+            round->cond.wait(lock, [&round] { return round->nDone == round->vEncoded.size(); });
+        }
+        if (round->error)
+            std::rethrow_exception(round->error);
+        for (const std::string& json : round->vEncoded)
+            Encoded(json);
+    }
+    EndArray();
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    sink(strBuffer);
+    if (tee && strBuffer.size() > nTeeStart)
+        tee(strBuffer.substr(nTeeStart));
+    strBuffer.clear();
+    nTeeStart = 0;
+    fFlushed = true;
+}
+
+void JSONStreamWriter::SetTee(const Sink& teeIn)
+{
+    if (tee && strBuffer.size() > nTeeStart)
+        tee(strBuffer.substr(nTeeStart));
+    tee = teeIn;
+    nTeeStart = strBuffer.size();
+}
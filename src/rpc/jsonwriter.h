@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONWRITER_H
+#define BITCOIN_RPC_JSONWRITER_H
+
+#include <functional>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Output buffered by JSONStreamWriter before it is passed on */
+static const size_t JSON_STREAM_FLUSH_SIZE = 64 * 1024;
+/** Most threads EncodedArray encodes on, including the caller's */
+static const int MAX_JSON_ENCODE_THREADS = 4;
+
+/**
+ * Writes one JSON value piece by piece, so that large results need not be
+ * built as a UniValue tree and then serialized as a whole. Output is buffered
+ * and handed to the sink whenever the buffer passes the flush size, and on
+ * Flush.
+ *
+ * Commas are inserted as needed; the caller is responsible for nesting and,
+ * inside objects, for a Key before each value.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+    /** Runs a function on another thread, returning false if it cannot */
+    typedef std::function<bool(const std::function<void()>&)> Launcher;
+
+    explicit JSONStreamWriter(const Sink& sinkIn, size_t nFlushSizeIn = JSON_STREAM_FLUSH_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    /** Write a value that is already encoded as JSON */
+    void Encoded(const std::string& json);
+    /**
+     * Write an array of nItems values, the i'th encoded by encode(i). Up to
+     * nHelpers functions are started through launch, e.g. on a worker pool,
+     * to encode items in parallel with the caller, a few hundred at a time,
+     * so encode must be safe to call concurrently. Helpers that only start
+     * once the caller is done find nothing left to do.
+     */
+    void EncodedArray(size_t nItems, const std::function<std::string(size_t)>& encode, int nHelpers = 0, const Launcher& launch = nullptr);
+
+    /** Pass everything buffered to the sink */
+    void Flush();
+    /**
+     * Also pass everything written from now on to tee as it is handed to the
+     * sink, until the tee is replaced or cleared with nullptr. Output still
+     * buffered then is passed to the old tee first.
+     */
+    void SetTee(const Sink& teeIn);
+
+    /** Whether anything was written yet */
+    bool IsUsed() const { return fUsed; }
+    /** Whether the sink has been given any output */
+    bool HasFlushed() const { return fFlushed; }
+    /** Output not yet passed to the sink */
+    const std::string& GetBuffer() const { return strBuffer; }
+
+private:
+    Sink sink;
+    Sink tee;
+    const size_t nFlushSize;
+    std::string strBuffer;
+    //! Where the output for tee starts in strBuffer
+    size_t nTeeStart;
+    //! For each open object or array, whether nothing was written in it yet
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fUsed;
+    bool fFlushed;
+
+    /** Write the comma, if any, that goes before the next key or value */
+    void Separate();
+    void Written();
+};
+
+#endif // BITCOIN_RPC_JSONWRITER_H
@@ -965,20 +965,20 @@ UniValue estimaterawfee(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  {"nblocks","height"} },
-    { "mining",             "getmininginfo",          &getmininginfo,          true,  {} },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  {"txid","dummy","fee_delta"} },
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  {"template_request"} },
-    { "mining",             "submitblock",            &submitblock,            true,  {"hexdata","dummy"} },
+{ //  category              name                      actor (function)         okSafe readOnly argNames
+  //  --------------------- ------------------------  -----------------------  ------ -------- ----------
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  true,    {"nblocks","height"} },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,  true,    {} },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  false,   {"txid","dummy","fee_delta"} },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  false,   {"template_request"} },
+    { "mining",             "submitblock",            &submitblock,            true,  false,   {"hexdata","dummy"} },
 
-    { "generating",         "generatetoaddress",      &generatetoaddress,      true,  {"nblocks","address","maxtries"} },
+    { "generating",         "generatetoaddress",      &generatetoaddress,      true,  false,   {"nblocks","address","maxtries"} },
 
-    { "util",               "estimatefee",            &estimatefee,            true,  {"nblocks"} },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,  {"conf_target", "estimate_mode"} },
+    { "util",               "estimatefee",            &estimatefee,            true,  true,    {"nblocks"} },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,  true,    {"conf_target", "estimate_mode"} },
 
-    { "hidden",             "estimaterawfee",         &estimaterawfee,         true,  {"conf_target", "threshold"} },
+    { "hidden",             "estimaterawfee",         &estimaterawfee,         true,  true,    {"conf_target", "threshold"} },
 };
 
 void RegisterMiningRPCCommands(CRPCTable &t)
@@ -13,6 +13,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpc/blockchain.h"
+#include "rpc/resultcache.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "util.h"
@@ -568,6 +569,59 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+UniValue gethttpinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "gethttpinfo\n"
+            "Returns an object containing information about the HTTP server's work queue and result cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"eventthreads\": n,         (numeric) Number of threads accepting and reading requests\n"
+            "  \"workthreads\": n,          (numeric) Number of threads handling requests\n"
+            "  \"depth\": n,                (numeric) Number of requests waiting for a worker\n"
+            "  \"maxdepth\": n,             (numeric) Number of waiting requests beyond which new ones are rejected\n"
+            "  \"peakdepth\": n,            (numeric) Largest number of requests that were waiting at once\n"
+            "  \"processed\": n,            (numeric) Number of requests and batch elements picked up by a worker\n"
+            "  \"rejected\": n,             (numeric) Number of requests rejected because the queue was full\n"
+            "  \"avgwait\": x.xxx,          (numeric) Average time in milliseconds items waited for a worker\n"
+            "  \"maxwait\": x.xxx,          (numeric) Longest time in milliseconds an item waited for a worker\n"
+            "  \"resultcache\": {           (json object) Cached results about deep blocks\n"
+            "    \"entries\": n,            (numeric) Number of cached results\n"
+            "    \"bytes\": n,              (numeric) Total size of the cached results\n"
+            "    \"hits\": n,               (numeric) Number of requests answered from the cache\n"
+            "    \"misses\": n              (numeric) Number of lookups that found no valid result\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gethttpinfo", "")
+            + HelpExampleRpc("gethttpinfo", "")
+        );
+
+    HTTPWorkQueueStats stats;
+    if (!GetHTTPWorkQueueStats(stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "HTTP server is not running");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("eventthreads", stats.eventThreads));
+    obj.push_back(Pair("workthreads", stats.threads));
+    obj.push_back(Pair("depth", (uint64_t)stats.depth));
+    obj.push_back(Pair("maxdepth", (uint64_t)stats.maxDepth));
+    obj.push_back(Pair("peakdepth", (uint64_t)stats.peakDepth));
+    obj.push_back(Pair("processed", stats.processed));
+    obj.push_back(Pair("rejected", stats.rejected));
+    obj.push_back(Pair("avgwait", stats.processed ? stats.totalWaitMicros / 1000.0 / stats.processed : 0.0));
+    obj.push_back(Pair("maxwait", stats.maxWaitMicros / 1000.0));
+    const CResultCache::Stats cacheStats = GetResultCacheStats();
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("entries", (uint64_t)cacheStats.nEntries));
+    cache.push_back(Pair("bytes", (uint64_t)cacheStats.nBytes));
+    cache.push_back(Pair("hits", cacheStats.nHits));
+    cache.push_back(Pair("misses", cacheStats.nMisses));
+    obj.push_back(Pair("resultcache", cache));
+    return obj;
+}
+
 uint32_t getCategoryMask(UniValue cats) {
     cats = cats.get_array();
     uint32_t mask = 0;
@@ -649,20 +703,21 @@ UniValue echo(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true,  {} }, /* uses wallet if enabled */
-    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {"mode"} },
-    { "util",               "validateaddress",        &validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true,  {"nrequired","keys"} },
-    { "util",               "verifymessage",          &verifymessage,          true,  {"address","signature","message"} },
-    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,  {"privkey","message"} },
+{ //  category              name                      actor (function)         okSafe readOnly argNames
+  //  --------------------- ------------------------  -----------------------  ------ -------- ----------
+    { "control",            "getinfo",                &getinfo,                true,  true,    {} }, /* uses wallet if enabled */
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  true,    {"mode"} },
+    { "control",            "gethttpinfo",            &gethttpinfo,            true,  true,    {} },
+    { "util",               "validateaddress",        &validateaddress,        true,  true,    {"address"} }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,  true,    {"nrequired","keys"} },
+    { "util",               "verifymessage",          &verifymessage,          true,  true,    {"address","signature","message"} },
+    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,  false,   {"privkey","message"} },
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true,  {"timestamp"}},
-    { "hidden",             "echo",                   &echo,                   true,  {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
-    { "hidden",             "echojson",               &echo,                   true,  {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
-    { "hidden",             "logging",                &logging,                true,  {"include", "exclude"}},
+    { "hidden",             "setmocktime",            &setmocktime,            true,  false,   {"timestamp"}},
+    { "hidden",             "echo",                   &echo,                   true,  true,    {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
+    { "hidden",             "echojson",               &echo,                   true,  true,    {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
+    { "hidden",             "logging",                &logging,                true,  false,   {"include", "exclude"}},
 };
 
 void RegisterMiscRPCCommands(CRPCTable &t)
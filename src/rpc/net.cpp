@@ -65,6 +65,16 @@ UniValue ping(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue MsgCostToJSON(const CMsgCost& cost)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", cost.nCount));
+    obj.push_back(Pair("total_us", cost.nTotalMicros));
+    obj.push_back(Pair("max_us", cost.nMaxMicros));
+    obj.push_back(Pair("cs_main_us", cost.nMainLockMicros));
+    return obj;
+}
+
 UniValue getpeerinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -101,6 +111,8 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) How many blocks we are willing to have in flight from this peer\n"
+            "    \"blockdeliverytime\": n,    (numeric) Average time in milliseconds this peer takes to deliver a requested block (0 if unknown)\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -109,7 +121,12 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
-            "    }\n"
+            "    },\n"
+            "    \"cost_per_msg\": {         (json object) Message handler time by received message type, see getmessagecosts\n"
+            "       \"addr\": {...},\n"
+            "       ...\n"
+            "    },\n"
+            "    \"sendmessages_cost\": {...} (json object) Message handler time spent sending to the peer\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -167,6 +184,8 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_limit", statestats.nBlocksInTransitLimit));
+            obj.push_back(Pair("blockdeliverytime", statestats.nBlockDeliveryTime / 1000));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -184,6 +203,14 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue costPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdCost::value_type &i : stats.mapCostPerMsgCmd) {
+            if (i.second.nCount > 0)
+                costPerMsgCmd.push_back(Pair(i.first, MsgCostToJSON(i.second)));
+        }
+        obj.push_back(Pair("cost_per_msg", costPerMsgCmd));
+        obj.push_back(Pair("sendmessages_cost", MsgCostToJSON(stats.sendMessagesCost)));
+
         ret.push_back(obj);
     }
 
@@ -345,6 +372,142 @@ UniValue getaddednodeinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getmessagecosts(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getmessagecosts\n"
+            "\nReturns the time the message handler has spent on each type of received message,\n"
+            "and on sending, over all peers since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"messages\": {\n"
+            "    \"addr\": {\n"
+            "      \"count\": n,        (numeric) Number of messages handled\n"
+            "      \"total_us\": n,     (numeric) Total time spent handling them, in microseconds\n"
+            "      \"max_us\": n,       (numeric) Longest time spent on one, in microseconds\n"
+            "      \"cs_main_us\": n    (numeric) Part of total_us spent holding cs_main\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"sendmessages\": {...}  (json object) The same for sending, with count the number of rounds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmessagecosts", "")
+            + HelpExampleRpc("getmessagecosts", "")
+        );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    mapMsgCmdCost mapCost;
+    CMsgCost sendCost;
+    g_connman->GetMsgCosts(mapCost, sendCost);
+
+    UniValue messages(UniValue::VOBJ);
+    for (const mapMsgCmdCost::value_type &i : mapCost) {
+        if (i.second.nCount > 0)
+            messages.push_back(Pair(i.first, MsgCostToJSON(i.second)));
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("messages", messages));
+    obj.push_back(Pair("sendmessages", MsgCostToJSON(sendCost)));
+    return obj;
+}
+
+UniValue getblockpropagation(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getblockpropagation\n"
+            "\nReturns how the most recent blocks reached this node and were relayed to high-bandwidth\n"
+            "compact block peers, oldest first. Times after the first are in microseconds since the\n"
+            "block was first announced.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"hash\": \"hash\",            (string) The block hash\n"
+            "    \"height\": n,               (numeric) The block height, if known\n"
+            "    \"announced\": {\n"
+            "      \"time\": n,               (numeric) When the block was first announced, in microseconds since epoch\n"
+            "      \"peer\": n,               (numeric) The peer that announced it, absent for blocks of our own\n"
+            "      \"via\": \"str\"             (string) The announcing message: headers, cmpctblock, block or local\n"
+            "    },\n"
+            "    \"compact\": {               (json object, optional) The first compact block received for it\n"
+            "      \"after_us\": n,\n"
+            "      \"peer\": n,\n"
+            "      \"txs\": n,                (numeric) Transactions in the block\n"
+            "      \"prefilled\": n,          (numeric) Transactions sent along with the compact block\n"
+            "      \"mempool\": n,            (numeric) Transactions found in the mempool\n"
+            "      \"extra\": n,              (numeric) Transactions found among orphans and replaced ones (-blockreconstructionextratxn)\n"
+            "      \"missing\": n             (numeric) Transactions that had to be requested, costing a round trip\n"
+            "    },\n"
+            "    \"received\": {              (json object, optional) When all of the block's transactions were in hand\n"
+            "      \"after_us\": n,\n"
+            "      \"peer\": n,\n"
+            "      \"via\": \"str\"             (string) The completing message: cmpctblock, blocktxn or block\n"
+            "    },\n"
+            "    \"processed_after_us\": n,   (numeric, optional) When processing of the block finished\n"
+            "    \"relays\": [                (array) First compact block relay to each high-bandwidth peer\n"
+            "      {\n"
+            "        \"peer\": n,\n"
+            "        \"after_us\": n\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockpropagation", "")
+            + HelpExampleRpc("getblockpropagation", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const CBlockPropagation& block : GetBlockPropagation()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("hash", block.hash.GetHex()));
+        if (block.nHeight >= 0)
+            obj.push_back(Pair("height", block.nHeight));
+
+        UniValue announced(UniValue::VOBJ);
+        announced.push_back(Pair("time", block.nAnnounceTime));
+        if (block.nAnnouncePeer >= 0)
+            announced.push_back(Pair("peer", block.nAnnouncePeer));
+        announced.push_back(Pair("via", block.strAnnounceVia));
+        obj.push_back(Pair("announced", announced));
+
+        if (block.nCompactTime) {
+            UniValue compact(UniValue::VOBJ);
+            compact.push_back(Pair("after_us", block.nCompactTime - block.nAnnounceTime));
+            compact.push_back(Pair("peer", block.nCompactPeer));
+            compact.push_back(Pair("txs", block.nTxs));
+            compact.push_back(Pair("prefilled", block.nPrefilledTxs));
+            compact.push_back(Pair("mempool", block.nMempoolTxs));
+            compact.push_back(Pair("extra", block.nExtraTxs));
+            compact.push_back(Pair("missing", block.nMissingTxs));
+            obj.push_back(Pair("compact", compact));
+        }
+        if (block.nReceivedTime) {
+            UniValue received(UniValue::VOBJ);
+            received.push_back(Pair("after_us", block.nReceivedTime - block.nAnnounceTime));
+            received.push_back(Pair("peer", block.nReceivedPeer));
+            received.push_back(Pair("via", block.strReceivedVia));
+            obj.push_back(Pair("received", received));
+        }
+        if (block.nProcessedTime)
+            obj.push_back(Pair("processed_after_us", block.nProcessedTime - block.nAnnounceTime));
+
+        UniValue relays(UniValue::VARR);
+        for (const std::pair<NodeId, int64_t>& relay : block.vRelays) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("peer", relay.first));
+            entry.push_back(Pair("after_us", relay.second - block.nAnnounceTime));
+            relays.push_back(entry);
+        }
+        obj.push_back(Pair("relays", relays));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue getnettotals(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 0)
@@ -365,6 +528,13 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"blockcache\":\n"
+            "  {\n"
+            "    \"blocks\": n,                            (numeric) Number of recent blocks cached for serving to peers\n"
+            "    \"bytes\": n,                             (numeric) Memory held by them and their cached serializations\n"
+            "    \"hits\": n,                              (numeric) Requests served from the cache\n"
+            "    \"misses\": n                             (numeric) Requests that had to read the block from disk\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -387,6 +557,14 @@ UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    CBlockCache::Stats cacheStats = GetBlockCacheStats();
+    UniValue blockCache(UniValue::VOBJ);
+    blockCache.push_back(Pair("blocks", (uint64_t)cacheStats.nBlocks));
+    blockCache.push_back(Pair("bytes", (uint64_t)cacheStats.nBytes));
+    blockCache.push_back(Pair("hits", cacheStats.nHits));
+    blockCache.push_back(Pair("misses", cacheStats.nMisses));
+    obj.push_back(Pair("blockcache", blockCache));
     return obj;
 }
 
@@ -584,6 +762,82 @@ UniValue listbanned(const JSONRPCRequest& request)
     return bannedAddresses;
 }
 
+UniValue importbanlist(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+                            "importbanlist [\"subnet\" or {\"address\":\"subnet\",\"banned_until\":n},...] (bantime)\n"
+                            "\nBans many IPs/Subnets at once. The output of listbanned can be imported as is,\n"
+                            "so the two together move a ban list between nodes. Subnets already banned keep\n"
+                            "the later of the two ban times.\n"
+                            "\nArguments:\n"
+                            "1. \"bans\"         (array, required) IPs/Subnets with an optional netmask, or objects with\n"
+                            "                    \"address\", \"banned_until\" (absolute timestamp) and optionally \"ban_created\"\n"
+                            "                    and \"ban_reason\" as listed by listbanned\n"
+                            "2. \"bantime\"      (numeric, optional) time in seconds how long the IPs/Subnets given as strings are banned\n"
+                            "                    (0 or empty means using the default time of 24h which can also be overwritten by the -bantime startup argument)\n"
+                            "\nResult:\n"
+                            "n    (numeric) The number of bans added or extended\n"
+                            "\nExamples:\n"
+                            + HelpExampleCli("importbanlist", "\"[\\\"192.168.0.6\\\",\\\"10.0.0.0/8\\\"]\" 86400")
+                            + HelpExampleRpc("importbanlist", "[\"192.168.0.6\", \"10.0.0.0/8\"], 86400")
+                            );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    const UniValue& bans = request.params[0].get_array();
+    int64_t banTime = 0;
+    if (request.params.size() >= 2 && !request.params[1].isNull())
+        banTime = request.params[1].get_int64();
+    if (banTime <= 0)
+        banTime = gArgs.GetArg("-bantime", DEFAULT_MISBEHAVING_BANTIME);
+
+    const int64_t nNow = GetTime();
+    banmap_t banMap;
+    for (size_t i = 0; i < bans.size(); i++) {
+        const UniValue& ban = bans[i];
+        CBanEntry banEntry(nNow);
+        banEntry.banReason = BanReasonManuallyAdded;
+        banEntry.nBanUntil = nNow + banTime;
+        std::string strSubNet;
+        if (ban.isStr()) {
+            strSubNet = ban.get_str();
+        } else {
+            RPCTypeCheckObj(ban.get_obj(),
+                {
+                    {"address", UniValueType(UniValue::VSTR)},
+                    {"banned_until", UniValueType(UniValue::VNUM)},
+                    {"ban_created", UniValueType(UniValue::VNUM)},
+                    {"ban_reason", UniValueType(UniValue::VSTR)},
+                }, true, false);
+            strSubNet = find_value(ban, "address").get_str();
+            banEntry.nBanUntil = find_value(ban, "banned_until").get_int64();
+            const UniValue& created = find_value(ban, "ban_created");
+            if (!created.isNull())
+                banEntry.nCreateTime = created.get_int64();
+            if (find_value(ban, "ban_reason").isStr() && find_value(ban, "ban_reason").get_str() == "node misbehaving")
+                banEntry.banReason = BanReasonNodeMisbehaving;
+        }
+
+        CSubNet subNet;
+        if (strSubNet.find("/") != std::string::npos) {
+            LookupSubNet(strSubNet.c_str(), subNet);
+        } else {
+            CNetAddr resolved;
+            LookupHost(strSubNet.c_str(), resolved, false);
+            subNet = CSubNet(resolved);
+        }
+        if (!subNet.IsValid())
+            throw JSONRPCError(RPC_CLIENT_INVALID_IP_OR_SUBNET, "Error: Invalid IP/Subnet " + strSubNet);
+
+        CBanEntry& entry = banMap[subNet];
+        if (entry.nBanUntil < banEntry.nBanUntil)
+            entry = banEntry;
+    }
+
+    return (uint64_t)g_connman->ImportBanned(banMap);
+}
+
 UniValue clearbanned(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -623,20 +877,23 @@ UniValue setnetworkactive(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "network",            "getconnectioncount",     &getconnectioncount,     true,  {} },
-    { "network",            "ping",                   &ping,                   true,  {} },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true,  {} },
-    { "network",            "addnode",                &addnode,                true,  {"node","command"} },
-    { "network",            "disconnectnode",         &disconnectnode,         true,  {"address", "nodeid"} },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
-    { "network",            "getnettotals",           &getnettotals,           true,  {} },
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  {} },
-    { "network",            "setban",                 &setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
-    { "network",            "listbanned",             &listbanned,             true,  {} },
-    { "network",            "clearbanned",            &clearbanned,            true,  {} },
-    { "network",            "setnetworkactive",       &setnetworkactive,       true,  {"state"} },
+{ //  category              name                      actor (function)         okSafe readOnly argNames
+  //  --------------------- ------------------------  -----------------------  ------ -------- ----------
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,  true,    {} },
+    { "network",            "ping",                   &ping,                   true,  false,   {} },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,  true,    {} },
+    { "network",            "addnode",                &addnode,                true,  false,   {"node","command"} },
+    { "network",            "disconnectnode",         &disconnectnode,         true,  false,   {"address", "nodeid"} },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  true,    {"node"} },
+    { "network",            "getnettotals",           &getnettotals,           true,  true,    {} },
+    { "network",            "getmessagecosts",        &getmessagecosts,        true,  true,    {} },
+    { "network",            "getblockpropagation",    &getblockpropagation,    true,  true,    {} },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  true,    {} },
+    { "network",            "setban",                 &setban,                 true,  false,   {"subnet", "command", "bantime", "absolute"} },
+    { "network",            "listbanned",             &listbanned,             true,  true,    {} },
+    { "network",            "clearbanned",            &clearbanned,            true,  false,   {} },
+    { "network",            "importbanlist",          &importbanlist,          true,  false,   {"bans", "bantime"} },
+    { "network",            "setnetworkactive",       &setnetworkactive,       true,  false,   {"state"} },
 };
 
 void RegisterNetRPCCommands(CRPCTable &t)
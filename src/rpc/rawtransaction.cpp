@@ -16,6 +16,8 @@
 #include "policy/policy.h"
 #include "policy/rbf.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
+#include "rpc/resultcache.h"
 #include "rpc/server.h"
 #include "script/script.h"
 #include "script/script_error.h"
@@ -29,7 +31,10 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <map>
+#include <set>
 #include <stdint.h>
+#include <vector>
 
 #include <univalue.h>
 
@@ -153,6 +158,11 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
         }
     }
 
+    // Results about transactions in deep blocks are cached, so check before looking the transaction up
+    const std::string key = strprintf("getrawtransaction/%s/%d/%d", hash.GetHex(), fVerbose, RPCSerializationFlags());
+    if (WriteCachedResult(request, key))
+        return NullUniValue;
+
     CTransactionRef tx;
     uint256 hashBlock;
     if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
@@ -160,11 +170,19 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             : "No such mempool transaction. Use -txindex to enable blockchain transaction queries") +
             ". Use gettransaction for wallet transactions.");
 
-    if (!fVerbose)
-        return EncodeHexTx(*tx, RPCSerializationFlags());
-
     UniValue result(UniValue::VOBJ);
-    TxToJSON(*tx, hashBlock, result);
+    if (!fVerbose)
+        result = EncodeHexTx(*tx, RPCSerializationFlags());
+    else
+        TxToJSON(*tx, hashBlock, result);
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (request.stream && mi != mapBlockIndex.end() && IsResultCacheable(mi->second)) {
+        WriteResult(request, key, mi->second, [&result](JSONStreamWriter& writer) {
+            writer.Value(result);
+        });
+        return NullUniValue;
+    }
     return result;
 }
 
@@ -885,6 +903,62 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
     return result;
 }
 
+/**
+ * Submit a transaction to the mempool unless it is already there. On failure
+ * nErrorCode and strError are set to the RPC error to report.
+ */
+static bool SubmitRawTransaction(CTransactionRef tx, CAmount nMaxRawTxFee, int& nErrorCode, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    const uint256& hashTx = tx->GetHash();
+
+    CCoinsViewCache &view = *pcoinsTip;
+    bool fHaveChain = false;
+    for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
+        const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+        fHaveChain = !existingCoin.IsSpent();
+    }
+    bool fHaveMempool = mempool.exists(hashTx);
+    if (!fHaveMempool && !fHaveChain) {
+        // push to local node and sync with wallets
+        CValidationState state;
+        bool fMissingInputs;
+        bool fLimitFree = true;
+        if (!AcceptToMemoryPool(mempool, state, std::move(tx), fLimitFree, &fMissingInputs, nullptr, false, nMaxRawTxFee)) {
+            if (state.IsInvalid()) {
+                nErrorCode = RPC_TRANSACTION_REJECTED;
+                strError = strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+            } else if (fMissingInputs) {
+                nErrorCode = RPC_TRANSACTION_ERROR;
+                strError = "Missing inputs";
+            } else {
+                nErrorCode = RPC_TRANSACTION_ERROR;
+                strError = state.GetRejectReason();
+            }
+            return false;
+        }
+    } else if (fHaveChain) {
+        nErrorCode = RPC_TRANSACTION_ALREADY_IN_CHAIN;
+        strError = "transaction already in block chain";
+        return false;
+    }
+    return true;
+}
+
+/** Announce transactions to all peers, visiting each peer once. */
+static void RelayRawTransactions(const std::vector<uint256>& vHashes)
+{
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    g_connman->ForEachNode([&vHashes](CNode* pnode)
+    {
+        for (const uint256& hash : vHashes) {
+            pnode->PushInventory(CInv(MSG_TX, hash));
+        }
+    });
+}
+
 UniValue sendrawtransaction(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -916,61 +990,180 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     if (!DecodeHexTx(mtx, request.params[0].get_str()))
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
     CTransactionRef tx(MakeTransactionRef(std::move(mtx)));
-    const uint256& hashTx = tx->GetHash();
+    const uint256 hashTx = tx->GetHash();
 
     CAmount nMaxRawTxFee = maxTxFee;
     if (request.params.size() > 1 && request.params[1].get_bool())
         nMaxRawTxFee = 0;
 
-    CCoinsViewCache &view = *pcoinsTip;
-    bool fHaveChain = false;
-    for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
-        const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
-        fHaveChain = !existingCoin.IsSpent();
+    int nErrorCode;
+    std::string strError;
+    if (!SubmitRawTransaction(std::move(tx), nMaxRawTxFee, nErrorCode, strError))
+        throw JSONRPCError(nErrorCode, strError);
+
+    RelayRawTransactions({hashTx});
+    return hashTx.GetHex();
+}
+
+/**
+ * Order a batch of transactions so that every transaction comes after the
+ * ones in the batch it spends from, keeping the given order otherwise.
+ */
+static std::vector<size_t> SortByDependency(const std::vector<CTransactionRef>& vtx)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        mapIndex.emplace(vtx[i]->GetHash(), i);
     }
-    bool fHaveMempool = mempool.exists(hashTx);
-    if (!fHaveMempool && !fHaveChain) {
-        // push to local node and sync with wallets
-        CValidationState state;
-        bool fMissingInputs;
-        bool fLimitFree = true;
-        if (!AcceptToMemoryPool(mempool, state, std::move(tx), fLimitFree, &fMissingInputs, nullptr, false, nMaxRawTxFee)) {
-            if (state.IsInvalid()) {
-                throw JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
+
+    std::vector<size_t> vParentCount(vtx.size(), 0);
+    std::vector<std::vector<size_t>> vChildren(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : vtx[i]->vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i && setParents.insert(it->second).second) {
+                vChildren[it->second].push_back(i);
+                ++vParentCount[i];
+            }
+        }
+    }
+
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    std::set<size_t> setReady;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vParentCount[i] == 0)
+            setReady.insert(i);
+    }
+    while (!setReady.empty()) {
+        size_t i = *setReady.begin();
+        setReady.erase(setReady.begin());
+        vOrder.push_back(i);
+        for (size_t child : vChildren[i]) {
+            if (--vParentCount[child] == 0)
+                setReady.insert(child);
+        }
+    }
+    // Whatever is left spends from itself in a cycle and will be rejected
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vParentCount[i] > 0)
+            vOrder.push_back(i);
+    }
+    return vOrder;
+}
+
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "Transactions are submitted after any transactions in the batch they spend from, whatever\n"
+            "their position in the array. Their scripts are verified in parallel beforehand, and all\n"
+            "accepted transactions are announced to peers together.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                       (array) One result per hex string, in the same order\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",       (string) The transaction hash in hex, omitted if the hex string could not be decoded\n"
+            "    \"accepted\" : true|false, (boolean) If the transaction is in the mempool and was relayed\n"
+            "    \"code\" : n,            (numeric) The error code sendrawtransaction would return, if not accepted,\n"
+            "                           or -8 for a transaction that appeared earlier in the array\n"
+            "    \"error\" : \"message\"    (string) The error message sendrawtransaction would return, if not accepted\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+    const UniValue& hexstrings = request.params[0].get_array();
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (request.params.size() > 1 && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    std::vector<UniValue> vEntries;
+    std::vector<CTransactionRef> vtx;
+    std::vector<size_t> vResultIndex;
+    std::set<uint256> setHashes;
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        CMutableTransaction mtx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str())) {
+            entry.push_back(Pair("accepted", false));
+            entry.push_back(Pair("code", RPC_DESERIALIZATION_ERROR));
+            entry.push_back(Pair("error", "TX decode failed"));
+        } else {
+            CTransactionRef tx = MakeTransactionRef(std::move(mtx));
+            entry.push_back(Pair("txid", tx->GetHash().GetHex()));
+            // Only the first copy is submitted; the rest would spend and
+            // create the same coins again
+            if (!setHashes.insert(tx->GetHash()).second) {
+                entry.push_back(Pair("accepted", false));
+                entry.push_back(Pair("code", RPC_INVALID_PARAMETER));
+                entry.push_back(Pair("error", "Duplicate transaction in batch"));
             } else {
-                if (fMissingInputs) {
-                    throw JSONRPCError(RPC_TRANSACTION_ERROR, "Missing inputs");
-                }
-                throw JSONRPCError(RPC_TRANSACTION_ERROR, state.GetRejectReason());
+                vtx.push_back(std::move(tx));
+                vResultIndex.push_back(i);
             }
         }
-    } else if (fHaveChain) {
-        throw JSONRPCError(RPC_TRANSACTION_ALREADY_IN_CHAIN, "transaction already in block chain");
+        vEntries.push_back(entry);
     }
-    if(!g_connman)
-        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
 
-    CInv inv(MSG_TX, hashTx);
-    g_connman->ForEachNode([&inv](CNode* pnode)
+    std::vector<size_t> vOrder = SortByDependency(vtx);
+    std::vector<CTransactionRef> vSorted;
+    vSorted.reserve(vOrder.size());
+    for (size_t i : vOrder) {
+        vSorted.push_back(vtx[i]);
+    }
+    PreVerifyTransactionScripts(vSorted);
+
+    std::vector<uint256> vAccepted;
     {
-        pnode->PushInventory(inv);
-    });
-    return hashTx.GetHex();
+        LOCK(cs_main);
+        for (size_t i : vOrder) {
+            UniValue& entry = vEntries[vResultIndex[i]];
+            int nErrorCode;
+            std::string strError;
+            if (SubmitRawTransaction(vtx[i], nMaxRawTxFee, nErrorCode, strError)) {
+                vAccepted.push_back(vtx[i]->GetHash());
+                entry.push_back(Pair("accepted", true));
+            } else {
+                entry.push_back(Pair("accepted", false));
+                entry.push_back(Pair("code", nErrorCode));
+                entry.push_back(Pair("error", strError));
+            }
+        }
+    }
+
+    RelayRawTransactions(vAccepted);
+
+    UniValue result(UniValue::VARR);
+    result.push_backV(vEntries);
+    return result;
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  {"txid","verbose"} },
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  {"inputs","outputs","locktime","replaceable"} },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  {"hexstring"} },
-    { "rawtransactions",    "decodescript",           &decodescript,           true,  {"hexstring"} },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, {"hexstring","allowhighfees"} },
-    { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  true,  {"txs"} },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
-
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  {"txids", "blockhash"} },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  {"proof"} },
+{ //  category              name                      actor (function)         okSafe readOnly argNames
+  //  --------------------- ------------------------  -----------------------  ------ -------- ----------
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  true,    {"txid","verbose"} },
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  true,    {"inputs","outputs","locktime","replaceable"} },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  true,    {"hexstring"} },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  true,    {"hexstring"} },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, false,   {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false, false,   {"hexstrings","allowhighfees"} },
+    { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  true,  true,    {"txs"} },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, false,   {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
+
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  true,    {"txids", "blockhash"} },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  true,    {"proof"} },
 };
 
 void RegisterRawTransactionRPCCommands(CRPCTable &t)
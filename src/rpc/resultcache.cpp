@@ -0,0 +1,210 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/resultcache.h"
+
+#include "chain.h"
+#include "rpc/jsonwriter.h"
+#include "rpc/server.h"
+#include "tinyformat.h"
+#include "validation.h"
+
+#include <atomic>
+
+CResultCache::CResultCache(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nBytes(0), nHits(0), nMisses(0)
+{
+}
+
+void CResultCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+void CResultCache::Erase(std::map<std::string, Entry>::iterator it)
+{
+    nBytes -= it->second.data->size();
+    lru.erase(it->second.itLru);
+    mapEntries.erase(it);
+}
+
+void CResultCache::Trim()
+{
+    while (nBytes > nMaxBytes)
+        Erase(mapEntries.find(lru.back()));
+}
+
+void CResultCache::Add(const std::string& key, const uint256& hashBlock, const uint256& hashNext, const std::string& strData, bool fJSON)
+{
+    // Find the confirmations outside the lock. Only JSON is scanned: there no
+    // string value can contain the quoted key, while binary data might.
+    static const std::string strConfirmationsKey = "\"confirmations\":";
+    size_t nConfirmationsPos = fJSON ? strData.find(strConfirmationsKey) : std::string::npos;
+    size_t nConfirmationsSize = 0;
+    if (nConfirmationsPos != std::string::npos) {
+        nConfirmationsPos += strConfirmationsKey.size();
+        size_t nEnd = strData.find_first_not_of("-0123456789", nConfirmationsPos);
+        if (nEnd == std::string::npos)
+            nEnd = strData.size();
+        nConfirmationsSize = nEnd - nConfirmationsPos;
+    }
+
+    LOCK(cs);
+    if (strData.size() > nMaxBytes / 4)
+        return;
+    std::map<std::string, Entry>::iterator it = mapEntries.find(key);
+    if (it != mapEntries.end())
+        Erase(it);
+    lru.push_front(key);
+    Entry& entry = mapEntries[key];
+    entry.data = std::make_shared<const std::string>(strData);
+    entry.hashBlock = hashBlock;
+    entry.hashNext = hashNext;
+    entry.nConfirmationsPos = nConfirmationsPos;
+    entry.nConfirmationsSize = nConfirmationsSize;
+    entry.itLru = lru.begin();
+    nBytes += strData.size();
+    Trim();
+}
+
+bool CResultCache::Get(const std::string& key, Result& result, const std::function<bool(const Result&)>& fValid)
+{
+    LOCK(cs);
+    std::map<std::string, Entry>::iterator it = mapEntries.find(key);
+    if (it == mapEntries.end()) {
+        nMisses++;
+        return false;
+    }
+    if (!fValid(it->second)) {
+        Erase(it);
+        nMisses++;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second.itLru);
+    result = it->second;
+    nHits++;
+    return true;
+}
+
+CResultCache::Stats CResultCache::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEntries = mapEntries.size();
+    stats.nBytes = nBytes;
+    return stats;
+}
+
+size_t CResultCache::GetMaxEntryBytes() const
+{
+    LOCK(cs);
+    return nMaxBytes / 4;
+}
+
+static CResultCache resultCache(DEFAULT_RESULT_CACHE_SIZE << 20);
+static std::atomic<bool> fResultCacheEnabled(true);
+static std::atomic<int> nResultCacheDepth(DEFAULT_RESULT_CACHE_DEPTH);
+
+void SetResultCacheLimits(size_t nMaxBytes, int nDepth)
+{
+    resultCache.SetMaxBytes(nMaxBytes);
+    fResultCacheEnabled = nMaxBytes > 0;
+    nResultCacheDepth = nDepth;
+}
+
+CResultCache::Stats GetResultCacheStats()
+{
+    return resultCache.GetStats();
+}
+
+bool IsResultCacheable(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    return fResultCacheEnabled && chainActive.Contains(pindex) && chainActive.Height() - pindex->nHeight + 1 >= nResultCacheDepth;
+}
+
+void AddCachedResult(const std::string& key, const CBlockIndex* pindex, const std::string& strData, bool fJSON)
+{
+    AssertLockHeld(cs_main);
+    if (!IsResultCacheable(pindex))
+        return;
+    const CBlockIndex* pnext = chainActive.Next(pindex);
+    resultCache.Add(key, pindex->GetBlockHash(), pnext ? pnext->GetBlockHash() : uint256(), strData, fJSON);
+}
+
+bool GetCachedResult(const std::string& key, std::string& strResult)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindex = nullptr;
+    CResultCache::Result result;
+    bool fFound = resultCache.Get(key, result, [&pindex](const CResultCache::Result& result) {
+        // A reorg may have disconnected the block or replaced its successor
+        BlockMap::const_iterator it = mapBlockIndex.find(result.hashBlock);
+        if (it == mapBlockIndex.end() || !chainActive.Contains(it->second))
+            return false;
+        pindex = it->second;
+        const CBlockIndex* pnext = chainActive.Next(pindex);
+        return (pnext ? pnext->GetBlockHash() : uint256()) == result.hashNext;
+    });
+    if (!fFound)
+        return false;
+
+    const std::string& strData = *result.data;
+    if (result.nConfirmationsPos == std::string::npos) {
+        strResult = strData;
+        return true;
+    }
+    const std::string strConfirmations = strprintf("%d", chainActive.Height() - pindex->nHeight + 1);
+    strResult.clear();
+    strResult.reserve(strData.size() + strConfirmations.size());
+    strResult.append(strData, 0, result.nConfirmationsPos);
+    strResult += strConfirmations;
+    strResult.append(strData, result.nConfirmationsPos + result.nConfirmationsSize, std::string::npos);
+    return true;
+}
+
+bool WriteCachedResult(const JSONRPCRequest& request, const std::string& key)
+{
+    std::string strResult;
+    if (!request.stream || !GetCachedResult(key, strResult))
+        return false;
+    request.stream->Encoded(strResult);
+    return true;
+}
+
+void WriteResult(const JSONRPCRequest& request, const std::string& key, const CBlockIndex* pindex, const std::function<void(JSONStreamWriter&)>& render)
+{
+    if (!IsResultCacheable(pindex)) {
+        render(*request.stream);
+        return;
+    }
+    // Copy the output into the cache as it is streamed, giving up once it
+    // is too large to be kept
+    const size_t nMaxEntryBytes = resultCache.GetMaxEntryBytes();
+    std::string strResult;
+    bool fKeep = true;
+    request.stream->SetTee([&strResult, &fKeep, nMaxEntryBytes](const std::string& chunk) {
+        if (!fKeep)
+            return;
+        if (strResult.size() + chunk.size() > nMaxEntryBytes) {
+            fKeep = false;
+            std::string().swap(strResult);
+            return;
+        }
+        strResult += chunk;
+    });
+    try {
+        render(*request.stream);
+    } catch (...) {
+        fKeep = false;
+        request.stream->SetTee(nullptr);
+        throw;
+    }
+    request.stream->SetTee(nullptr);
+    if (fKeep)
+        AddCachedResult(key, pindex, strResult, true);
+}
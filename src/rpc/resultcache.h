@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_RESULTCACHE_H
+#define BITCOIN_RPC_RESULTCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+class CBlockIndex;
+class JSONRPCRequest;
+class JSONStreamWriter;
+
+/** Default size in MiB of the cache of rendered RPC and REST results */
+static const unsigned int DEFAULT_RESULT_CACHE_SIZE = 32;
+/** Default number of confirmations a block needs for results about it to be cached */
+static const int DEFAULT_RESULT_CACHE_DEPTH = 10;
+
+/**
+ * Least-recently-used cache of rendered results about blocks, limited by
+ * their total size. Each result records the block it is about and that
+ * block's successor when it was rendered, so it can be checked to still
+ * hold, and where its "confirmations" number is, so that can be updated
+ * instead of rendering the result again.
+ */
+class CResultCache
+{
+public:
+    struct Result {
+        std::shared_ptr<const std::string> data;
+        uint256 hashBlock;
+        uint256 hashNext;
+        //! Position and length of the confirmations number in data, if any
+        size_t nConfirmationsPos;
+        size_t nConfirmationsSize;
+    };
+
+    struct Stats {
+        uint64_t nHits;
+        uint64_t nMisses;
+        size_t nEntries;
+        size_t nBytes;
+    };
+
+    explicit CResultCache(size_t nMaxBytesIn);
+
+    /** Change the total size of results kept, evicting the oldest as needed. 0 disables the cache. */
+    void SetMaxBytes(size_t nMaxBytesIn);
+
+    /**
+     * Add or replace a result. Results larger than a quarter of the cache are
+     * not kept. Only in JSON results (fJSON) are the confirmations looked for.
+     */
+    void Add(const std::string& key, const uint256& hashBlock, const uint256& hashNext, const std::string& strData, bool fJSON);
+    /**
+     * Look up a result. If fValid returns false for it, it is dropped and
+     * this counts as a miss.
+     */
+    bool Get(const std::string& key, Result& result, const std::function<bool(const Result&)>& fValid);
+
+    Stats GetStats() const;
+    /** Size of the largest result that is kept */
+    size_t GetMaxEntryBytes() const;
+
+private:
+    struct Entry : public Result {
+        std::list<std::string>::iterator itLru;
+    };
+
+    mutable CCriticalSection cs;
+    size_t nMaxBytes;
+    size_t nBytes;
+    std::map<std::string, Entry> mapEntries;
+    //! Most recently used key at the front
+    std::list<std::string> lru;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void Erase(std::map<std::string, Entry>::iterator it);
+    void Trim();
+};
+
+/** Set the size in bytes of the global result cache and the depth blocks need for their results to be cached */
+void SetResultCacheLimits(size_t nMaxBytes, int nDepth);
+CResultCache::Stats GetResultCacheStats();
+
+/** Whether results about pindex may be cached. Requires cs_main. */
+bool IsResultCacheable(const CBlockIndex* pindex);
+/**
+ * Cache a result about pindex, if it is deep enough in the active chain. fJSON
+ * tells whether it is JSON whose confirmations need updating. Requires cs_main.
+ */
+void AddCachedResult(const std::string& key, const CBlockIndex* pindex, const std::string& strData, bool fJSON);
+/**
+ * Get a cached result, if its block is still in the active chain with the
+ * same successor, with its confirmations brought up to date. Requires cs_main.
+ */
+bool GetCachedResult(const std::string& key, std::string& strResult);
+
+/**
+ * If the request takes pre-encoded results and the result under key is
+ * cached, write it to the request's stream. Requires cs_main.
+ */
+bool WriteCachedResult(const JSONRPCRequest& request, const std::string& key);
+/**
+ * Write the result render gives about pindex to the request's stream,
+ * keeping a copy in the cache if pindex is deep enough and the result is
+ * small enough to be kept. Requires cs_main.
+ */
+void WriteResult(const JSONRPCRequest& request, const std::string& key, const CBlockIndex* pindex, const std::function<void(JSONStreamWriter&)>& render);
+
+#endif // BITCOIN_RPC_RESULTCACHE_H
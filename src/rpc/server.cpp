@@ -22,7 +22,12 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
+#include <set>
 #include <unordered_map>
 
 static bool fRPCRunning = false;
@@ -267,12 +272,12 @@ UniValue uptime(const JSONRPCRequest& jsonRequest)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafe argNames
-  //  --------------------- ------------------------  -----------------------  ------ ----------
+{ //  category              name                      actor (function)         okSafe readOnly argNames
+  //  --------------------- ------------------------  -----------------------  ------ -------- ----------
     /* Overall control/query calls */
-    { "control",            "help",                   &help,                   true,  {"command"}  },
-    { "control",            "stop",                   &stop,                   true,  {}  },
-    { "control",            "uptime",                 &uptime,                 true,  {}  },
+    { "control",            "help",                   &help,                   true,  true,    {"command"}  },
+    { "control",            "stop",                   &stop,                   true,  false,   {}  },
+    { "control",            "uptime",                 &uptime,                 true,  true,    {}  },
 };
 
 CRPCTable::CRPCTable()
@@ -411,12 +416,84 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+namespace {
+/**
+ * A batch being executed by several threads. Each one claims the next element
+ * not yet taken until none are left; the last to finish wakes the caller.
+ */
+struct JSONRPCBatch
+{
+    const UniValue& vReq;
+    std::vector<UniValue> vReply;
+    std::atomic<size_t> nNext;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t nDone;
+
+    explicit JSONRPCBatch(const UniValue& vReqIn) : vReq(vReqIn), vReply(vReqIn.size()), nNext(0), nDone(0) {}
+
+    void Run()
+    {
+        size_t nRan = 0;
+        for (size_t i = nNext++; i < vReply.size(); i = nNext++) {
+            vReply[i] = JSONRPCExecOne(vReq[i]);
+            nRan++;
+        }
+        if (nRan > 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            nDone += nRan;
+            if (nDone == vReply.size())
+                cond.notify_all();
+        }
+    }
+};
+}
+
+/**
+ * Any method not marked readOnly could change what later elements of a batch
+ * see, so batches are only run in parallel if made of read-only methods
+ * alone, or of names that are not methods at all.
+ */
+static bool IsReadOnlyBatch(const UniValue& vReq)
+{
+    for (size_t i = 0; i < vReq.size(); i++) {
+        if (!vReq[i].isObject())
+            continue;
+        const UniValue& method = find_value(vReq[i].get_obj(), "method");
+        if (!method.isStr())
+            continue;
+        const CRPCCommand* pcmd = tableRPC[method.get_str()];
+        if (pcmd && !pcmd->readOnly)
+            return false;
+    }
+    return true;
+}
+
+std::string JSONRPCExecBatch(const UniValue& vReq, int nHelpers, const std::function<bool(const std::function<void()>&)>& launch)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    if (nHelpers <= 0 || !launch || vReq.size() < 2 || !IsReadOnlyBatch(vReq)) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+        return ret.write() + "\n";
+    }
 
+    // Helpers only touch vReq for elements they claimed, which we wait for;
+    // one that starts after we returned finds nothing left and just exits.
+    std::shared_ptr<JSONRPCBatch> batch = std::make_shared<JSONRPCBatch>(vReq);
+    nHelpers = std::min<size_t>(nHelpers, vReq.size() - 1);
+    for (int i = 0; i < nHelpers; i++) {
+        if (!launch([batch] { batch->Run(); }))
+            break;
+    }
+    // Work on the batch here too, so it completes even if no helper gets to run
+    batch->Run();
+    {
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->cond.wait(lock, [&batch] { return batch->nDone == batch->vReply.size(); });
+    }
+    for (UniValue& reply : batch->vReply)
+        ret.push_back(std::move(reply));
     return ret.write() + "\n";
 }
 
@@ -10,6 +10,7 @@
 #include "rpc/protocol.h"
 #include "uint256.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -20,6 +21,7 @@
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 
 class CRPCCommand;
+class JSONStreamWriter;
 
 namespace RPCServer
 {
@@ -46,8 +48,13 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /**
+     * If set, a method with a large result may write it here instead of
+     * returning it. It must have checked everything that can fail first.
+     */
+    JSONStreamWriter* stream;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), stream(nullptr) {}
     void parse(const UniValue& valRequest);
 };
 
@@ -135,6 +142,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Only reads state, so it may run alongside other such calls in a batch
+    bool readOnly;
     std::vector<std::string> argNames;
 };
 
@@ -191,7 +200,13 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/**
+ * Execute a JSON-RPC batch and return the reply array. If all its methods only
+ * read state, up to nHelpers more threads may work on its elements alongside
+ * the caller; launch(func) should arrange for func to run on one and return
+ * false if it cannot. Other batches run in order.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, int nHelpers = 0, const std::function<bool(const std::function<void()>&)>& launch = nullptr);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -6,11 +6,31 @@
 
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 
 #include <stdio.h>
 
 #include <boost/thread.hpp>
 
+static thread_local int64_t nTimedLockHeldMicros = 0;
+
+void CCriticalSection::StartHold()
+{
+    if (nHoldDepth++ == 0)
+        nHeldSince = GetTimeMicros();
+}
+
+void CCriticalSection::EndHold()
+{
+    if (--nHoldDepth == 0)
+        nTimedLockHeldMicros += GetTimeMicros() - nHeldSince;
+}
+
+int64_t GetTimedLockHeldMicros()
+{
+    return nTimedLockHeldMicros;
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -8,6 +8,8 @@
 
 #include "threadsafety.h"
 
+#include <stdint.h>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
@@ -91,11 +93,53 @@ void static inline DeleteLock(void* cs) {}
 class CCriticalSection : public AnnotatedMixin<boost::recursive_mutex>
 {
 public:
+    /**
+     * With fTimeHeld, the time each thread holds the lock is added up for
+     * GetTimedLockHeldMicros(). This costs two clock reads per outermost
+     * acquisition, so it is only meant for cs_main.
+     */
+    explicit CCriticalSection(bool fTimeHeldIn = false) : fTimeHeld(fTimeHeldIn), nHoldDepth(0), nHeldSince(0) {}
+
     ~CCriticalSection() {
         DeleteLock((void*)this);
     }
+
+    void lock() EXCLUSIVE_LOCK_FUNCTION()
+    {
+        AnnotatedMixin<boost::recursive_mutex>::lock();
+        if (fTimeHeld)
+            StartHold();
+    }
+
+    void unlock() UNLOCK_FUNCTION()
+    {
+        if (fTimeHeld)
+            EndHold();
+        AnnotatedMixin<boost::recursive_mutex>::unlock();
+    }
+
+    bool try_lock() EXCLUSIVE_TRYLOCK_FUNCTION(true)
+    {
+        if (!AnnotatedMixin<boost::recursive_mutex>::try_lock())
+            return false;
+        if (fTimeHeld)
+            StartHold();
+        return true;
+    }
+
+private:
+    const bool fTimeHeld;
+    //! Recursion depth and time of the outermost acquisition, only touched by the owning thread
+    int nHoldDepth;
+    int64_t nHeldSince;
+
+    void StartHold();
+    void EndHold();
 };
 
+/** Microseconds the calling thread has spent holding critical sections created with fTimeHeld */
+int64_t GetTimedLockHeldMicros();
+
 /** Wrapped boost mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 
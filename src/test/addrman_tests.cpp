@@ -6,9 +6,11 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include "clientversion.h"
 #include "hash.h"
 #include "netbase.h"
 #include "random.h"
+#include "streams.h"
 
 class CAddrManTest : public CAddrMan
 {
@@ -217,6 +219,68 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(ports.size(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_sparse)
+{
+    CAddrManTest addrman;
+
+    // Thousands of empty positions, a handful of occupied ones: every
+    // selection lands on one of them, and all of them get selected
+    std::set<std::string> added;
+    for (int i = 1; i <= 5; i++) {
+        CService addr = ResolveService("250." + boost::to_string(i) + ".1.1", 8333);
+        addrman.Add(CAddress(addr, NODE_NONE), ResolveIP("252." + boost::to_string(i) + ".2.2"));
+        added.insert(addr.ToString());
+    }
+    BOOST_CHECK_EQUAL(addrman.size(), 5);
+
+    std::set<std::string> selected;
+    for (int i = 0; i < 200; i++) {
+        CAddrInfo addr = addrman.Select(true);
+        BOOST_CHECK(added.count(addr.ToString()));
+        selected.insert(addr.ToString());
+    }
+    BOOST_CHECK(selected == added);
+
+    // Moving them to tried empties the new table
+    for (const std::string& strAddr : added)
+        addrman.Good(CAddress(ResolveService(strAddr), NODE_NONE));
+    BOOST_CHECK_EQUAL(addrman.Select(true).ToString(), "[::]:0");
+    selected.clear();
+    for (int i = 0; i < 200; i++)
+        selected.insert(addrman.Select().ToString());
+    BOOST_CHECK(selected == added);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_add_batch)
+{
+    CAddrManTest addrmanOne;
+    CAddrManTest addrmanBatch;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    std::vector<CAddress> vAddr;
+    for (int i = 1; i < 100; i++)
+        vAddr.push_back(CAddress(ResolveService("250.1." + boost::to_string(i % 7) + "." + boost::to_string(i), 8333), NODE_NONE));
+    // Known addresses on another port, and ones that are not routable
+    vAddr.push_back(CAddress(ResolveService("250.1.1.1", 9999), NODE_NONE));
+    vAddr.push_back(CAddress(ResolveService("250.1.2.2", 7777), NODE_NONE));
+    vAddr.push_back(CAddress(ResolveService("10.0.0.1", 8333), NODE_NONE));
+    for (CAddress& addr : vAddr)
+        addr.nTime = 1500000000;
+    vAddr[99].nTime = vAddr[100].nTime = 1500000000 + 3 * 24 * 60 * 60;
+
+    for (const CAddress& addr : vAddr)
+        addrmanOne.Add(addr, source);
+    BOOST_CHECK(addrmanBatch.Add(vAddr, source));
+
+    // Positions worked out before taking the lock are where Add_ would have put them
+    CDataStream ssOne(SER_DISK, CLIENT_VERSION);
+    CDataStream ssBatch(SER_DISK, CLIENT_VERSION);
+    ssOne << addrmanOne;
+    ssBatch << addrmanBatch;
+    BOOST_CHECK_EQUAL(addrmanOne.size(), addrmanBatch.size());
+    BOOST_CHECK(ssOne.str() == ssBatch.str());
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
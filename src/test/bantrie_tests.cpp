@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bantrie.h"
+#include "netbase.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(bantrie_tests, BasicTestingSetup)
+
+static CNetAddr Addr(const std::string& str)
+{
+    CNetAddr addr;
+    LookupHost(str.c_str(), addr, false);
+    return addr;
+}
+
+static CSubNet SubNet(const std::string& str)
+{
+    CSubNet subNet;
+    LookupSubNet(str.c_str(), subNet);
+    BOOST_REQUIRE(subNet.IsValid());
+    return subNet;
+}
+
+static CNetAddr RandomAddr(FastRandomContext& rand, bool fIPv4)
+{
+    if (fIPv4) {
+        struct in_addr ipv4;
+        ipv4.s_addr = rand.rand32();
+        return CNetAddr(ipv4);
+    }
+    struct in6_addr ipv6;
+    // Stay within 2001::/16 so these are not taken for IPv4 or Tor
+    for (int i = 0; i < 16; i++)
+        ipv6.s6_addr[i] = i < 2 ? (i == 0 ? 0x20 : 0x01) : rand.randbits(8);
+    return CNetAddr(ipv6);
+}
+
+BOOST_AUTO_TEST_CASE(bantrie_prefixes)
+{
+    BOOST_CHECK_EQUAL(SubNet("1.2.3.0/24").GetPrefixLength(), 120);
+    BOOST_CHECK_EQUAL(SubNet("1.2.3.4").GetPrefixLength(), 128);
+    BOOST_CHECK_EQUAL(SubNet("2001:470::/33").GetPrefixLength(), 33);
+    BOOST_CHECK_EQUAL(SubNet("1.2.3.4/255.0.255.0").GetPrefixLength(), -1);
+
+    CBanTrie trie;
+    BOOST_CHECK(!trie.Match(Addr("1.2.3.4"), 0));
+    trie.Insert(SubNet("1.2.3.0/24"), 100);
+    trie.Insert(SubNet("1.2.0.0/16"), 50);
+    trie.Insert(SubNet("2001:470::/32"), 100);
+    trie.Insert(SubNet("10.0.0.0/255.0.255.0"), 100);
+
+    BOOST_CHECK(trie.Match(Addr("1.2.3.4"), 60));
+    BOOST_CHECK(trie.Match(Addr("1.2.4.4"), 40));
+    // The /16 expired but the /24 below it did not
+    BOOST_CHECK(!trie.Match(Addr("1.2.4.4"), 60));
+    BOOST_CHECK(!trie.Match(Addr("1.3.3.4"), 0));
+    BOOST_CHECK(trie.Match(Addr("2001:470:1::1"), 0));
+    BOOST_CHECK(!trie.Match(Addr("2001:471::1"), 0));
+    // IPv4 subnets do not cover IPv6 addresses with the same low bits
+    BOOST_CHECK(!trie.Match(Addr("::1.2.3.4"), 0));
+    BOOST_CHECK(trie.Match(Addr("10.5.0.7"), 0));
+    BOOST_CHECK(!trie.Match(Addr("10.5.1.7"), 0));
+    BOOST_CHECK(!trie.Match(CNetAddr(), 0));
+
+    // Banning again replaces the time
+    trie.Insert(SubNet("1.2.3.0/24"), 200);
+    BOOST_CHECK(trie.Match(Addr("1.2.3.4"), 150));
+    trie.Insert(SubNet("10.0.0.0/255.0.255.0"), 200);
+    BOOST_CHECK(trie.Match(Addr("10.5.0.7"), 150));
+
+    // Everything
+    trie.Insert(SubNet("0.0.0.0/0"), 300);
+    BOOST_CHECK(trie.Match(Addr("8.8.8.8"), 250));
+    BOOST_CHECK(!trie.Match(Addr("2001:471::1"), 250));
+
+    trie.Clear();
+    BOOST_CHECK(!trie.Match(Addr("1.2.3.4"), 0));
+    BOOST_CHECK_EQUAL(trie.GetNodeCount(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(bantrie_matches_linear_scan)
+{
+    FastRandomContext rand(true);
+    banmap_t banMap;
+    std::vector<CNetAddr> vProbes;
+    for (int i = 0; i < 2000; i++) {
+        const bool fIPv4 = rand.randbool();
+        const CNetAddr addr = RandomAddr(rand, fIPv4);
+        const int nMaxBits = fIPv4 ? 32 : 128;
+        // Mostly single addresses, as with misbehaving peers
+        const int nBits = rand.randrange(4) ? nMaxBits : 8 + rand.randrange(nMaxBits - 7);
+        CBanEntry banEntry(0);
+        banEntry.nBanUntil = 1 + rand.randrange(100);
+        banMap[CSubNet(addr, nBits)] = banEntry;
+        vProbes.push_back(addr);
+        vProbes.push_back(RandomAddr(rand, fIPv4));
+    }
+
+    CBanTrie trie;
+    trie.Reset(banMap);
+    // Path compression keeps the trie within twice the number of subnets
+    BOOST_CHECK(trie.GetNodeCount() <= 2 * banMap.size() + 1);
+    for (const CNetAddr& addr : vProbes) {
+        for (int64_t nNow : {0, 50, 100}) {
+            bool fBanned = false;
+            for (const std::pair<const CSubNet, CBanEntry>& item : banMap)
+                fBanned |= item.first.Match(addr) && nNow < item.second.nBanUntil;
+            BOOST_CHECK_EQUAL(trie.Match(addr, nNow), fBanned);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,201 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "blockencodings.h"
+#include "chain.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+// Compact encodings use a random nonce, so compare what they describe
+static void CheckEncoding(const std::vector<unsigned char>& data, const CBlock& block, CBlockCache::Format format)
+{
+    if (format == CBlockCache::BLOCK_WITNESS || format == CBlockCache::BLOCK_NO_WITNESS) {
+        BOOST_CHECK(data == *CBlockCache::Serialize(block, format));
+        return;
+    }
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> cmpctblock;
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+}
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(32, 0x42));
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nNonce = nNonce;
+    pblock->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_formats)
+{
+    CBlockCache cache(4);
+    std::shared_ptr<const CBlock> pblock = MakeBlock(1);
+    const uint256 hash = pblock->GetHash();
+
+    BOOST_CHECK(!cache.Get(hash, CBlockCache::BLOCK_WITNESS));
+    cache.Add(pblock);
+    for (int format = 0; format < CBlockCache::FORMAT_COUNT; format++) {
+        CBlockCache::DataRef data = cache.Get(hash, (CBlockCache::Format)format);
+        BOOST_REQUIRE(data);
+        CheckEncoding(*data, *pblock, (CBlockCache::Format)format);
+        // The second request is served from the same serialization
+        BOOST_CHECK(cache.Get(hash, (CBlockCache::Format)format) == data);
+    }
+    BOOST_CHECK(*cache.Get(hash, CBlockCache::BLOCK_WITNESS) != *cache.Get(hash, CBlockCache::BLOCK_NO_WITNESS));
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 2U * CBlockCache::FORMAT_COUNT + 2);
+    BOOST_CHECK_EQUAL(stats.nBlocks, 1U);
+    BOOST_CHECK(stats.nBytes > 0);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_from_bytes)
+{
+    // A block only known by its witness serialization, as read from disk
+    CBlockCache cache(4);
+    std::shared_ptr<const CBlock> pblock = MakeBlock(2);
+    const uint256 hash = pblock->GetHash();
+    cache.Add(hash, CBlockCache::BLOCK_WITNESS, CBlockCache::Serialize(*pblock, CBlockCache::BLOCK_WITNESS));
+
+    std::shared_ptr<const CBlock> pcached = cache.GetBlock(hash);
+    BOOST_REQUIRE(pcached);
+    BOOST_CHECK(pcached->GetHash() == hash);
+    BOOST_CHECK(pcached->vtx[0]->GetWitnessHash() == pblock->vtx[0]->GetWitnessHash());
+
+    CBlockCache::DataRef data = cache.Get(hash, CBlockCache::CMPCT_NO_WITNESS);
+    BOOST_REQUIRE(data);
+    CheckEncoding(*data, *pblock, CBlockCache::CMPCT_NO_WITNESS);
+
+    // Without the block or its witness serialization nothing can be built
+    CBlockCache::DataRef noWitness = CBlockCache::Serialize(*MakeBlock(3), CBlockCache::BLOCK_NO_WITNESS);
+    cache.Add(MakeBlock(3)->GetHash(), CBlockCache::BLOCK_NO_WITNESS, noWitness);
+    BOOST_CHECK(cache.Get(MakeBlock(3)->GetHash(), CBlockCache::BLOCK_NO_WITNESS) == noWitness);
+    BOOST_CHECK(!cache.Get(MakeBlock(3)->GetHash(), CBlockCache::BLOCK_WITNESS));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_eviction)
+{
+    CBlockCache cache(2);
+    std::shared_ptr<const CBlock> pblock1 = MakeBlock(1);
+    std::shared_ptr<const CBlock> pblock2 = MakeBlock(2);
+    std::shared_ptr<const CBlock> pblock3 = MakeBlock(3);
+
+    cache.Add(pblock1);
+    cache.Add(pblock2);
+    // Using block 1 makes block 2 the least recently used
+    BOOST_CHECK(cache.Get(pblock1->GetHash(), CBlockCache::BLOCK_WITNESS));
+    cache.Add(pblock3);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 2U);
+    BOOST_CHECK(cache.GetBlock(pblock1->GetHash()));
+    BOOST_CHECK(!cache.GetBlock(pblock2->GetHash()));
+    BOOST_CHECK(cache.GetBlock(pblock3->GetHash()));
+
+    cache.SetMaxBlocks(1);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 1U);
+    BOOST_CHECK(cache.GetBlock(pblock3->GetHash()));
+
+    cache.SetMaxBlocks(0);
+    cache.Add(pblock1);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 0U);
+    BOOST_CHECK(!cache.GetBlock(pblock1->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_byte_limit)
+{
+    std::shared_ptr<const CBlock> pblock1 = MakeBlock(1);
+    std::shared_ptr<const CBlock> pblock2 = MakeBlock(2);
+    CBlockCache cache(16, 0);
+    cache.Add(pblock1);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 0U);
+
+    // Room for one block with its encodings but not two, whatever the block limit
+    cache.SetMaxBytes(1 << 20);
+    cache.Add(pblock1);
+    BOOST_CHECK(cache.Get(pblock1->GetHash(), CBlockCache::BLOCK_WITNESS));
+    BOOST_CHECK(cache.Get(pblock1->GetHash(), CBlockCache::CMPCT_WITNESS));
+    const size_t nOneBlock = cache.GetStats().nBytes;
+    BOOST_CHECK(nOneBlock > 0);
+    cache.SetMaxBytes(nOneBlock * 3 / 2);
+    cache.Add(pblock2);
+    BOOST_CHECK(cache.Get(pblock2->GetHash(), CBlockCache::BLOCK_WITNESS));
+    BOOST_CHECK(cache.Get(pblock2->GetHash(), CBlockCache::CMPCT_WITNESS));
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 1U);
+    BOOST_CHECK(!cache.GetBlock(pblock1->GetHash()));
+    BOOST_CHECK(cache.GetBlock(pblock2->GetHash()));
+    BOOST_CHECK(cache.GetStats().nBytes <= nOneBlock * 3 / 2);
+
+    cache.SetMaxBlocks(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 0U);
+}
+
+// A chain of block indexes branching off base, with made-up headers
+static void ExtendChain(std::vector<std::unique_ptr<CBlockIndex>>& vIndex, std::vector<std::unique_ptr<uint256>>& vHashes, const CBlockIndex* base, int nBlocks, uint32_t nTime)
+{
+    const CBlockIndex* pprev = base;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockHeader header;
+        header.hashPrevBlock = pprev ? pprev->GetBlockHash() : uint256();
+        header.nTime = nTime + i;
+        header.nBits = 0x207fffff;
+        vHashes.emplace_back(new uint256(header.GetHash()));
+        vIndex.emplace_back(new CBlockIndex(header));
+        vIndex.back()->phashBlock = vHashes.back().get();
+        vIndex.back()->pprev = const_cast<CBlockIndex*>(pprev);
+        vIndex.back()->nHeight = pprev ? pprev->nHeight + 1 : 0;
+        pprev = vIndex.back().get();
+    }
+}
+
+static std::vector<unsigned char> SerializeHeaders(const CChain& chain, int nFirst, int nLast)
+{
+    std::vector<CBlock> vHeaders;
+    for (int nHeight = nFirst; nHeight <= nLast; nHeight++)
+        vHeaders.push_back(chain[nHeight]->GetBlockHeader());
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0, vHeaders);
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(headerscache_ranges)
+{
+    std::vector<std::unique_ptr<CBlockIndex>> vIndex;
+    std::vector<std::unique_ptr<uint256>> vHashes;
+    ExtendChain(vIndex, vHashes, nullptr, 2 * CHeadersCache::CHUNK_SIZE + 500, 1);
+    CChain chain;
+    chain.SetTip(vIndex.back().get());
+
+    CHeadersCache cache(4);
+    // Within a chunk, across chunk boundaries, into the uncached tip and repeated
+    const int ranges[][2] = {{0, 0}, {10, 1999}, {1500, 3499}, {3999, 4499}, {4200, 4499}, {1500, 3499}};
+    for (const auto& range : ranges) {
+        std::vector<unsigned char> data = CHeadersCache::MakeHeadersMessage(cache.GetHeaders(chain, range[0], range[1]));
+        BOOST_CHECK(data == SerializeHeaders(chain, range[0], range[1]));
+    }
+    BOOST_CHECK(CHeadersCache::MakeHeadersMessage(std::vector<CHeadersCache::Range>()) == std::vector<unsigned char>(1, 0));
+
+    // After a reorg the chunks above the fork are rebuilt
+    ExtendChain(vIndex, vHashes, chain[CHeadersCache::CHUNK_SIZE + 100], 2 * CHeadersCache::CHUNK_SIZE, 2);
+    chain.SetTip(vIndex.back().get());
+    std::vector<unsigned char> data = CHeadersCache::MakeHeadersMessage(cache.GetHeaders(chain, 1500, 3499));
+    BOOST_CHECK(data == SerializeHeaders(chain, 1500, 3499));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
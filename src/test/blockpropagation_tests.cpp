@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockpropagation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockpropagation_tests, BasicTestingSetup)
+
+static uint256 Hash(int n)
+{
+    uint256 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(blockpropagation_events)
+{
+    CBlockPropagationLog log(10);
+
+    // Nothing is recorded for blocks that were never announced
+    log.Received(Hash(1), 3, "block", 100);
+    log.Relayed(Hash(1), 3, 100);
+    BOOST_CHECK(log.GetBlocks().empty());
+
+    log.Announced(Hash(1), -1, 3, "inv", 1000);
+    log.Announced(Hash(1), 50, 4, "headers", 1100);
+    log.CompactReceived(Hash(1), 4, 100, 1, 95, 2, 2, 1200);
+    log.CompactReceived(Hash(1), 5, 100, 1, 97, 2, 0, 1250);
+    log.Received(Hash(1), 4, "blocktxn", 1300);
+    log.Received(Hash(1), 5, "block", 1350);
+    log.Processed(Hash(1), 1400);
+    log.Relayed(Hash(1), 6, 1500);
+    log.Relayed(Hash(1), 7, 1510);
+    log.Relayed(Hash(1), 6, 1520);
+
+    std::vector<CBlockPropagation> vBlocks = log.GetBlocks();
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 1U);
+    const CBlockPropagation& block = vBlocks[0];
+    // The first announcement is kept, but a later one can tell the height
+    BOOST_CHECK_EQUAL(block.nHeight, 50);
+    BOOST_CHECK_EQUAL(block.nAnnounceTime, 1000);
+    BOOST_CHECK_EQUAL(block.nAnnouncePeer, 3);
+    BOOST_CHECK_EQUAL(block.strAnnounceVia, "inv");
+    BOOST_CHECK_EQUAL(block.nCompactPeer, 4);
+    BOOST_CHECK_EQUAL(block.nMempoolTxs, 95);
+    BOOST_CHECK_EQUAL(block.nMissingTxs, 2);
+    BOOST_CHECK_EQUAL(block.nReceivedTime, 1300);
+    BOOST_CHECK_EQUAL(block.strReceivedVia, "blocktxn");
+    BOOST_CHECK_EQUAL(block.nProcessedTime, 1400);
+    BOOST_REQUIRE_EQUAL(block.vRelays.size(), 2U);
+    BOOST_CHECK(block.vRelays[0] == std::make_pair(NodeId(6), int64_t(1500)));
+    BOOST_CHECK(block.vRelays[1] == std::make_pair(NodeId(7), int64_t(1510)));
+}
+
+BOOST_AUTO_TEST_CASE(blockpropagation_ring)
+{
+    CBlockPropagationLog log(10);
+    for (int i = 0; i < 25; i++)
+        log.Announced(Hash(i), i, 1, "headers", i);
+
+    // Only the newest blocks are kept, oldest first
+    std::vector<CBlockPropagation> vBlocks = log.GetBlocks();
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 10U);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK(vBlocks[i].hash == Hash(15 + i));
+
+    log.Processed(Hash(5), 100);
+    log.Processed(Hash(20), 100);
+    vBlocks = log.GetBlocks();
+    BOOST_CHECK_EQUAL(vBlocks[5].nProcessedTime, 100);
+
+    CBlockPropagationLog logOff(0);
+    logOff.Announced(Hash(1), 1, 1, "headers", 1);
+    BOOST_CHECK(logOff.GetBlocks().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
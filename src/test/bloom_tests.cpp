@@ -6,6 +6,7 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "consensus/merkle.h"
 #include "key.h"
 #include "merkleblock.h"
 #include "random.h"
@@ -16,6 +17,7 @@
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 
+#include <limits>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -540,4 +542,71 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bloom_elements_shared)
+{
+    // A chain of transactions paying to P2PK and P2PKH scripts
+    CBlock block;
+    std::vector<std::vector<unsigned char> > vKeys;
+    for (int i = 0; i < 50; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + i % 3);
+        for (CTxIn& txin : tx.vin) {
+            txin.prevout = COutPoint(i % 2 && i > 0 ? block.vtx.back()->GetHash() : InsecureRand256(), 0);
+            txin.scriptSig = CScript() << RandomData() << RandomData();
+        }
+        tx.vout.resize(2);
+        std::vector<unsigned char> vchPubKey = RandomData();
+        vchPubKey.insert(vchPubKey.begin(), 0x02);
+        tx.vout[0].scriptPubKey = CScript() << vchPubKey << OP_CHECKSIG;
+        vKeys.push_back(vchPubKey);
+        std::vector<unsigned char> vchKeyId = RandomData();
+        vchKeyId.resize(20);
+        tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchKeyId << OP_EQUALVERIFY << OP_CHECKSIG;
+        vKeys.push_back(vchKeyId);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    // Hashing shared between filters gives the same merkle blocks and filter updates
+    std::vector<uint256> vTxid;
+    for (const CTransactionRef& tx : block.vtx)
+        vTxid.push_back(tx->GetHash());
+    const std::vector<std::vector<uint256> > vTreeLevels = CPartialMerkleTree::CalcTreeLevels(vTxid);
+    BOOST_CHECK(vTreeLevels.back() == std::vector<uint256>(1, BlockMerkleRoot(block)));
+    CBloomElementsCache cache(10, std::numeric_limits<size_t>::max());
+    for (unsigned char nFlags : {BLOOM_UPDATE_NONE, BLOOM_UPDATE_ALL, BLOOM_UPDATE_P2PUBKEY_ONLY}) {
+        for (int i = 0; i < 20; i++) {
+            CBloomFilter filter(10, 0.001, InsecureRand32(), nFlags);
+            filter.insert(vKeys[InsecureRandRange(vKeys.size())]);
+            filter.insert(vKeys[InsecureRandRange(vKeys.size())]);
+            if (i == 0)
+                filter.insert(block.vtx[InsecureRandRange(block.vtx.size())]->GetHash());
+            CBloomFilter filterShared(filter);
+
+            CMerkleBlock merkleBlock(block, filter);
+            CMerkleBlock merkleBlockShared(block, filterShared, &cache, &vTreeLevels);
+            BOOST_CHECK(!merkleBlock.vMatchedTxn.empty());
+            BOOST_CHECK(merkleBlock.vMatchedTxn == merkleBlockShared.vMatchedTxn);
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION), ssShared(SER_NETWORK, PROTOCOL_VERSION);
+            ss << merkleBlock << filter;
+            ssShared << merkleBlockShared << filterShared;
+            BOOST_CHECK(ss.str() == ssShared.str());
+        }
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 10U);
+
+    // The memory limit evicts before the transaction limit is reached, and
+    // elements too large for it are not kept at all
+    CBloomElementsCache cacheSmall(block.vtx.size(), cache.DynamicMemoryUsage());
+    for (const CTransactionRef& tx : block.vtx) {
+        cacheSmall.Get(*tx);
+        BOOST_CHECK(cacheSmall.DynamicMemoryUsage() <= cache.DynamicMemoryUsage());
+    }
+    BOOST_CHECK(cacheSmall.size() > 0 && cacheSmall.size() < block.vtx.size());
+    CBloomElementsCache cacheNone(block.vtx.size(), 0);
+    for (const CTransactionRef& tx : block.vtx)
+        cacheNone.Get(*tx);
+    BOOST_CHECK_EQUAL(cacheNone.size(), 0U);
+    BOOST_CHECK_EQUAL(cacheNone.DynamicMemoryUsage(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -43,6 +43,18 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
     T(0xb4698def, 0x00000000, "001122334455667788");
 
 #undef T
+
+    // Premixed hashing agrees for every tail length
+    for (size_t nSize = 0; nSize < 40; nSize++) {
+        std::vector<unsigned char> data(nSize);
+        for (size_t i = 0; i < nSize; i++)
+            data[i] = InsecureRandBits(8);
+        std::vector<uint32_t> vMixes;
+        MurmurHash3Premix(data.data(), data.size(), vMixes);
+        BOOST_CHECK_EQUAL(vMixes.size(), (nSize + 3) / 4);
+        const unsigned int nSeed = InsecureRand32();
+        BOOST_CHECK_EQUAL(MurmurHash3Premixed(nSeed, vMixes.data(), nSize), MurmurHash3(nSeed, data));
+    }
 }
 
 /*
@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <thread>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(jsonwriter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsonwriter_matches_univalue)
+{
+    UniValue inner(UniValue::VARR);
+    inner.push_back(1);
+    inner.push_back("two\n\"2\"");
+    inner.push_back(UniValue(UniValue::VOBJ));
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("a", inner));
+    expected.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    expected.push_back(Pair("key \"quoted\"", true));
+    expected.push_back(Pair("null", NullUniValue));
+
+    std::string strOut;
+    size_t nChunks = 0;
+    JSONStreamWriter writer([&](const std::string& chunk) { strOut += chunk; nChunks++; }, 8);
+    BOOST_CHECK(!writer.IsUsed());
+    writer.BeginObject();
+    writer.Key("a");
+    writer.BeginArray();
+    writer.Value(1);
+    writer.Value("two\n\"2\"");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Key("key \"quoted\"");
+    writer.Encoded("true");
+    writer.Key("null");
+    writer.Value(NullUniValue);
+    writer.EndObject();
+    BOOST_CHECK(writer.IsUsed());
+    BOOST_CHECK(writer.HasFlushed());
+    writer.Flush();
+    BOOST_CHECK(writer.GetBuffer().empty());
+
+    BOOST_CHECK_EQUAL(strOut, expected.write());
+    // Output was passed on as it passed the flush size, not all at the end
+    BOOST_CHECK(nChunks > 3);
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_tee)
+{
+    UniValue inner(UniValue::VARR);
+    for (int i = 0; i < 10; i++)
+        inner.push_back(i);
+
+    std::string strOut;
+    std::string strTee;
+    JSONStreamWriter writer([&](const std::string& chunk) { strOut += chunk; }, 8);
+    writer.BeginObject();
+    writer.Key("before");
+    writer.Value("not teed");
+    writer.Key("result");
+    writer.SetTee([&](const std::string& chunk) { strTee += chunk; });
+    writer.Value(inner);
+    writer.SetTee(nullptr);
+    writer.Key("after");
+    writer.Value(false);
+    writer.EndObject();
+    writer.Flush();
+
+    // The tee sees exactly the value written while it was set
+    BOOST_CHECK_EQUAL(strTee, inner.write());
+    BOOST_CHECK_EQUAL(strOut, "{\"before\":\"not teed\",\"result\":" + inner.write() + ",\"after\":false}");
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_encoded_array)
+{
+    auto encode = [](size_t i) { return UniValue((int64_t)i * 3).write(); };
+    UniValue expected(UniValue::VARR);
+    for (int i = 0; i < 1000; i++)
+        expected.push_back(i * 3);
+
+    // Parallel encoding keeps the items in order
+    for (int nHelpers : {0, 1, 3}) {
+        std::vector<std::thread> threads;
+        std::string strOut;
+        JSONStreamWriter writer([&](const std::string& chunk) { strOut += chunk; });
+        writer.EncodedArray(1000, encode, nHelpers, [&threads](const std::function<void()>& func) {
+            threads.emplace_back(func);
+            return true;
+        });
+        writer.Flush();
+        for (std::thread& thread : threads)
+            thread.join();
+        BOOST_CHECK_EQUAL(strOut, expected.write());
+    }
+
+    // The caller does all the work if helpers cannot be started, or only
+    // start after it is done, when they find nothing left
+    std::vector<std::function<void()>> vLate;
+    for (bool fLaunch : {false, true}) {
+        std::string strOut;
+        JSONStreamWriter writer([&](const std::string& chunk) { strOut += chunk; });
+        writer.EncodedArray(1000, encode, 3, [&](const std::function<void()>& func) {
+            if (fLaunch)
+                vLate.push_back(func);
+            return fLaunch;
+        });
+        writer.Flush();
+        BOOST_CHECK_EQUAL(strOut, expected.write());
+    }
+    BOOST_CHECK(!vLate.empty());
+    for (const std::function<void()>& func : vLate)
+        func();
+
+    std::string strOut;
+    JSONStreamWriter writer([&](const std::string& chunk) { strOut += chunk; });
+    writer.EncodedArray(0, encode, 3, [](const std::function<void()>&) { return false; });
+    writer.Flush();
+    BOOST_CHECK_EQUAL(strOut, "[]");
+
+    // Errors while encoding reach the caller
+    std::vector<std::thread> threads;
+    JSONStreamWriter writerError([](const std::string&) {});
+    BOOST_CHECK_THROW(writerError.EncodedArray(1000, [](size_t i) -> std::string {
+        if (i == 500)
+            throw std::runtime_error("encode");
+        return "0";
+    }, 3, [&threads](const std::function<void()>& func) {
+        threads.emplace_back(func);
+        return true;
+    }), std::runtime_error);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "knowninventory.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(knowninventory_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(knowninventory_per_peer)
+{
+    CKnownInventoryTable table(1000);
+    BOOST_CHECK_EQUAL(table.GetSlotCount(), 1024U);
+    CKnownInventory peer1(table), peer2(table);
+
+    FastRandomContext rand(true);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 600; i++)
+        vHashes.push_back(rand.rand256());
+
+    for (int i = 0; i < 600; i++) {
+        if (i % 2 == 0)
+            peer1.insert(vHashes[i]);
+        if (i % 3 == 0)
+            peer2.insert(vHashes[i]);
+    }
+    for (int i = 0; i < 600; i++) {
+        BOOST_CHECK_EQUAL(peer1.contains(vHashes[i]), i % 2 == 0);
+        BOOST_CHECK_EQUAL(peer2.contains(vHashes[i]), i % 3 == 0);
+    }
+
+    peer1.reset();
+    for (const uint256& hash : vHashes)
+        BOOST_CHECK(!peer1.contains(hash));
+    BOOST_CHECK(peer2.contains(vHashes[0]));
+
+    // A peer created later knows nothing, whatever the table holds
+    CKnownInventory peer3(table);
+    for (const uint256& hash : vHashes)
+        BOOST_CHECK(!peer3.contains(hash));
+}
+
+BOOST_AUTO_TEST_CASE(knowninventory_recycles_slots)
+{
+    CKnownInventoryTable table(256);
+    CKnownInventory peer(table), other(table);
+
+    FastRandomContext rand(true);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 600; i++) {
+        vHashes.push_back(rand.rand256());
+        // Every peer adds to the ring, not only the one that knows the hash
+        if (i % 4 == 0)
+            peer.insert(vHashes.back());
+        else
+            other.insert(vHashes.back());
+
+        // A hash is forgotten once the ring comes back to its chunk
+        for (int j = 0; j <= i; j++) {
+            const bool fRemembered = i / 64 - j / 64 < 4;
+            BOOST_CHECK_EQUAL(peer.contains(vHashes[j]), fRemembered && j % 4 == 0);
+            BOOST_CHECK_EQUAL(other.contains(vHashes[j]), fRemembered && j % 4 != 0);
+        }
+    }
+
+    // Inserting a hash again does not move it
+    CKnownInventoryTable::Slot slot1, slot2;
+    BOOST_CHECK(table.Find(vHashes.back(), slot1));
+    peer.insert(vHashes.back());
+    BOOST_CHECK(table.Find(vHashes.back(), slot2));
+    BOOST_CHECK_EQUAL(slot1.nIndex, slot2.nIndex);
+    BOOST_CHECK_EQUAL(slot1.nEpoch, slot2.nEpoch);
+    BOOST_CHECK(peer.contains(vHashes.back()));
+}
+
+BOOST_AUTO_TEST_CASE(knowninventory_from_peer)
+{
+    CKnownInventoryTable table(256);
+    CKnownInventory peer(table), flooder(table);
+
+    FastRandomContext rand(true);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 100; i++) {
+        vHashes.push_back(rand.rand256());
+        peer.insert(vHashes.back());
+    }
+
+    // What a peer announces takes no slots, so it can not evict other peers' entries
+    std::vector<uint256> vFlood;
+    for (int i = 0; i < 10000; i++) {
+        vFlood.push_back(rand.rand256());
+        flooder.insertFromPeer(vFlood.back());
+    }
+    CKnownInventoryTable::Slot slot;
+    BOOST_CHECK(!table.Find(vFlood.back(), slot));
+    for (const uint256& hash : vHashes) {
+        BOOST_CHECK(peer.contains(hash));
+        BOOST_CHECK(!flooder.contains(hash));
+    }
+    // Only its own older announcements are forgotten
+    BOOST_CHECK(flooder.contains(vFlood.back()));
+    BOOST_CHECK(!flooder.contains(vFlood.front()));
+
+    // Hashes that have a slot are marked in the table
+    flooder.insertFromPeer(vHashes[0]);
+    BOOST_CHECK(flooder.contains(vHashes[0]));
+    flooder.reset();
+    BOOST_CHECK(!flooder.contains(vHashes[0]));
+    BOOST_CHECK(!flooder.contains(vFlood.back()));
+}
+
+BOOST_AUTO_TEST_CASE(knowninventory_memory)
+{
+    // A bit and a fraction per slot of the table plus a small filter, where
+    // the rolling bloom filter this replaces took over half a megabyte per peer
+    CKnownInventoryTable table(1 << 17);
+    CKnownInventory peer(table);
+    BOOST_CHECK(peer.DynamicMemoryUsage() < 48 * 1024);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
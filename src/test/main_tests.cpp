@@ -58,6 +58,31 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, 8399999990760000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(read_raw_block)
+{
+    const CChainParams& chainparams = Params();
+    const CBlock& genesis = chainparams.GenesisBlock();
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(genesis.GetHash());
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        pindex = mi->second;
+        BOOST_REQUIRE(pindex->nStatus & BLOCK_HAVE_DATA);
+    }
+
+    // The raw bytes match what a peer would get from serializing the block
+    std::vector<unsigned char> raw;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, chainparams.MessageStart()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << genesis;
+    BOOST_CHECK(raw == std::vector<unsigned char>(ss.begin(), ss.end()));
+
+    // A mismatching network magic is rejected
+    CMessageHeader::MessageStartChars wrongStart = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, pindex, wrongStart));
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
@@ -581,4 +581,207 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+
+    CTxMemPoolSnapshotRef empty = pool.GetSnapshot();
+    BOOST_CHECK(empty->vEntries.empty());
+    // Unchanged mempool: the same snapshot is handed out again
+    BOOST_CHECK(pool.GetSnapshot() == empty);
+
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(10000LL).FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(20000LL).FromTx(txChild));
+
+    CTxMemPoolSnapshotRef snapshot = pool.GetSnapshot();
+    BOOST_CHECK(snapshot != empty);
+    BOOST_CHECK(empty->vEntries.empty());
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2);
+    for (const CTxMemPoolSnapshot::Entry& e : snapshot->vEntries) {
+        if (e.entry.GetTx().GetHash() == txChild.GetHash()) {
+            BOOST_CHECK_EQUAL(e.vParents.size(), 1);
+            BOOST_CHECK(e.vParents[0] == txParent.GetHash());
+            BOOST_CHECK_EQUAL(e.entry.GetCountWithAncestors(), 2);
+        } else {
+            BOOST_CHECK(e.vParents.empty());
+            BOOST_CHECK_EQUAL(e.entry.GetCountWithDescendants(), 2);
+        }
+    }
+
+    // Prioritisation changes entry state and invalidates the snapshot
+    pool.PrioritiseTransaction(txChild.GetHash(), 5000LL);
+    CTxMemPoolSnapshotRef prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+
+    // Older snapshots stay intact after removal
+    pool.removeRecursive(txParent);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2);
+    BOOST_CHECK(pool.GetSnapshot()->vEntries.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorCacheTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+
+    // A chain longer than the cache bound, each spending the previous tx
+    const size_t nChain = MAX_CACHED_ANCESTORS + 5;
+    std::vector<CTransactionRef> chain;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    for (size_t i = 0; i < nChain; i++) {
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 1000 * COIN - i * COIN;
+        chain.push_back(MakeTransactionRef(tx));
+        pool.addUnchecked(chain.back()->GetHash(), entry.Fee(1000LL).FromTx(tx));
+        tx.vin[0].prevout = COutPoint(chain.back()->GetHash(), 0);
+    }
+    // The cache is accounted apart from the usage -maxmempool limits
+    BOOST_CHECK(pool.AncestorCacheUsage() > 0);
+
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    for (size_t i = 0; i < nChain; i++) {
+        CTxMemPool::txiter it = pool.mapTx.find(chain[i]->GetHash());
+        CTxMemPool::setEntries setAncestors;
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+        BOOST_CHECK_EQUAL(setAncestors.size(), i);
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), i + 1);
+    }
+
+    // Limits are still enforced when ancestors come from the cache
+    CTxMemPool::setEntries setLimited;
+    CTxMemPool::txiter tail = pool.mapTx.find(chain[10]->GetHash());
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*tail, setLimited, 10, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*tail, setLimited, 11, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+
+    // Confirming the front of the chain shrinks every remaining ancestor set
+    std::vector<CTransactionRef> block(chain.begin(), chain.begin() + 3);
+    pool.removeForBlock(block, 1);
+    BOOST_CHECK_EQUAL(pool.size(), nChain - 3);
+    for (size_t i = 3; i < nChain; i++) {
+        CTxMemPool::txiter it = pool.mapTx.find(chain[i]->GetHash());
+        CTxMemPool::setEntries setAncestors;
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+        BOOST_CHECK_EQUAL(setAncestors.size(), i - 3);
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), i - 2);
+        for (CTxMemPool::txiter ancestorIt : setAncestors) {
+            BOOST_CHECK(pool.exists(ancestorIt->GetTx().GetHash()));
+        }
+    }
+
+    pool.removeRecursive(*chain[3]);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.AncestorCacheUsage(), 0U);
+
+    // With a byte limit too small for the whole chain, later sets are left
+    // uncached and still come out right by walking the links
+    CTxMemPool poolLimited;
+    const size_t nMaxUsage = 4096;
+    poolLimited.SetMaxAncestorCacheUsage(nMaxUsage);
+    for (size_t i = 0; i < nChain; i++) {
+        poolLimited.addUnchecked(chain[i]->GetHash(), entry.Fee(1000LL).FromTx(*chain[i]));
+        BOOST_CHECK(poolLimited.AncestorCacheUsage() <= nMaxUsage);
+    }
+    BOOST_CHECK(poolLimited.AncestorCacheUsage() > 0);
+    for (size_t i = 0; i < nChain; i++) {
+        CTxMemPool::txiter it = poolLimited.mapTx.find(chain[i]->GetHash());
+        CTxMemPool::setEntries setAncestors;
+        BOOST_CHECK(poolLimited.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+        BOOST_CHECK_EQUAL(setAncestors.size(), i);
+    }
+    poolLimited.removeRecursive(*chain[0]);
+    BOOST_CHECK_EQUAL(poolLimited.AncestorCacheUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolChangeLogTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+
+    std::vector<CMutableTransaction> txs(4);
+    for (size_t i = 0; i < txs.size(); i++) {
+        txs[i].vin.resize(1);
+        txs[i].vin[0].scriptSig = CScript() << OP_11;
+        txs[i].vout.resize(1);
+        txs[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txs[i].vout[0].nValue = (i + 1) * COIN;
+    }
+
+    std::vector<uint256> vAdded, vRemoved;
+    BOOST_CHECK_EQUAL(pool.changeLog.GetSequence(), 0);
+    BOOST_CHECK(pool.changeLog.GetChangesSince(0, vAdded, vRemoved));
+    BOOST_CHECK(vAdded.empty() && vRemoved.empty());
+
+    pool.addUnchecked(txs[0].GetHash(), entry.FromTx(txs[0]));
+    pool.addUnchecked(txs[1].GetHash(), entry.FromTx(txs[1]));
+    uint64_t nSequence = pool.changeLog.GetSequence();
+    BOOST_CHECK_EQUAL(nSequence, 2);
+
+    // Added and removed again within the window: not reported at all
+    pool.addUnchecked(txs[2].GetHash(), entry.FromTx(txs[2]));
+    pool.removeRecursive(txs[2]);
+    pool.removeRecursive(txs[0]);
+    pool.addUnchecked(txs[3].GetHash(), entry.FromTx(txs[3]));
+    BOOST_CHECK_EQUAL(pool.changeLog.GetSequence(), 6);
+
+    BOOST_CHECK(pool.changeLog.GetChangesSince(nSequence, vAdded, vRemoved));
+    BOOST_CHECK_EQUAL(vAdded.size(), 1);
+    BOOST_CHECK(vAdded[0] == txs[3].GetHash());
+    BOOST_CHECK_EQUAL(vRemoved.size(), 1);
+    BOOST_CHECK(vRemoved[0] == txs[0].GetHash());
+
+    // From the start, the net changes are the pool contents
+    vAdded.clear();
+    vRemoved.clear();
+    BOOST_CHECK(pool.changeLog.GetChangesSince(0, vAdded, vRemoved));
+    BOOST_CHECK_EQUAL(vAdded.size(), 2);
+    BOOST_CHECK(vRemoved.empty());
+
+    // Future sequence numbers are rejected
+    BOOST_CHECK(!pool.changeLog.GetChangesSince(7, vAdded, vRemoved));
+
+    // Clearing the pool forces a resynchronization
+    pool.clear();
+    BOOST_CHECK(!pool.changeLog.GetChangesSince(nSequence, vAdded, vRemoved));
+    BOOST_CHECK(pool.changeLog.GetChangesSince(pool.changeLog.GetSequence(), vAdded, vRemoved));
+
+    // Each log (e.g. each run of the node) has its own nonce, as its
+    // sequence numbers restart at 0
+    CTxMemPool poolRestarted;
+    BOOST_CHECK(pool.changeLog.GetNonce() != poolRestarted.changeLog.GetNonce());
+
+    // The log is bounded; older sequence numbers fall off the front
+    CTxMemPoolChangeLog log(2);
+    log.TransactionAdded(MakeTransactionRef(txs[0]));
+    log.TransactionAdded(MakeTransactionRef(txs[1]));
+    log.TransactionRemoved(MakeTransactionRef(txs[0]), MemPoolRemovalReason::EXPIRY);
+    vAdded.clear();
+    vRemoved.clear();
+    BOOST_CHECK(!log.GetChangesSince(0, vAdded, vRemoved));
+    BOOST_CHECK(log.GetChangesSince(1, vAdded, vRemoved));
+    BOOST_CHECK_EQUAL(vAdded.size(), 1);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
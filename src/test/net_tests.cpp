@@ -185,4 +185,174 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+// A message as it appears on the wire
+static std::vector<char> MakeWireMessage(const char* pszCommand, const std::vector<unsigned char>& payload)
+{
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION);
+    ss << hdr;
+    ss.write((const char*)payload.data(), payload.size());
+    return std::vector<char>(ss.begin(), ss.end());
+}
+
+static void ReadWireMessage(CNetMessage& msg, const std::vector<char>& wire)
+{
+    int nHeader = msg.readHeader(wire.data(), wire.size());
+    BOOST_REQUIRE_EQUAL(nHeader, CMessageHeader::HEADER_SIZE);
+    BOOST_CHECK_EQUAL(msg.readData(wire.data() + nHeader, wire.size() - nHeader), (int)(wire.size() - nHeader));
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(memcmp(msg.GetMessageHash().begin(), msg.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_reuse)
+{
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    ReadWireMessage(msg, MakeWireMessage(NetMsgType::TX, std::vector<unsigned char>(1000, 1)));
+    const char* pBuffer = &msg.vRecv[0];
+    const size_t nCapacity = msg.GetMemoryUsage();
+    BOOST_CHECK(nCapacity >= 1000);
+
+    // The next message is received into the same buffer
+    msg.Reset();
+    BOOST_CHECK(!msg.complete());
+    BOOST_CHECK_EQUAL(msg.GetMemoryUsage(), nCapacity);
+    ReadWireMessage(msg, MakeWireMessage(NetMsgType::PING, std::vector<unsigned char>(8, 2)));
+    BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), NetMsgType::PING);
+    BOOST_CHECK_EQUAL(msg.vRecv.size(), 8U);
+    BOOST_CHECK(&msg.vRecv[0] == pBuffer);
+    uint64_t nNonce;
+    msg.vRecv >> nNonce;
+    BOOST_CHECK_EQUAL(nNonce, 0x0202020202020202ULL);
+}
+
+BOOST_AUTO_TEST_CASE(cnode_recv_pool)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true));
+
+    // Only as many messages as fit in the pool's limits are kept
+    std::list<CNetMessage> msgs;
+    for (size_t i = 0; i < MAX_RECV_POOL_MSGS + 2; i++) {
+        msgs.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+        msgs.back().vRecv.reserve(1000);
+    }
+    const size_t nUsage = msgs.front().GetMemoryUsage();
+    pnode->RecycleMessages(msgs);
+    BOOST_CHECK(msgs.empty());
+    BOOST_CHECK_EQUAL(pnode->vRecvPool.size(), MAX_RECV_POOL_MSGS);
+    BOOST_CHECK_EQUAL(pnode->nRecvPoolSize, MAX_RECV_POOL_MSGS * nUsage);
+
+    msgs.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    msgs.back().vRecv.reserve(MAX_RECV_POOL_SIZE);
+    pnode->RecycleMessages(msgs);
+    BOOST_CHECK_EQUAL(pnode->vRecvPool.size(), MAX_RECV_POOL_MSGS);
+
+    // Received messages are built in pooled buffers
+    std::vector<char> wire = MakeWireMessage(NetMsgType::PING, std::vector<unsigned char>(8, 2));
+    bool fComplete;
+    BOOST_CHECK(pnode->ReceiveMsgBytes(wire.data(), wire.size(), fComplete));
+    BOOST_CHECK(fComplete);
+    BOOST_CHECK_EQUAL(pnode->vRecvPool.size(), MAX_RECV_POOL_MSGS - 1);
+    BOOST_CHECK_EQUAL(pnode->nRecvPoolSize, (MAX_RECV_POOL_MSGS - 1) * nUsage);
+}
+
+BOOST_AUTO_TEST_CASE(cnode_msg_cost)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true));
+
+    pnode->AddMsgCost(NetMsgType::INV, 10, 2);
+    pnode->AddMsgCost(NetMsgType::INV, 30, 5);
+    // Serving more of an earlier getdata adds time but no message
+    pnode->AddMsgCost(NetMsgType::GETDATA, 100, 0);
+    pnode->AddMsgCost(NetMsgType::GETDATA, 200, 0, false);
+    pnode->AddMsgCost("nonsense", 7, 0);
+    pnode->AddMsgCost("", 3, 1);
+
+    CNodeStats stats;
+    pnode->copyStats(stats);
+    const CMsgCost& inv = stats.mapCostPerMsgCmd[NetMsgType::INV];
+    BOOST_CHECK_EQUAL(inv.nCount, 2U);
+    BOOST_CHECK_EQUAL(inv.nTotalMicros, 40);
+    BOOST_CHECK_EQUAL(inv.nMaxMicros, 30);
+    BOOST_CHECK_EQUAL(inv.nMainLockMicros, 7);
+    BOOST_CHECK_EQUAL(stats.mapCostPerMsgCmd[NetMsgType::GETDATA].nCount, 1U);
+    BOOST_CHECK_EQUAL(stats.mapCostPerMsgCmd[NetMsgType::GETDATA].nTotalMicros, 300);
+    BOOST_CHECK(!stats.mapCostPerMsgCmd.count("nonsense"));
+    BOOST_CHECK_EQUAL(stats.mapCostPerMsgCmd["*other*"].nCount, 1U);
+    BOOST_CHECK_EQUAL(stats.sendMessagesCost.nCount, 1U);
+    BOOST_CHECK_EQUAL(stats.sendMessagesCost.nMainLockMicros, 1);
+
+    // Only what the peer spent anything on is added to totals
+    mapMsgCmdCost mapCost;
+    CMsgCost sendCost;
+    pnode->GetMsgCosts(mapCost, sendCost);
+    pnode->GetMsgCosts(mapCost, sendCost);
+    BOOST_CHECK_EQUAL(mapCost.size(), 3U);
+    BOOST_CHECK_EQUAL(mapCost[NetMsgType::INV].nCount, 4U);
+    BOOST_CHECK_EQUAL(mapCost[NetMsgType::INV].nMaxMicros, 30);
+    BOOST_CHECK_EQUAL(sendCost.nTotalMicros, 6);
+}
+
+BOOST_AUTO_TEST_CASE(timed_lock_hold)
+{
+    CCriticalSection csTimed(true);
+    CCriticalSection csUntimed;
+
+    int64_t nBefore = GetTimedLockHeldMicros();
+    {
+        LOCK(csUntimed);
+        MilliSleep(5);
+    }
+    BOOST_CHECK_EQUAL(GetTimedLockHeldMicros(), nBefore);
+
+    {
+        LOCK(csTimed);
+        {
+            // Recursive locking counts once
+            LOCK(csTimed);
+            MilliSleep(5);
+        }
+        MilliSleep(5);
+    }
+    const int64_t nHeld = GetTimedLockHeldMicros() - nBefore;
+    BOOST_CHECK(nHeld >= 10000);
+    BOOST_CHECK(nHeld < 1000000);
+
+    nBefore = GetTimedLockHeldMicros();
+    {
+        TRY_LOCK(csTimed, lockTimed);
+        BOOST_CHECK(bool(lockTimed));
+        MilliSleep(5);
+    }
+    BOOST_CHECK(GetTimedLockHeldMicros() - nBefore >= 5000);
+}
+
+BOOST_AUTO_TEST_CASE(socket_events_mode)
+{
+    SocketEventsMode mode;
+    BOOST_CHECK(ParseSocketEventsMode("select", mode));
+    BOOST_CHECK(mode == SOCKETEVENTS_SELECT);
+    BOOST_CHECK(!ParseSocketEventsMode("", mode));
+    BOOST_CHECK(!ParseSocketEventsMode("kqueue", mode));
+
+    // The default is always available, and every name round-trips
+    BOOST_CHECK(ParseSocketEventsMode(GetSocketEventsModeName(DEFAULT_SOCKETEVENTS), mode));
+    BOOST_CHECK(mode == DEFAULT_SOCKETEVENTS);
+    for (SocketEventsMode m : {SOCKETEVENTS_SELECT, SOCKETEVENTS_POLL, SOCKETEVENTS_EPOLL}) {
+        std::string strModes = ", " + GetSupportedSocketEventsModes() + ",";
+        bool fSupported = strModes.find(", " + GetSocketEventsModeName(m) + ",") != std::string::npos;
+        BOOST_CHECK_EQUAL(ParseSocketEventsMode(GetSocketEventsModeName(m), mode), fSupported);
+        if (fSupported) {
+            BOOST_CHECK(mode == m);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -54,6 +54,9 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
             nTx_ = (nTx_+1)/2;
             nHeight++;
         }
+        const std::vector<std::vector<uint256> > vLevels = CPartialMerkleTree::CalcTreeLevels(vTxid);
+        BOOST_CHECK_EQUAL(vLevels.size(), (unsigned int)nHeight);
+        BOOST_CHECK(vLevels.back() == std::vector<uint256>(1, merkleRoot1));
 
         // check with random subsets with inclusion chances 1, 1/2, 1/4, ..., 1/128
         for (int att = 1; att < 15; att++) {
@@ -74,6 +77,11 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
             CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
             ss << pmt1;
 
+            // built from the precomputed tree it is the same
+            CDataStream ssLevels(SER_NETWORK, PROTOCOL_VERSION);
+            ssLevels << CPartialMerkleTree(vLevels, vMatch);
+            BOOST_CHECK(ssLevels.str() == ss.str());
+
             // verify CPartialMerkleTree's size guarantees
             unsigned int n = std::min<unsigned int>(nTx, 1 + vMatchTxid1.size()*nHeight);
             BOOST_CHECK(ss.size() <= 10 + (258*n+7)/8);
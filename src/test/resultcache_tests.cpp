@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/resultcache.h"
+
+#include "chain.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(resultcache_tests, TestingSetup)
+
+static bool AlwaysValid(const CResultCache::Result&) { return true; }
+
+BOOST_AUTO_TEST_CASE(resultcache_lru)
+{
+    CResultCache cache(90);
+    CResultCache::Result result;
+    const uint256 hashBlock = uint256S("01");
+
+    BOOST_CHECK(!cache.Get("a", result, AlwaysValid));
+    cache.Add("a", hashBlock, uint256(), std::string(20, 'a'), false);
+    cache.Add("b", hashBlock, uint256(), std::string(20, 'b'), false);
+    cache.Add("c", hashBlock, uint256(), std::string(20, 'c'), false);
+    BOOST_CHECK(cache.Get("a", result, AlwaysValid));
+    BOOST_CHECK_EQUAL(*result.data, std::string(20, 'a'));
+    BOOST_CHECK(result.hashBlock == hashBlock);
+
+    // Passing the size limit evicts the least recently used, "b"
+    cache.Add("d", hashBlock, uint256(), std::string(20, 'd'), false);
+    cache.Add("e", hashBlock, uint256(), std::string(20, 'e'), false);
+    BOOST_CHECK(!cache.Get("b", result, AlwaysValid));
+    BOOST_CHECK(cache.Get("a", result, AlwaysValid));
+    BOOST_CHECK(cache.Get("c", result, AlwaysValid));
+
+    // Results over a quarter of the cache are not kept
+    cache.Add("big", hashBlock, uint256(), std::string(26, 'x'), false);
+    BOOST_CHECK(!cache.Get("big", result, AlwaysValid));
+
+    // Results that no longer hold are dropped
+    BOOST_CHECK(!cache.Get("a", result, [](const CResultCache::Result&) { return false; }));
+    BOOST_CHECK(!cache.Get("a", result, AlwaysValid));
+
+    CResultCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 3U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 60U);
+    BOOST_CHECK_EQUAL(stats.nHits, 3U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 5U);
+
+    cache.SetMaxBytes(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(resultcache_confirmations)
+{
+    LOCK(cs_main);
+    const CBlockIndex* pgenesis = chainActive.Genesis();
+    BOOST_REQUIRE(pgenesis);
+    std::string strResult;
+
+    // Not deep enough
+    SetResultCacheLimits(1 << 20, 2);
+    BOOST_CHECK(!IsResultCacheable(pgenesis));
+    AddCachedResult("header", pgenesis, "{}", true);
+    BOOST_CHECK(!GetCachedResult("header", strResult));
+
+    // The confirmations are those of the current chain, not when it was cached
+    SetResultCacheLimits(1 << 20, 1);
+    BOOST_CHECK(IsResultCacheable(pgenesis));
+    AddCachedResult("header", pgenesis, "{\"hash\":\"00\",\"confirmations\":1234,\"height\":0}", true);
+    BOOST_CHECK(GetCachedResult("header", strResult));
+    BOOST_CHECK_EQUAL(strResult, "{\"hash\":\"00\",\"confirmations\":1,\"height\":0}");
+    AddCachedResult("hex", pgenesis, "\"0100\"", true);
+    BOOST_CHECK(GetCachedResult("hex", strResult));
+    BOOST_CHECK_EQUAL(strResult, "\"0100\"");
+    AddCachedResult("tail", pgenesis, "\"confirmations\":77", true);
+    BOOST_CHECK(GetCachedResult("tail", strResult));
+    BOOST_CHECK_EQUAL(strResult, "\"confirmations\":1");
+
+    // Binary results are returned as they were, whatever bytes they hold
+    const std::string strBinary("\x01\"confirmations\":99", 19);
+    AddCachedResult("bin", pgenesis, strBinary, false);
+    BOOST_CHECK(GetCachedResult("bin", strResult));
+    BOOST_CHECK(strResult == strBinary);
+
+    SetResultCacheLimits(0, 1);
+    BOOST_CHECK(!IsResultCacheable(pgenesis));
+    BOOST_CHECK(!GetCachedResult("header", strResult));
+    SetResultCacheLimits(DEFAULT_RESULT_CACHE_SIZE << 20, DEFAULT_RESULT_CACHE_DEPTH);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
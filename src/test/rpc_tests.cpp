@@ -14,6 +14,8 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <thread>
+
 #include <univalue.h>
 
 UniValue CallRPC(std::string args)
@@ -80,6 +82,24 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction null"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction DEADBEEF"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ")+rawtx+" extra"), std::runtime_error);
+
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions null"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions DEADBEEF"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions [] false extra"), std::runtime_error);
+    BOOST_CHECK_NO_THROW(r = CallRPC("sendrawtransactions []"));
+    BOOST_CHECK(r.get_array().empty());
+    // Undecodable transactions are reported per entry rather than failing the call
+    BOOST_CHECK_NO_THROW(r = CallRPC("sendrawtransactions [\"DEADBEEF\",\"ff00\"]"));
+    BOOST_CHECK_EQUAL(r.get_array().size(), 2);
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "accepted").get_bool(), false);
+    BOOST_CHECK_EQUAL(find_value(r[1].get_obj(), "error").get_str(), "TX decode failed");
+    // So are repeats of a transaction earlier in the batch
+    BOOST_CHECK_NO_THROW(r = CallRPC("sendrawtransactions [\""+rawtx+"\",\""+rawtx+"\"]"));
+    BOOST_CHECK_EQUAL(r.get_array().size(), 2);
+    BOOST_CHECK_EQUAL(find_value(r[0].get_obj(), "error").get_str(), "Missing inputs");
+    BOOST_CHECK_EQUAL(find_value(r[1].get_obj(), "txid").get_str(), find_value(r[0].get_obj(), "txid").get_str());
+    BOOST_CHECK_EQUAL(find_value(r[1].get_obj(), "code").get_int(), RPC_INVALID_PARAMETER);
 }
 
 BOOST_AUTO_TEST_CASE(rpc_togglenetwork)
@@ -237,6 +257,50 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    SetRPCWarmupFinished();
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("id", i));
+        req.push_back(Pair("method", i % 5 == 4 ? "nosuchmethod" : "echo"));
+        UniValue params(UniValue::VARR);
+        params.push_back(i);
+        req.push_back(Pair("params", params));
+        vReq.push_back(req);
+    }
+    const std::string strSerial = JSONRPCExecBatch(vReq);
+
+    // Replies keep the order of the requests, however the elements are spread
+    std::vector<std::thread> threads;
+    auto launch = [&threads](const std::function<void()>& func) {
+        threads.emplace_back(func);
+        return true;
+    };
+    BOOST_CHECK_EQUAL(JSONRPCExecBatch(vReq, 3, launch), strSerial);
+    BOOST_CHECK_EQUAL(threads.size(), 3U);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // The batch still completes if helpers cannot be started
+    BOOST_CHECK_EQUAL(JSONRPCExecBatch(vReq, 3, [](const std::function<void()>&) { return false; }), strSerial);
+
+    // Methods that change state keep the batch in order
+    UniValue req(UniValue::VOBJ);
+    req.push_back(Pair("id", 20));
+    req.push_back(Pair("method", "ping"));
+    vReq.push_back(req);
+    threads.clear();
+    JSONRPCExecBatch(vReq, 3, launch);
+    BOOST_CHECK(threads.empty());
+
+    UniValue reply = ParseNonRFCJSONValue(strSerial);
+    BOOST_CHECK_EQUAL(reply.size(), 20U);
+    BOOST_CHECK_EQUAL(find_value(reply[3], "result")[0].get_int(), 3);
+    BOOST_CHECK(find_value(reply[4], "result").isNull());
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(std::string("clearbanned")));
@@ -0,0 +1,351 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "protocol.h"
+#include "random.h"
+#include "streams.h"
+#include "txreconciliation.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    FastRandomContext rand(true);
+    for (size_t nDifference : {0, 1, 2, 10, 100, 1000, 10000}) {
+        CTxSketch local(CTxSketch::CellsForDifference(nDifference));
+        CTxSketch remote(local.GetCellCount());
+        for (int i = 0; i < 500; i++) {
+            uint32_t nShortId = rand.rand32();
+            local.Add(nShortId);
+            remote.Add(nShortId);
+        }
+        std::set<uint32_t> setLocalOnly, setRemoteOnly;
+        for (size_t i = 0; i < nDifference; i++) {
+            uint32_t nShortId = rand.rand32();
+            if (i % 3 == 0) {
+                setLocalOnly.insert(nShortId);
+                local.Add(nShortId);
+            } else {
+                setRemoteOnly.insert(nShortId);
+                remote.Add(nShortId);
+            }
+        }
+
+        // Survives the trip through a sketch message
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << remote;
+        BOOST_CHECK_EQUAL(ss.size(), GetSizeOfCompactSize(remote.GetCellCount()) + remote.GetCellCount() * 10);
+        CTxSketch diff;
+        ss >> diff;
+
+        BOOST_CHECK(diff.Subtract(local));
+        std::vector<uint32_t> vAdded, vRemoved;
+        BOOST_CHECK(diff.Decode(vAdded, vRemoved));
+        BOOST_CHECK(std::set<uint32_t>(vAdded.begin(), vAdded.end()) == setRemoteOnly);
+        BOOST_CHECK(std::set<uint32_t>(vRemoved.begin(), vRemoved.end()) == setLocalOnly);
+    }
+
+    // A difference far beyond the sketch's capacity is detected
+    CTxSketch small(CTxSketch::CellsForDifference(10));
+    for (int i = 0; i < 200; i++)
+        small.Add(rand.rand32());
+    std::vector<uint32_t> vAdded, vRemoved;
+    BOOST_CHECK(!small.Decode(vAdded, vRemoved));
+    BOOST_CHECK(!small.Subtract(CTxSketch(CTxSketch::CellsForDifference(20))));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    CTxReconState initiator(true), responder(false);
+    std::vector<uint256> vCommon;
+    for (int i = 0; i < 50; i++) {
+        vCommon.push_back(InsecureRand256());
+        BOOST_CHECK(initiator.AddTx(vCommon.back(), i % 2 == 0));
+        BOOST_CHECK(responder.AddTx(vCommon.back(), false));
+    }
+    const uint256 txInitiator = InsecureRand256(), txFlooded = InsecureRand256(), txResponder = InsecureRand256();
+    initiator.AddTx(txInitiator, false);
+    initiator.AddTx(txFlooded, true);
+    responder.AddTx(txResponder, false);
+
+    // Sketches here are oversized, as whether a small one decodes depends on the random salt
+    const uint16_t nQ = 4 * RECON_Q_PRECISION;
+    uint64_t nSalt = initiator.StartRound(0);
+    BOOST_CHECK(initiator.IsRoundOpen());
+    std::vector<uint32_t> vWanted;
+    std::vector<uint256> vAnnounce;
+    CTxSketch sketch = responder.HandleRequest(nSalt, initiator.GetQueueSize(), nQ, 0, vAnnounce);
+    BOOST_CHECK(vAnnounce.empty());
+    BOOST_CHECK(initiator.HandleSketch(sketch, vWanted, vAnnounce));
+    BOOST_CHECK(!initiator.IsRoundOpen());
+    BOOST_CHECK_EQUAL(initiator.GetQueueSize(), 0U);
+    // What was already flooded is not announced again
+    BOOST_CHECK(vAnnounce == std::vector<uint256>(1, txInitiator));
+    BOOST_CHECK(vWanted == std::vector<uint32_t>(1, GetReconShortId(nSalt, txResponder)));
+
+    responder.HandleDiff(true, vWanted, vAnnounce);
+    BOOST_CHECK(vAnnounce == std::vector<uint256>(1, txResponder));
+
+    // The responder answers one request at a time
+    BOOST_CHECK(!responder.IsRoundOpen());
+    for (const uint256& txid : vCommon) {
+        initiator.AddTx(txid, false);
+        responder.AddTx(txid, false);
+    }
+    responder.AddTx(txResponder, false);
+    responder.AddTx(txInitiator, false);
+    nSalt = initiator.StartRound(0);
+    sketch = responder.HandleRequest(nSalt, initiator.GetQueueSize(), nQ, 0, vAnnounce);
+    BOOST_CHECK(responder.IsRoundOpen());
+    BOOST_CHECK(initiator.HandleSketch(sketch, vWanted, vAnnounce));
+    BOOST_CHECK_EQUAL(vWanted.size(), 2U);
+    BOOST_CHECK(vAnnounce.empty());
+
+    // On failure everything queued is announced
+    responder.HandleDiff(false, std::vector<uint32_t>(), vAnnounce);
+    BOOST_CHECK(!responder.IsRoundOpen());
+    BOOST_CHECK_EQUAL(vAnnounce.size(), vCommon.size() + 2);
+    initiator.AddTx(txInitiator, false);
+    initiator.StartRound(0);
+    BOOST_CHECK(!initiator.HandleSketch(CTxSketch(), vWanted, vAnnounce));
+    BOOST_CHECK(vWanted.empty());
+    BOOST_CHECK(vAnnounce == std::vector<uint256>(1, txInitiator));
+
+    // However large the peer claims its queue is, the sketch is sized by ours
+    responder.AddTx(txResponder, false);
+    sketch = responder.HandleRequest(nSalt, std::numeric_limits<uint32_t>::max(), std::numeric_limits<uint16_t>::max(), 0, vAnnounce);
+    BOOST_CHECK_EQUAL(sketch.GetCellCount(), CTxSketch::CellsForDifference(2));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_shortid_collision)
+{
+    // Find two txids whose short IDs collide for a fixed salt
+    const uint64_t nSalt = 0;
+    std::map<uint32_t, uint256> mapSeen;
+    uint256 txFirst, txSecond;
+    for (uint64_t i = 0; txSecond.IsNull(); i++) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << i;
+        const uint256 txid = Hash(ss.begin(), ss.end());
+        std::pair<std::map<uint32_t, uint256>::iterator, bool> inserted = mapSeen.emplace(GetReconShortId(nSalt, txid), txid);
+        if (!inserted.second) {
+            txFirst = inserted.first->second;
+            txSecond = txid;
+        }
+    }
+
+    // Only one of them can go in the sketch; the other is announced instead
+    CTxReconState responder(false);
+    responder.AddTx(txFirst, false);
+    responder.AddTx(txSecond, false);
+    std::vector<uint256> vAnnounce;
+    CTxSketch sketch = responder.HandleRequest(nSalt, 0, DEFAULT_RECON_Q, 0, vAnnounce);
+    BOOST_CHECK_EQUAL(vAnnounce.size(), 1U);
+    BOOST_CHECK(vAnnounce[0] == txFirst || vAnnounce[0] == txSecond);
+    std::vector<uint32_t> vAdded, vRemoved;
+    BOOST_CHECK(sketch.Decode(vAdded, vRemoved));
+    BOOST_CHECK(vAdded == std::vector<uint32_t>(1, GetReconShortId(nSalt, txFirst)));
+
+    // Asked for by short ID, the one in the sketch is announced as well
+    const uint256 txAnnounced = vAnnounce[0];
+    responder.HandleDiff(true, vAdded, vAnnounce);
+    BOOST_CHECK_EQUAL(vAnnounce.size(), 1U);
+    BOOST_CHECK(vAnnounce[0] != txAnnounced);
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_timeout)
+{
+    const int64_t nTimeout = RECON_ROUND_TIMEOUT * 1000000LL;
+    const uint256 txQueued = InsecureRand256(), txLater = InsecureRand256();
+    std::vector<uint256> vAnnounce;
+
+    // An initiator whose request goes unanswered floods what it queued
+    CTxReconState initiator(true);
+    BOOST_CHECK(!initiator.ExpireRound(nTimeout * 2, vAnnounce));
+    initiator.AddTx(txQueued, false);
+    initiator.AddTx(InsecureRand256(), true);
+    initiator.StartRound(1000);
+    BOOST_CHECK(!initiator.ExpireRound(1000 + nTimeout, vAnnounce));
+    BOOST_CHECK(initiator.AddTx(txLater, false));
+    BOOST_CHECK(initiator.ExpireRound(1001 + nTimeout, vAnnounce));
+    BOOST_CHECK_EQUAL(vAnnounce.size(), 2U);
+    BOOST_CHECK(initiator.IsFlooding());
+    BOOST_CHECK(!initiator.IsRoundOpen());
+    BOOST_CHECK_EQUAL(initiator.GetQueueSize(), 0U);
+    // and every transaction after them
+    BOOST_CHECK(!initiator.AddTx(InsecureRand256(), false));
+    BOOST_CHECK(!initiator.ExpireRound(nTimeout * 4, vAnnounce));
+
+    // So does a responder whose sketch goes unanswered, including what it sketched
+    CTxReconState responder(false);
+    responder.AddTx(txQueued, false);
+    responder.HandleRequest(1, 1, DEFAULT_RECON_Q, 1000, vAnnounce);
+    responder.AddTx(txLater, false);
+    BOOST_CHECK(responder.ExpireRound(1001 + nTimeout, vAnnounce));
+    BOOST_CHECK_EQUAL(vAnnounce.size(), 2U);
+    BOOST_CHECK(responder.IsFlooding());
+    BOOST_CHECK(!responder.AddTx(InsecureRand256(), false));
+}
+
+// A small network relaying transactions, with transaction announcements
+// made only by INV or through reconciliation as net_processing does. Counts
+// the bytes of the messages that differ between the two; getdata and tx
+// messages are the same either way.
+namespace {
+struct SimLink {
+    int nodes[2]; //!< [0] made the connection
+    std::unique_ptr<CTxReconState> recon[2];
+    std::set<uint256> setKnown[2]; //!< transactions side i knows the other side has
+};
+
+struct SimNetwork {
+    std::vector<std::set<uint256>> vHave;
+    std::vector<std::vector<std::pair<size_t, int>>> vNodeLinks; //!< link and side
+    std::vector<SimLink> vLinks;
+    std::vector<std::pair<std::pair<size_t, int>, uint256>> vInvs;
+    uint64_t nBytes;
+    int nRounds;
+    int nFailures;
+
+    SimNetwork(int nNodes, int nOutbound, bool fReconcile) : vHave(nNodes), vNodeLinks(nNodes), vLinks(nNodes * nOutbound), nBytes(0), nRounds(0), nFailures(0)
+    {
+        FastRandomContext rand(true);
+        std::set<std::pair<int, int>> setConnected;
+        size_t nLink = 0;
+        for (int nNode = 0; nNode < nNodes; nNode++) {
+            for (int i = 0; i < nOutbound; i++) {
+                int nPeer;
+                do {
+                    nPeer = rand.randrange(nNodes);
+                } while (nPeer == nNode || setConnected.count(std::make_pair(std::min(nNode, nPeer), std::max(nNode, nPeer))));
+                setConnected.insert(std::make_pair(std::min(nNode, nPeer), std::max(nNode, nPeer)));
+                SimLink& link = vLinks[nLink];
+                link.nodes[0] = nNode;
+                link.nodes[1] = nPeer;
+                for (int nSide = 0; nSide < 2; nSide++) {
+                    if (fReconcile)
+                        link.recon[nSide].reset(new CTxReconState(nSide == 0));
+                    vNodeLinks[link.nodes[nSide]].push_back(std::make_pair(nLink, nSide));
+                }
+                nLink++;
+            }
+        }
+    }
+
+    void PushInventory(size_t nLink, int nSide, const uint256& txid)
+    {
+        if (vLinks[nLink].setKnown[nSide].insert(txid).second)
+            vInvs.push_back(std::make_pair(std::make_pair(nLink, nSide), txid));
+    }
+
+    // Same choice as RelayTransaction
+    void Relay(int nNode, const uint256& txid)
+    {
+        vHave[nNode].insert(txid);
+        int nFlooded = 0;
+        for (const std::pair<size_t, int>& item : vNodeLinks[nNode]) {
+            CTxReconState* recon = vLinks[item.first].recon[item.second].get();
+            if (recon) {
+                bool fFlood = recon->IsInitiator() && nFlooded < MAX_RECON_FLOOD_PEERS;
+                if (recon->AddTx(txid, fFlood)) {
+                    if (!fFlood)
+                        continue;
+                    nFlooded++;
+                }
+            }
+            PushInventory(item.first, item.second, txid);
+        }
+    }
+
+    void SendInvs()
+    {
+        std::vector<std::pair<std::pair<size_t, int>, uint256>> vSending;
+        vSending.swap(vInvs);
+        std::set<std::pair<size_t, int>> setMessages;
+        for (const auto& inv : vSending) {
+            const SimLink& link = vLinks[inv.first.first];
+            const int nPeer = link.nodes[1 - inv.first.second];
+            vLinks[inv.first.first].setKnown[1 - inv.first.second].insert(inv.second);
+            if (setMessages.insert(inv.first).second)
+                nBytes += CMessageHeader::HEADER_SIZE + 1;
+            nBytes += ::GetSerializeSize(CInv(MSG_TX, inv.second), SER_NETWORK, PROTOCOL_VERSION);
+            if (!vHave[nPeer].count(inv.second))
+                Relay(nPeer, inv.second);
+        }
+    }
+
+    // Each link reconciles every fourth step, as if INVs were sent about every
+    // RECON_INTERVAL / 4 seconds
+    void Reconcile(int nStep)
+    {
+        for (size_t nLink = 0; nLink < vLinks.size(); nLink++) {
+            SimLink& link = vLinks[nLink];
+            if (!link.recon[0])
+                return;
+            if ((nLink + nStep) % 4 != 0)
+                continue;
+            const uint64_t nSalt = link.recon[0]->StartRound(0);
+            nBytes += CMessageHeader::HEADER_SIZE + 12;
+            std::vector<uint32_t> vWanted;
+            std::vector<uint256> vAnnounce;
+            CTxSketch sketch = link.recon[1]->HandleRequest(nSalt, link.recon[0]->GetQueueSize(), link.recon[0]->GetQ(), 0, vAnnounce);
+            nBytes += CMessageHeader::HEADER_SIZE + ::GetSerializeSize(sketch, SER_NETWORK, PROTOCOL_VERSION);
+            for (const uint256& txid : vAnnounce)
+                PushInventory(nLink, 1, txid);
+            bool fSuccess = link.recon[0]->HandleSketch(sketch, vWanted, vAnnounce);
+            nRounds++;
+            nFailures += !fSuccess;
+            nBytes += CMessageHeader::HEADER_SIZE + ::GetSerializeSize(fSuccess, SER_NETWORK, PROTOCOL_VERSION) + ::GetSerializeSize(vWanted, SER_NETWORK, PROTOCOL_VERSION);
+            for (const uint256& txid : vAnnounce)
+                PushInventory(nLink, 0, txid);
+            link.recon[1]->HandleDiff(fSuccess, vWanted, vAnnounce);
+            for (const uint256& txid : vAnnounce)
+                PushInventory(nLink, 1, txid);
+        }
+    }
+};
+
+uint64_t RunSimulation(bool fReconcile, size_t& nTxs)
+{
+    const int nNodes = 16;
+    SimNetwork net(nNodes, 4, fReconcile);
+    FastRandomContext rand(true);
+    nTxs = 0;
+    for (int nStep = 0; nStep < 40; nStep++) {
+        // New transactions for the first 30 steps, then let them settle
+        for (int i = 0; nStep < 30 && i < 40; i++) {
+            net.Relay(rand.randrange(nNodes), rand.rand256());
+            nTxs++;
+        }
+        net.SendInvs();
+        net.Reconcile(nStep);
+    }
+    for (int nNode = 0; nNode < nNodes; nNode++)
+        BOOST_CHECK_EQUAL(net.vHave[nNode].size(), nTxs);
+    BOOST_TEST_MESSAGE(net.nFailures << " of " << net.nRounds << " rounds failed to decode");
+    return net.nBytes;
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(reconciliation_bandwidth)
+{
+    size_t nTxs;
+    const uint64_t nFloodBytes = RunSimulation(false, nTxs);
+    const uint64_t nReconBytes = RunSimulation(true, nTxs);
+    BOOST_TEST_MESSAGE("announcement bytes per transaction: " << nFloodBytes / nTxs << " flooding, " << nReconBytes / nTxs << " reconciling");
+    BOOST_CHECK(nReconBytes * 3 < nFloodBytes * 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
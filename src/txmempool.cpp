@@ -18,6 +18,8 @@
 #include "utilmoneystr.h"
 #include "utiltime.h"
 
+#include <boost/bind.hpp>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp):
@@ -101,6 +103,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
             cachedDescendants[updateIt].insert(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            UpdateCachedAncestor(cit, updateIt, true);
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -152,6 +155,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    ++nEpoch;
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -184,26 +188,54 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
-
-        setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
-        totalSizeWithAncestors += stageit->GetTxSize();
+    // Account for a newly found ancestor and check it against the limits.
+    auto addAncestor = [&](txiter ancestorIt) -> bool {
+        setAncestors.insert(ancestorIt);
+        totalSizeWithAncestors += ancestorIt->GetTxSize();
 
-        if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
-            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantSize);
+        if (ancestorIt->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", ancestorIt->GetTx().GetHash().ToString(), limitDescendantSize);
             return false;
-        } else if (stageit->GetCountWithDescendants() + 1 > limitDescendantCount) {
-            errString = strprintf("too many descendants for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantCount);
+        } else if (ancestorIt->GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", ancestorIt->GetTx().GetHash().ToString(), limitDescendantCount);
             return false;
         } else if (totalSizeWithAncestors > limitAncestorSize) {
             errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
             return false;
         }
+        return true;
+    };
+
+    while (!parentHashes.empty()) {
+        txiter stageit = *parentHashes.begin();
+
+        parentHashes.erase(stageit);
+        if (!addAncestor(stageit)) {
+            return false;
+        }
+
+        txlinksMap::const_iterator linksIt = mapLinks.find(stageit);
+        assert(linksIt != mapLinks.end());
+        const TxLinks &links = linksIt->second;
+        if (links.fAncestorsCached) {
+            // The cached set is closed under ancestry, so its members do not
+            // need to be walked any further.
+            for (const txiter &ancestorIt : links.ancestors) {
+                if (setAncestors.count(ancestorIt) == 0) {
+                    parentHashes.erase(ancestorIt);
+                    if (!addAncestor(ancestorIt)) {
+                        return false;
+                    }
+                }
+            }
+            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+                errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+                return false;
+            }
+            continue;
+        }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
-        for (const txiter &phash : setMemPoolParents) {
+        for (const txiter &phash : links.parents) {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
                 parentHashes.insert(phash);
@@ -276,6 +308,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
             int modifySigOps = -removeIt->GetSigOpCost();
             for (txiter dit : setDescendants) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                UpdateCachedAncestor(dit, removeIt, false);
             }
         }
     }
@@ -334,10 +367,13 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), minerPolicyEstimator(estimator), nMaxAncestorCacheUsage(DEFAULT_ANCESTOR_CACHE_USAGE), nEpoch(0)
 {
     _clear(); //lock free clear
 
+    NotifyEntryAdded.connect(boost::bind(&CTxMemPoolChangeLog::TransactionAdded, &changeLog, _1));
+    NotifyEntryRemoved.connect(boost::bind(&CTxMemPoolChangeLog::TransactionRemoved, &changeLog, _1, _2));
+
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
     // of transactions in the pool
@@ -410,8 +446,16 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
+    if (setAncestors.size() <= MAX_CACHED_ANCESTORS &&
+        cachedAncestorUsage + memusage::DynamicUsage(setAncestors) <= nMaxAncestorCacheUsage) {
+        TxLinks &links = mapLinks[newit];
+        links.ancestors = setAncestors;
+        links.fAncestorsCached = true;
+        cachedAncestorUsage += memusage::DynamicUsage(links.ancestors);
+    }
 
     nTransactionsUpdated++;
+    ++nEpoch;
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
@@ -440,9 +484,11 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
+    cachedAncestorUsage -= memusage::DynamicUsage(mapLinks[it].ancestors);
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    ++nEpoch;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -535,6 +581,7 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
         }
         if (!validLP) {
             mapTx.modify(it, update_lock_points(lp));
+            ++nEpoch;
         }
     }
     setEntries setAllRemoves;
@@ -600,10 +647,13 @@ void CTxMemPool::_clear()
     mapNextTx.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    cachedAncestorUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++nEpoch;
+    changeLog.Reset();
 }
 
 void CTxMemPool::clear()
@@ -624,6 +674,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    uint64_t ancestorUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
     const int64_t nSpendHeight = GetSpendHeight(mempoolDuplicate);
@@ -639,6 +690,23 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
         innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        ancestorUsage += memusage::DynamicUsage(links.ancestors);
+        if (links.fAncestorsCached) {
+            // The cached ancestor set must match a full walk of mapLinks.
+            setEntries setAncestorsWalk;
+            setEntries stage = links.parents;
+            while (!stage.empty()) {
+                txiter stageit = *stage.begin();
+                stage.erase(stage.begin());
+                if (setAncestorsWalk.insert(stageit).second) {
+                    const setEntries &setParents = GetMemPoolParents(stageit);
+                    stage.insert(setParents.begin(), setParents.end());
+                }
+            }
+            assert(setAncestorsWalk == links.ancestors);
+        } else {
+            assert(links.ancestors.empty());
+        }
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -739,6 +807,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    assert(ancestorUsage == cachedAncestorUsage);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -835,6 +904,35 @@ TxMempoolInfo CTxMemPool::info(const uint256& hash) const
     return GetInfo(i);
 }
 
+CTxMemPoolSnapshot::Entry CTxMemPool::GetSnapshotEntry(txiter it) const
+{
+    AssertLockHeld(cs);
+    CTxMemPoolSnapshot::Entry ret(*it);
+    const setEntries& parents = GetMemPoolParents(it);
+    ret.vParents.reserve(parents.size());
+    for (txiter parentIt : parents) {
+        ret.vParents.push_back(parentIt->GetTx().GetHash());
+    }
+    return ret;
+}
+
+CTxMemPoolSnapshotRef CTxMemPool::GetSnapshot() const
+{
+    LOCK(cs);
+    if (cachedSnapshot && cachedSnapshot->nEpoch == nEpoch) {
+        return cachedSnapshot;
+    }
+
+    std::shared_ptr<CTxMemPoolSnapshot> snapshot = std::make_shared<CTxMemPoolSnapshot>();
+    snapshot->nEpoch = nEpoch;
+    snapshot->vEntries.reserve(mapTx.size());
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+        snapshot->vEntries.push_back(GetSnapshotEntry(it));
+    }
+    cachedSnapshot = snapshot;
+    return cachedSnapshot;
+}
+
 void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeDelta)
 {
     {
@@ -860,6 +958,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
+            ++nEpoch;
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -913,6 +1012,11 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
     return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
+size_t CTxMemPool::AncestorCacheUsage() const {
+    LOCK(cs);
+    return cachedAncestorUsage;
+}
+
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
     UpdateForRemoveFromMempool(stage, updateDescendants);
@@ -967,6 +1071,27 @@ void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
     }
 }
 
+void CTxMemPool::UpdateCachedAncestor(txiter entry, txiter ancestor, bool add)
+{
+    TxLinks &links = mapLinks[entry];
+    if (!links.fAncestorsCached) {
+        return;
+    }
+    setEntries s;
+    if (add && links.ancestors.insert(ancestor).second) {
+        cachedAncestorUsage += memusage::IncrementalDynamicUsage(s);
+        if (links.ancestors.size() > MAX_CACHED_ANCESTORS || cachedAncestorUsage > nMaxAncestorCacheUsage) {
+            // Stop tracking sets that grew past either bound; they are walked
+            // through mapLinks again instead.
+            cachedAncestorUsage -= memusage::DynamicUsage(links.ancestors);
+            links.ancestors.clear();
+            links.fAncestorsCached = false;
+        }
+    } else if (!add && links.ancestors.erase(ancestor)) {
+        cachedAncestorUsage -= memusage::IncrementalDynamicUsage(s);
+    }
+}
+
 const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
@@ -1066,3 +1191,71 @@ bool CTxMemPool::TransactionWithinChainLimit(const uint256& txid, size_t chainLi
 }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+CTxMemPoolChangeLog::CTxMemPoolChangeLog(size_t nMaxChangesIn) :
+    nMaxChanges(nMaxChangesIn), nNonce(GetRand(std::numeric_limits<uint64_t>::max())), nSequence(0), nOldestSequence(0)
+{
+}
+
+void CTxMemPoolChangeLog::Append(const uint256& txid, bool fAdded)
+{
+    LOCK(cs);
+    changes.push_back(Change{++nSequence, txid, fAdded});
+    while (changes.size() > nMaxChanges) {
+        nOldestSequence = changes.front().nSequence;
+        changes.pop_front();
+    }
+}
+
+void CTxMemPoolChangeLog::TransactionAdded(CTransactionRef tx)
+{
+    Append(tx->GetHash(), true);
+}
+
+void CTxMemPoolChangeLog::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    Append(tx->GetHash(), false);
+}
+
+void CTxMemPoolChangeLog::Reset()
+{
+    LOCK(cs);
+    changes.clear();
+    nOldestSequence = nSequence;
+}
+
+uint64_t CTxMemPoolChangeLog::GetSequence() const
+{
+    LOCK(cs);
+    return nSequence;
+}
+
+bool CTxMemPoolChangeLog::GetChangesSince(uint64_t nSequenceIn, std::vector<uint256>& vAdded, std::vector<uint256>& vRemoved) const
+{
+    LOCK(cs);
+    if (nSequenceIn < nOldestSequence || nSequenceIn > nSequence) {
+        return false;
+    }
+
+    // A transaction added and removed again (or the other way around) within
+    // the window cancels out, so only the net balance is reported.
+    std::map<uint256, int> mapBalance;
+    std::vector<uint256> vOrder;
+    auto it = changes.begin() + (nSequenceIn - nOldestSequence);
+    for (; it != changes.end(); ++it) {
+        auto inserted = mapBalance.emplace(it->txid, 0);
+        if (inserted.second) {
+            vOrder.push_back(it->txid);
+        }
+        inserted.first->second += it->fAdded ? 1 : -1;
+    }
+    for (const uint256& txid : vOrder) {
+        int nBalance = mapBalance[txid];
+        if (nBalance > 0) {
+            vAdded.push_back(txid);
+        } else if (nBalance < 0) {
+            vRemoved.push_back(txid);
+        }
+    }
+    return true;
+}
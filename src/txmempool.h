@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <deque>
 #include <memory>
 #include <set>
 #include <map>
@@ -32,6 +33,12 @@ class CBlockIndex;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Default number of additions/removals kept by CTxMemPoolChangeLog */
+static const unsigned int DEFAULT_MEMPOOL_CHANGELOG_SIZE = 100000;
+/** Ancestor sets larger than this are not cached per entry, bounding the cache's memory and update cost */
+static const unsigned int MAX_CACHED_ANCESTORS = 100;
+/** Default limit on the memory used by all cached ancestor sets together */
+static const size_t DEFAULT_ANCESTOR_CACHE_USAGE = 32 << 20;
 
 struct LockPoints
 {
@@ -313,6 +320,34 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * Immutable point-in-time copy of the mempool contents.
+ *
+ * Readers that walk the whole pool (getrawmempool, REST mempool contents)
+ * take a snapshot with CTxMemPool::GetSnapshot() and do their expensive work
+ * on it without holding CTxMemPool::cs, so they never stall transaction
+ * acceptance. The snapshot is rebuilt lazily the first time it is requested
+ * after the mempool changed, and is shared by all readers until then.
+ */
+struct CTxMemPoolSnapshot
+{
+    struct Entry
+    {
+        explicit Entry(const CTxMemPoolEntry& entryIn) : entry(entryIn) {}
+
+        CTxMemPoolEntry entry;
+        /** Txids of the in-mempool parents of this transaction. */
+        std::vector<uint256> vParents;
+    };
+
+    /** Mempool epoch at which this snapshot was taken. */
+    uint64_t nEpoch;
+
+    std::vector<Entry> vEntries;
+};
+
+typedef std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPoolSnapshotRef;
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -326,6 +361,52 @@ enum class MemPoolRemovalReason {
     REPLACED     //! Removed for replacement
 };
 
+/**
+ * Bounded log of mempool additions and removals, each tagged with a
+ * monotonically increasing sequence number.
+ *
+ * It is fed from CTxMemPool's NotifyEntryAdded and NotifyEntryRemoved
+ * signals. Polling clients can then fetch only what changed since the last
+ * sequence number they saw, instead of the whole mempool.
+ */
+class CTxMemPoolChangeLog
+{
+private:
+    struct Change
+    {
+        uint64_t nSequence;
+        uint256 txid;
+        bool fAdded;
+    };
+
+    mutable CCriticalSection cs;
+    std::deque<Change> changes;
+    size_t nMaxChanges;
+    const uint64_t nNonce;    //!< Random for each log, so sequence numbers from another one (e.g. before a restart) are told apart
+    uint64_t nSequence;       //!< Sequence number of the most recent change
+    uint64_t nOldestSequence; //!< Every change after this sequence number is still in the log
+
+    void Append(const uint256& txid, bool fAdded);
+
+public:
+    explicit CTxMemPoolChangeLog(size_t nMaxChangesIn = DEFAULT_MEMPOOL_CHANGELOG_SIZE);
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    /** Forget all logged changes (e.g. when the mempool is cleared), so
+     *  clients have to resynchronize. The sequence number keeps increasing. */
+    void Reset();
+
+    uint64_t GetSequence() const;
+    uint64_t GetNonce() const { return nNonce; }
+
+    /** Get the net changes since nSequenceIn: transactions that are in the
+     *  mempool now but were not then, and the other way around. Returns false
+     *  if the log no longer reaches back to nSequenceIn. */
+    bool GetChangesSince(uint64_t nSequenceIn, std::vector<uint256>& vAdded, std::vector<uint256>& vRemoved) const;
+};
+
 class SaltedTxidHasher
 {
 private:
@@ -421,11 +502,16 @@ private:
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedAncestorUsage; //!< dynamic memory usage of the cached ancestor sets, which is not part of cachedInnerUsage
+    size_t nMaxAncestorCacheUsage; //!< sets are not cached, or stop being cached, once they would push cachedAncestorUsage past this
 
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    uint64_t nEpoch; //!< Bumped on every change to mapTx entries or links; tags snapshots
+    mutable CTxMemPoolSnapshotRef cachedSnapshot; //!< Most recent snapshot, reused while nEpoch is unchanged
+
     void trackPackageRemoved(const CFeeRate& rate);
 
 public:
@@ -485,6 +571,10 @@ private:
     struct TxLinks {
         setEntries parents;
         setEntries children;
+        //! All in-mempool ancestors, kept in step with the ancestor state of
+        //! the entry so CalculateMemPoolAncestors() need not walk past it.
+        setEntries ancestors;
+        bool fAncestorsCached = false;
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
@@ -492,6 +582,7 @@ private:
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
+    void UpdateCachedAncestor(txiter entry, txiter ancestor, bool add);
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
@@ -511,6 +602,7 @@ public:
      */
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(double dFrequency = 1.0) { nCheckFrequency = dFrequency * 4294967295.0; }
+    void SetMaxAncestorCacheUsage(size_t nMaxUsage) { LOCK(cs); nMaxAncestorCacheUsage = nMaxUsage; }
 
     // addUnchecked must updated state for all ancestors of a given transaction,
     // to track size/count of descendant transactions.  First version of
@@ -622,11 +714,28 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
+    /** Return a consistent copy of the whole mempool. Only holds cs while the
+     *  copy is made, and only if the mempool changed since the last call. */
+    CTxMemPoolSnapshotRef GetSnapshot() const;
+    /** Copy a single entry and its in-mempool parents. Requires cs. */
+    CTxMemPoolSnapshot::Entry GetSnapshotEntry(txiter it) const;
+
     size_t DynamicMemoryUsage() const;
+    /**
+     * Memory used by the cached ancestor sets. It is left out of
+     * DynamicMemoryUsage() so that the cache, which only speeds up
+     * CalculateMemPoolAncestors(), does not make -maxmempool evict any sooner.
+     * Instead it is bounded on its own by nMaxAncestorCacheUsage: sets that
+     * would push it past the limit are not cached.
+     */
+    size_t AncestorCacheUsage() const;
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
 
+    /** Sequence-numbered record of recent additions and removals. */
+    CTxMemPoolChangeLog changeLog;
+
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
      *  the descendants for a single transaction that has been added to the
@@ -0,0 +1,280 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "hash.h"
+#include "random.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+
+//! SipHash key half fixed for short IDs; the other half is the round's salt
+static const uint64_t RECON_SHORTID_K1 = 0x7265636f6e63696cULL;
+
+uint32_t GetReconShortId(uint64_t nSalt, const uint256& txid)
+{
+    return (uint32_t)SipHashUint256(nSalt, RECON_SHORTID_K1, txid);
+}
+
+// Short IDs are already uniformly distributed, so cells and checksums only
+// need a cheap mix that differs per use.
+static inline uint32_t MixShortId(uint32_t nShortId, uint32_t nSeed)
+{
+    uint32_t h = nShortId ^ nSeed;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static const uint32_t SKETCH_CELL_SEEDS[3] = {0x2a4d1c5bU, 0x7e3f9b01U, 0x5c68e2d7U};
+static const uint32_t SKETCH_CHECK_SEED = 0x9e3779b9U;
+
+CTxSketch::CTxSketch(size_t nCells) : vCells(nCells)
+{
+    assert(nCells % 3 == 0);
+}
+
+size_t CTxSketch::CellsForDifference(size_t nDifference)
+{
+    // Peeling with three cells per element usually succeeds at about 1.25
+    // cells per element for large differences; leave room for the estimate
+    // being low, and more for small differences.
+    size_t nCells = nDifference * 2 + 9;
+    return (nCells + 2) / 3 * 3;
+}
+
+size_t CTxSketch::CellIndex(size_t nCells, uint32_t nShortId, int i)
+{
+    // Each element goes in one cell of each third of the table, so its three
+    // cells are always distinct.
+    const uint64_t nPart = nCells / 3;
+    return i * nPart + ((uint64_t)MixShortId(nShortId, SKETCH_CELL_SEEDS[i]) * nPart >> 32);
+}
+
+void CTxSketch::Update(std::vector<Cell>& cells, uint32_t nShortId, int16_t nDelta)
+{
+    const uint32_t nCheck = MixShortId(nShortId, SKETCH_CHECK_SEED);
+    for (int i = 0; i < 3; i++) {
+        Cell& cell = cells[CellIndex(cells.size(), nShortId, i)];
+        cell.nCount = (int16_t)(cell.nCount + nDelta);
+        cell.nKeySum ^= nShortId;
+        cell.nHashSum ^= nCheck;
+    }
+}
+
+void CTxSketch::Add(uint32_t nShortId)
+{
+    if (!vCells.empty())
+        Update(vCells, nShortId, 1);
+}
+
+bool CTxSketch::Subtract(const CTxSketch& other)
+{
+    if (other.vCells.size() != vCells.size())
+        return false;
+    for (size_t i = 0; i < vCells.size(); i++) {
+        vCells[i].nCount = (int16_t)(vCells[i].nCount - other.vCells[i].nCount);
+        vCells[i].nKeySum ^= other.vCells[i].nKeySum;
+        vCells[i].nHashSum ^= other.vCells[i].nHashSum;
+    }
+    return true;
+}
+
+bool CTxSketch::IsPure(const Cell& cell)
+{
+    return (cell.nCount == 1 || cell.nCount == -1) && cell.nHashSum == MixShortId(cell.nKeySum, SKETCH_CHECK_SEED);
+}
+
+bool CTxSketch::Decode(std::vector<uint32_t>& vAdded, std::vector<uint32_t>& vRemoved) const
+{
+    vAdded.clear();
+    vRemoved.clear();
+    if (vCells.empty() || vCells.size() % 3 != 0)
+        return false;
+
+    // Take out elements that are alone in a cell, which may leave other cells
+    // with a single element. Only the cells an element was taken out of can
+    // have become pure, so those are all that need checking again.
+    std::vector<Cell> cells(vCells);
+    std::vector<size_t> vPure;
+    for (size_t i = 0; i < cells.size(); i++) {
+        if (IsPure(cells[i]))
+            vPure.push_back(i);
+    }
+    while (!vPure.empty()) {
+        const Cell& cell = cells[vPure.back()];
+        vPure.pop_back();
+        // Emptied or changed since it was found
+        if (!IsPure(cell))
+            continue;
+        const uint32_t nShortId = cell.nKeySum;
+        const int16_t nCount = cell.nCount;
+        (nCount == 1 ? vAdded : vRemoved).push_back(nShortId);
+        // Only a corrupt sketch can yield more elements than it has cells
+        if (vAdded.size() + vRemoved.size() > cells.size())
+            return false;
+        Update(cells, nShortId, -nCount);
+        for (int i = 0; i < 3; i++) {
+            const size_t nIndex = CellIndex(cells.size(), nShortId, i);
+            if (IsPure(cells[nIndex]))
+                vPure.push_back(nIndex);
+        }
+    }
+
+    for (const Cell& cell : cells) {
+        if (cell.nCount != 0 || cell.nKeySum != 0 || cell.nHashSum != 0)
+            return false;
+    }
+    return true;
+}
+
+CTxReconState::CTxReconState(bool fInitiatorIn) : fInitiator(fInitiatorIn), nSalt(0), fRoundOpen(false), nRoundStart(0), fFlooding(false), nQ(DEFAULT_RECON_Q)
+{
+}
+
+bool CTxReconState::AddTx(const uint256& txid, bool fFlooded)
+{
+    if (fFlooding)
+        return false;
+    if (mapQueued.size() >= MAX_RECON_QUEUE_SIZE && !mapQueued.count(txid))
+        return false;
+    mapQueued[txid] |= fFlooded;
+    return true;
+}
+
+uint64_t CTxReconState::StartRound(int64_t nNow)
+{
+    assert(fInitiator && !fRoundOpen && !fFlooding);
+    nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    fRoundOpen = true;
+    nRoundStart = nNow;
+    return nSalt;
+}
+
+bool CTxReconState::HandleSketch(const CTxSketch& sketch, std::vector<uint32_t>& vWanted, std::vector<uint256>& vAnnounce)
+{
+    assert(fInitiator && fRoundOpen);
+    fRoundOpen = false;
+    vWanted.clear();
+    vAnnounce.clear();
+
+    std::map<uint32_t, std::pair<uint256, bool>> mapLocal;
+    for (const std::pair<const uint256, bool>& item : mapQueued) {
+        if (!mapLocal.emplace(GetReconShortId(nSalt, item.first), item).second && !item.second)
+            vAnnounce.push_back(item.first);
+    }
+    mapQueued.clear();
+
+    std::vector<uint32_t> vLocalOnly;
+    bool fSuccess = false;
+    const size_t nCells = sketch.GetCellCount();
+    if (nCells > 0 && nCells % 3 == 0 && nCells <= MAX_SKETCH_CELLS) {
+        CTxSketch local(nCells);
+        for (const std::pair<const uint32_t, std::pair<uint256, bool>>& item : mapLocal)
+            local.Add(item.first);
+        CTxSketch diff(sketch);
+        fSuccess = diff.Subtract(local) && diff.Decode(vWanted, vLocalOnly);
+    }
+
+    if (!fSuccess) {
+        // Ask for a larger sketch next time
+        nQ = std::min<uint32_t>(std::max<uint32_t>(nQ * 2, DEFAULT_RECON_Q), std::numeric_limits<uint16_t>::max());
+        vWanted.clear();
+        for (const std::pair<const uint32_t, std::pair<uint256, bool>>& item : mapLocal) {
+            if (!item.second.second)
+                vAnnounce.push_back(item.second.first);
+        }
+        return false;
+    }
+
+    // The peer's queue was what we share plus what only it had
+    const size_t nLocalSize = mapLocal.size();
+    const size_t nRemoteSize = nLocalSize - std::min(vLocalOnly.size(), nLocalSize) + vWanted.size();
+    const size_t nMin = std::min(nLocalSize, nRemoteSize);
+    const size_t nMax = std::max(nLocalSize, nRemoteSize);
+    if (nMin > 0) {
+        const size_t nExtra = vWanted.size() + vLocalOnly.size() - (nMax - nMin);
+        // Smoothed, as a single round is a small sample
+        nQ = std::min<uint64_t>((nQ + nExtra * RECON_Q_PRECISION / nMin) / 2, std::numeric_limits<uint16_t>::max());
+    }
+
+    for (uint32_t nShortId : vLocalOnly) {
+        std::map<uint32_t, std::pair<uint256, bool>>::const_iterator it = mapLocal.find(nShortId);
+        if (it != mapLocal.end() && !it->second.second)
+            vAnnounce.push_back(it->second.first);
+    }
+    return true;
+}
+
+CTxSketch CTxReconState::HandleRequest(uint64_t nSaltIn, uint32_t nRemoteSize, uint16_t nRemoteQ, int64_t nNow, std::vector<uint256>& vAnnounce)
+{
+    assert(!fInitiator && !fRoundOpen && !fFlooding);
+    fRoundOpen = true;
+    nRoundStart = nNow;
+    nSalt = nSaltIn;
+    vAnnounce.clear();
+    for (const std::pair<const uint256, bool>& item : mapQueued) {
+        if (!mapSketched.emplace(GetReconShortId(nSalt, item.first), item).second && !item.second)
+            vAnnounce.push_back(item.first);
+    }
+    mapQueued.clear();
+
+    // The difference is at least that of the queue sizes, plus the fraction q
+    // of the smaller queue the initiator saw missing on the other side last time.
+    const size_t nLocalSize = mapSketched.size();
+    const size_t nMin = std::min<size_t>(nLocalSize, nRemoteSize);
+    const size_t nMax = std::max<size_t>(nLocalSize, nRemoteSize);
+    // The peer's figures are only trusted as far as our own queue goes, so a
+    // request can not make us send more than a sketch of it is worth.
+    const size_t nDifference = std::min<uint64_t>(nMax - nMin + (uint64_t)nMin * nRemoteQ / RECON_Q_PRECISION, 2 * nLocalSize);
+    CTxSketch sketch(std::min(CTxSketch::CellsForDifference(nDifference), MAX_SKETCH_CELLS));
+    for (const std::pair<const uint32_t, std::pair<uint256, bool>>& item : mapSketched)
+        sketch.Add(item.first);
+    return sketch;
+}
+
+void CTxReconState::HandleDiff(bool fSuccess, const std::vector<uint32_t>& vWanted, std::vector<uint256>& vAnnounce)
+{
+    assert(!fInitiator && fRoundOpen);
+    fRoundOpen = false;
+    vAnnounce.clear();
+    if (fSuccess) {
+        for (uint32_t nShortId : vWanted) {
+            std::map<uint32_t, std::pair<uint256, bool>>::const_iterator it = mapSketched.find(nShortId);
+            if (it != mapSketched.end() && !it->second.second)
+                vAnnounce.push_back(it->second.first);
+        }
+    } else {
+        for (const std::pair<const uint32_t, std::pair<uint256, bool>>& item : mapSketched) {
+            if (!item.second.second)
+                vAnnounce.push_back(item.second.first);
+        }
+    }
+    mapSketched.clear();
+}
+
+bool CTxReconState::ExpireRound(int64_t nNow, std::vector<uint256>& vAnnounce)
+{
+    vAnnounce.clear();
+    if (!fRoundOpen || nRoundStart + RECON_ROUND_TIMEOUT * 1000000LL >= nNow)
+        return false;
+    fRoundOpen = false;
+    fFlooding = true;
+    for (const std::pair<const uint256, bool>& item : mapQueued) {
+        if (!item.second)
+            vAnnounce.push_back(item.first);
+    }
+    for (const std::pair<const uint32_t, std::pair<uint256, bool>>& item : mapSketched) {
+        if (!item.second.second)
+            vAnnounce.push_back(item.second.first);
+    }
+    mapQueued.clear();
+    mapSketched.clear();
+    return true;
+}
@@ -0,0 +1,180 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** Average delay between reconciliation rounds started with an outbound peer, in seconds */
+static const int RECON_INTERVAL = 8;
+/** Number of outbound reconciling peers a new transaction is still flooded to */
+static const int MAX_RECON_FLOOD_PEERS = 2;
+/** Time a round may stay open before reconciliation with the peer gives way to flooding, in seconds */
+static const int RECON_ROUND_TIMEOUT = 60;
+/** Maximum number of transactions queued for reconciliation with one peer; further ones are flooded */
+static const size_t MAX_RECON_QUEUE_SIZE = 10000;
+/** Maximum number of cells in a sketch we accept */
+static const size_t MAX_SKETCH_CELLS = 3 * MAX_RECON_QUEUE_SIZE;
+/** Fixed-point scale of q, the expected fraction of the smaller queue not in the other one */
+static const uint16_t RECON_Q_PRECISION = 1 << 12;
+/** q before the first round with a peer */
+static const uint16_t DEFAULT_RECON_Q = RECON_Q_PRECISION / 4;
+
+/** Short ID of a transaction in the reconciliation round using the given salt */
+uint32_t GetReconShortId(uint64_t nSalt, const uint256& txid);
+
+/**
+ * Invertible Bloom lookup table over 32-bit short IDs. A sketch of one set
+ * minus a sketch of another with the same number of cells decodes to the
+ * symmetric difference of the sets, as long as the difference is small
+ * compared to the number of cells. Its size does not depend on the size of
+ * the sets themselves.
+ */
+class CTxSketch
+{
+public:
+    CTxSketch() {}
+    explicit CTxSketch(size_t nCells);
+
+    /** Number of cells needed to decode a difference of about nDifference elements */
+    static size_t CellsForDifference(size_t nDifference);
+
+    void Add(uint32_t nShortId);
+    /** Remove the elements of a sketch with the same number of cells */
+    bool Subtract(const CTxSketch& other);
+    /**
+     * Recover the elements added to this sketch but not subtracted (vAdded),
+     * and those subtracted but never added (vRemoved). Returns false if the
+     * difference is too large for the sketch.
+     */
+    bool Decode(std::vector<uint32_t>& vAdded, std::vector<uint32_t>& vRemoved) const;
+
+    size_t GetCellCount() const { return vCells.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(vCells);
+    }
+
+private:
+    struct Cell {
+        int16_t nCount;
+        uint32_t nKeySum;
+        uint32_t nHashSum;
+
+        Cell() : nCount(0), nKeySum(0), nHashSum(0) {}
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(nCount);
+            READWRITE(nKeySum);
+            READWRITE(nHashSum);
+        }
+    };
+
+    std::vector<Cell> vCells;
+
+    //! Index of the i-th of the three cells an element goes in
+    static size_t CellIndex(size_t nCells, uint32_t nShortId, int i);
+    static void Update(std::vector<Cell>& cells, uint32_t nShortId, int16_t nDelta);
+    //! Whether a cell holds exactly one element, added or removed
+    static bool IsPure(const Cell& cell);
+};
+
+/**
+ * Transaction reconciliation with one peer. Transactions we relay are queued
+ * for the peer instead of (or, for the few peers we still flood to, as well
+ * as) being announced by INV. The side that made the connection periodically
+ * sends a salt, the size of its queue and q as measured in the last round;
+ * the other side answers with a sketch of its queue sized from those, which
+ * the initiator subtracts its own from and decodes. The initiator then asks for what only the peer has and announces
+ * what only it has, so transactions both sides already know cost nothing.
+ * If decoding fails both sides announce their whole queue. Rounds do not
+ * overlap: the initiator only starts one once the last sketch arrived, and
+ * the responder only answers one once the last difference arrived, so a
+ * sketch is always decoded with the salt it was made with. A round the peer
+ * leaves open for RECON_ROUND_TIMEOUT is given up on together with
+ * reconciliation itself: what is queued is announced, and so is everything
+ * after it, so no late answer can be taken for one in a newer round.
+ * Transactions whose short IDs collide with another's in the same queue
+ * can not be told apart in a sketch, and are announced instead.
+ *
+ * Not thread-safe; net_processing keeps it in CNodeState under cs_main.
+ */
+class CTxReconState
+{
+public:
+    explicit CTxReconState(bool fInitiatorIn);
+
+    bool IsInitiator() const { return fInitiator; }
+    size_t GetQueueSize() const { return mapQueued.size(); }
+    /** Whether a round timed out and transactions are only flooded to the peer now */
+    bool IsFlooding() const { return fFlooding; }
+
+    /**
+     * Queue a transaction for the next round; fFlooded if it is also being
+     * announced by INV. Returns false if the queue is full or IsFlooding(),
+     * in which case the transaction should be announced by INV.
+     */
+    bool AddTx(const uint256& txid, bool fFlooded);
+
+    /** Initiator: start a round at nNow (in microseconds), returning the salt to send */
+    uint64_t StartRound(int64_t nNow);
+    /** Initiator: q to send with the request */
+    uint16_t GetQ() const { return nQ; }
+    /** Whether the initiator is waiting for a sketch, or the responder for the difference */
+    bool IsRoundOpen() const { return fRoundOpen; }
+    /**
+     * Initiator: finish the open round with the peer's sketch. Fills the short
+     * IDs to request and the transactions to announce, including those whose
+     * short IDs collided, and returns whether the difference could be decoded.
+     */
+    bool HandleSketch(const CTxSketch& sketch, std::vector<uint32_t>& vWanted, std::vector<uint256>& vAnnounce);
+
+    /**
+     * Responder: snapshot the queue and sketch it for the peer's round,
+     * opened at nNow (in microseconds). The sketch is never sized for more
+     * than twice the queue, whatever the peer claims about its own. Fills the
+     * transactions left out because their short IDs collided, to announce.
+     */
+    CTxSketch HandleRequest(uint64_t nSaltIn, uint32_t nRemoteSize, uint16_t nRemoteQ, int64_t nNow, std::vector<uint256>& vAnnounce);
+    /** Responder: the peer's result for the last sketch; fills the transactions to announce */
+    void HandleDiff(bool fSuccess, const std::vector<uint32_t>& vWanted, std::vector<uint256>& vAnnounce);
+
+    /**
+     * Switch to flooding if a round has been open since before nNow (in
+     * microseconds) minus RECON_ROUND_TIMEOUT. Returns whether it did, and
+     * fills the transactions still waiting to be reconciled, to announce.
+     */
+    bool ExpireRound(int64_t nNow, std::vector<uint256>& vAnnounce);
+
+private:
+    const bool fInitiator;
+    //! Transactions for the next round, and whether each was flooded
+    std::map<uint256, bool> mapQueued;
+    uint64_t nSalt;
+    bool fRoundOpen;
+    //! When the open round was started or answered, in microseconds
+    int64_t nRoundStart;
+    bool fFlooding;
+    //! Initiator: q measured in the last successful round
+    uint16_t nQ;
+    //! Responder: transactions in the last sketch sent, by short ID
+    std::map<uint32_t, std::pair<uint256, bool>> mapSketched;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -42,7 +42,9 @@
 #include "versionbits.h"
 #include "warnings.h"
 
+#include <algorithm>
 #include <atomic>
+#include <set>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -57,7 +59,8 @@
  * Global state
  */
 
-CCriticalSection cs_main;
+// Held time is added up per thread, for the per-message costs in getpeerinfo
+CCriticalSection cs_main(true);
 
 BlockMap mapBlockIndex;
 CChain chainActive;
@@ -1038,6 +1041,64 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+CRawBlockReader::CRawBlockReader() : nFile(-1)
+{
+}
+
+CRawBlockReader::~CRawBlockReader()
+{
+}
+
+bool CRawBlockReader::Read(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // Go to the index header written by WriteBlockToDisk
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (file && nFile == hpos.nFile) {
+        if (fseek(file->Get(), hpos.nPos, SEEK_SET)) {
+            file.reset();
+            return error("CRawBlockReader::Read: fseek failed for %s", pos.ToString());
+        }
+    } else {
+        file.reset(new CAutoFile(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION));
+        nFile = hpos.nFile;
+        if (file->IsNull()) {
+            file.reset();
+            return error("CRawBlockReader::Read: OpenBlockFile failed for %s", pos.ToString());
+        }
+    }
+
+    try {
+        CMessageHeader::MessageStartChars blkStart;
+        unsigned int nSize;
+        *file >> FLATDATA(blkStart) >> nSize;
+        if (memcmp(blkStart, messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+            return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_SIZE)
+            return error("%s: Block size %u too large at %s", __func__, nSize, pos.ToString());
+
+        block.resize(nSize);
+        file->read((char*)block.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        file.reset();
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    CRawBlockReader reader;
+    return reader.Read(block, pos, messageStart);
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    return ReadRawBlockFromDisk(block, pindex->GetBlockPos(), messageStart);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -4342,6 +4403,59 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 }
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of stored transactions LoadMempool verifies and accepts at a time */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+void PreVerifyTransactionScripts(const std::vector<CTransactionRef>& vtx)
+{
+    if (nScriptCheckThreads == 0)
+        return;
+
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vtx.size()); // CScriptCheck keeps pointers into this vector
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsView dummy;
+        CCoinsViewCache view(&dummy);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        view.SetBackend(viewMemPool);
+        view.GetBestBlock(); // Bring the best block into scope for GetSpendHeight
+
+        std::set<uint256> setHashes;
+        for (const CTransactionRef& tx : vtx) {
+            // Adding the same transaction's coins twice would throw
+            if (!setHashes.insert(tx->GetHash()).second)
+                continue;
+            bool fHaveInputs = true;
+            for (const CTxIn& txin : tx->vin) {
+                // HaveCoin also pulls the coin into the cache
+                if (!view.HaveCoin(txin.prevout)) {
+                    fHaveInputs = false;
+                    break;
+                }
+            }
+            if (fHaveInputs && !tx->IsCoinBase()) {
+                CValidationState state;
+                txdata.emplace_back(*tx);
+                std::vector<CScriptCheck> vTxChecks;
+                if (CheckInputs(*tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata.back(), &vTxChecks)) {
+                    for (CScriptCheck& check : vTxChecks) {
+                        vChecks.push_back(CScriptCheck());
+                        check.swap(vChecks.back());
+                    }
+                }
+            }
+            // Later transactions in the batch may spend this one
+            AddCoins(view, *tx, MEMPOOL_HEIGHT);
+        }
+    }
+
+    // Failures are not interesting here; AcceptToMemoryPool reports them.
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
 
 bool LoadMempool(void)
 {
@@ -4367,30 +4481,51 @@ bool LoadMempool(void)
         }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        std::vector<CTransactionRef> vBatch;
+        std::vector<int64_t> vBatchTime;
+        while (num) {
+            // Read a batch of unexpired transactions, check their scripts in
+            // parallel, then accept them in file order under one cs_main lock.
+            while (num && vBatch.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                --num;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vBatch.push_back(tx);
+                    vBatchTime.push_back(nTime);
+                } else {
+                    ++skipped;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+
+            // The batch is in file order, so parents come before their children
+            PreVerifyTransactionScripts(vBatch);
+            if (ShutdownRequested())
+                return false;
+
+            {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, true, nullptr, nTime, nullptr, false, 0);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
+                for (size_t i = 0; i < vBatch.size(); i++) {
+                    CValidationState state;
+                    AcceptToMemoryPoolWithTime(chainparams, mempool, state, vBatch[i], true, nullptr, vBatchTime[i], nullptr, false, 0);
+                    if (state.IsValid()) {
+                        ++count;
+                    } else {
+                        ++failed;
+                    }
                 }
-            } else {
-                ++skipped;
             }
+            vBatch.clear();
+            vBatchTime.clear();
             if (ShutdownRequested())
                 return false;
         }
@@ -4414,15 +4549,29 @@ void DumpMempool(void)
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    CTxMemPoolSnapshotRef snapshot;
 
     {
         LOCK(mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
-        vinfo = mempool.infoAll();
+        snapshot = mempool.GetSnapshot();
+    }
+
+    // Parents have fewer in-mempool ancestors than their children, so this
+    // order lets LoadMempool accept the transactions in file order.
+    std::vector<const CTxMemPoolEntry*> vEntries;
+    vEntries.reserve(snapshot->vEntries.size());
+    for (const CTxMemPoolSnapshot::Entry& snapshotEntry : snapshot->vEntries) {
+        vEntries.push_back(&snapshotEntry.entry);
     }
+    std::sort(vEntries.begin(), vEntries.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors()) {
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        }
+        return CompareTxMemPoolEntryByScore()(*a, *b);
+    });
 
     int64_t mid = GetTimeMicros();
 
@@ -4437,12 +4586,12 @@ void DumpMempool(void)
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
+        file << (uint64_t)vEntries.size();
+        for (const CTxMemPoolEntry* entry : vEntries) {
+            file << entry->GetTx();
+            file << (int64_t)entry->GetTime();
+            file << (int64_t)(entry->GetModifiedFee() - entry->GetFee());
+            mapDeltas.erase(entry->GetTx().GetHash());
         }
 
         file << mapDeltas;
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -30,6 +31,7 @@
 
 #include <atomic>
 
+class CAutoFile;
 class CBlockIndex;
 class CBlockTreeDB;
 class CChainParams;
@@ -80,8 +82,15 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Number of blocks that can be requested at any given time from a single peer whose download speed is not yet known. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the number of blocks in flight from a single peer once its download speed is known. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 64;
+/** Amount of download time (in microseconds) to keep queued at each peer, at its measured speed. */
+static const int64_t BLOCK_DOWNLOAD_QUEUE_TIME = 4 * 1000000;
+/** Minimum time (in microseconds) a block must have been outstanding before it is requested again from a faster peer. */
+static const int64_t BLOCK_REREQUEST_MIN_TIME = 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -396,6 +405,28 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read the serialized bytes of a block as stored, without deserializing it
+ * or checking its proof of work. The stored format includes witness data.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+
+/**
+ * Reads stored blocks like ReadRawBlockFromDisk, but keeps the last block file
+ * open, so that reading many blocks in a row does not reopen it for each.
+ */
+class CRawBlockReader
+{
+public:
+    CRawBlockReader();
+    ~CRawBlockReader();
+    bool Read(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+
+private:
+    std::unique_ptr<CAutoFile> file;
+    int nFile;
+};
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -477,6 +508,15 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
+/**
+ * Verify the scripts of a batch of transactions against the chain tip and
+ * mempool on the script check threads. This only warms the signature cache:
+ * acceptance itself still goes through AcceptToMemoryPool, which then finds
+ * the signatures cached. Parents must come before their children in vtx;
+ * repeated transactions are only verified once.
+ */
+void PreVerifyTransactionScripts(const std::vector<CTransactionRef>& vtx);
+
 /** Dump the mempool to disk. */
 void DumpMempool();
 
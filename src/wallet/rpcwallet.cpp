@@ -16,6 +16,7 @@
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "policy/rbf.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/mining.h"
 #include "rpc/server.h"
 #include "script/sign.h"
@@ -1639,16 +1640,54 @@ UniValue listtransactions(const JSONRPCRequest& request)
     UniValue ret(UniValue::VARR);
 
     const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
-    {
+    auto listItem = [&](CWallet::TxItems::const_reverse_iterator it, UniValue& entries) {
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
-            ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+            ListTransactions(pwallet, *pwtx, strAccount, 0, true, entries, filter);
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, entries);
+    };
+
+    if (request.stream) {
+        // The range is counted from the newest entry but returned oldest
+        // first. Find the wallet items it covers, keeping only where their
+        // entries fall, then render them again oldest first as they are
+        // written, so the result is never held in memory as a whole.
+        struct Item {
+            CWallet::TxItems::const_reverse_iterator it;
+            int nPos;
+            int nEntries;
+        };
+        std::vector<Item> vItems;
+        int nPos = 0;
+        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend() && nPos < nCount + nFrom; ++it) {
+            UniValue entries(UniValue::VARR);
+            listItem(it, entries);
+            vItems.push_back(Item{it, nPos, (int)entries.size()});
+            nPos += entries.size();
+        }
+        const int nEnd = std::min(nPos, nFrom + nCount);
+
+        request.stream->BeginArray();
+        for (std::vector<Item>::const_reverse_iterator item = vItems.rbegin(); item != vItems.rend(); ++item) {
+            if (item->nEntries == 0 || item->nPos >= nEnd || item->nPos + item->nEntries <= nFrom)
+                continue;
+            UniValue entries(UniValue::VARR);
+            listItem(item->it, entries);
+            for (int i = item->nEntries - 1; i >= 0; i--) {
+                if (item->nPos + i >= nFrom && item->nPos + i < nEnd)
+                    request.stream->Value(entries[i]);
+            }
+        }
+        request.stream->EndArray();
+        return NullUniValue;
+    }
+
+    // iterate backwards until we have nCount items to return:
+    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    {
+        listItem(it, ret);
 
         if ((int)ret.size() >= (nCount+nFrom)) break;
     }
@@ -2730,6 +2769,8 @@ UniValue listunspent(const JSONRPCRequest& request)
     LOCK2(cs_main, pwallet->cs_wallet);
 
     pwallet->AvailableCoins(vecOutputs, !include_unsafe, nullptr, nMinimumAmount, nMaximumAmount, nMinimumSumAmount, nMaximumCount, nMinDepth, nMaxDepth);
+    if (request.stream)
+        request.stream->BeginArray();
     for (const COutput& out : vecOutputs) {
         CTxDestination address;
         const CScript& scriptPubKey = out.tx->tx->vout[out.i].scriptPubKey;
@@ -2764,8 +2805,13 @@ UniValue listunspent(const JSONRPCRequest& request)
         entry.push_back(Pair("spendable", out.fSpendable));
         entry.push_back(Pair("solvable", out.fSolvable));
         entry.push_back(Pair("safe", out.fSafe));
-        results.push_back(entry);
+        if (request.stream)
+            request.stream->Value(entry);
+        else
+            results.push_back(entry);
     }
+    if (request.stream)
+        request.stream->EndArray();
 
     return results;
 }
@@ -3145,60 +3191,60 @@ extern UniValue removeprunedfunds(const JSONRPCRequest& request);
 extern UniValue importmulti(const JSONRPCRequest& request);
 
 static const CRPCCommand commands[] =
-{ //  category              name                        actor (function)           okSafeMode
-    //  --------------------- ------------------------    -----------------------    ----------
-    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false,  {"hexstring","options"} },
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,   {} },
-    { "wallet",             "abandontransaction",       &abandontransaction,       false,  {"txid"} },
-    { "wallet",             "abortrescan",              &abortrescan,              false,  {} },
-    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,   {"nrequired","keys","account"} },
-    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,   {"address"} },
-    { "wallet",             "backupwallet",             &backupwallet,             true,   {"destination"} },
-    { "wallet",             "bumpfee",                  &bumpfee,                  true,   {"txid", "options"} },
-    { "wallet",             "dumpprivkey",              &dumpprivkey,              true,   {"address"}  },
-    { "wallet",             "dumpwallet",               &dumpwallet,               true,   {"filename"} },
-    { "wallet",             "encryptwallet",            &encryptwallet,            true,   {"passphrase"} },
-    { "wallet",             "getaccountaddress",        &getaccountaddress,        true,   {"account"} },
-    { "wallet",             "getaccount",               &getaccount,               true,   {"address"} },
-    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true,   {"account"} },
-    { "wallet",             "getbalance",               &getbalance,               false,  {"account","minconf","include_watchonly"} },
-    { "wallet",             "getnewaddress",            &getnewaddress,            true,   {"account"} },
-    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,   {} },
-    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,  {"account","minconf"} },
-    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,  {"address","minconf"} },
-    { "wallet",             "gettransaction",           &gettransaction,           false,  {"txid","include_watchonly"} },
-    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,  {} },
-    { "wallet",             "getwalletinfo",            &getwalletinfo,            false,  {} },
-    { "wallet",             "importmulti",              &importmulti,              true,   {"requests","options"} },
-    { "wallet",             "importprivkey",            &importprivkey,            true,   {"privkey","label","rescan"} },
-    { "wallet",             "importwallet",             &importwallet,             true,   {"filename"} },
-    { "wallet",             "importaddress",            &importaddress,            true,   {"address","label","rescan","p2sh"} },
-    { "wallet",             "importprunedfunds",        &importprunedfunds,        true,   {"rawtransaction","txoutproof"} },
-    { "wallet",             "importpubkey",             &importpubkey,             true,   {"pubkey","label","rescan"} },
-    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,   {"newsize"} },
-    { "wallet",             "listaccounts",             &listaccounts,             false,  {"minconf","include_watchonly"} },
-    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false,  {} },
-    { "wallet",             "listlockunspent",          &listlockunspent,          false,  {} },
-    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false,  {"minconf","include_empty","include_watchonly"} },
-    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false,  {"minconf","include_empty","include_watchonly"} },
-    { "wallet",             "listsinceblock",           &listsinceblock,           false,  {"blockhash","target_confirmations","include_watchonly","include_removed"} },
-    { "wallet",             "listtransactions",         &listtransactions,         false,  {"account","count","skip","include_watchonly"} },
-    { "wallet",             "listunspent",              &listunspent,              false,  {"minconf","maxconf","addresses","include_unsafe","query_options"} },
-    { "wallet",             "listwallets",              &listwallets,              true,   {} },
-    { "wallet",             "lockunspent",              &lockunspent,              true,   {"unlock","transactions"} },
-    { "wallet",             "move",                     &movecmd,                  false,  {"fromaccount","toaccount","amount","minconf","comment"} },
-    { "wallet",             "sendfrom",                 &sendfrom,                 false,  {"fromaccount","toaddress","amount","minconf","comment","comment_to"} },
-    { "wallet",             "sendmany",                 &sendmany,                 false,  {"fromaccount","amounts","minconf","comment","subtractfeefrom","replaceable","conf_target","estimate_mode"} },
-    { "wallet",             "sendtoaddress",            &sendtoaddress,            false,  {"address","amount","comment","comment_to","subtractfeefromamount","replaceable","conf_target","estimate_mode"} },
-    { "wallet",             "setaccount",               &setaccount,               true,   {"address","account"} },
-    { "wallet",             "settxfee",                 &settxfee,                 true,   {"amount"} },
-    { "wallet",             "signmessage",              &signmessage,              true,   {"address","message"} },
-    { "wallet",             "walletlock",               &walletlock,               true,   {} },
-    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true,   {"oldpassphrase","newpassphrase"} },
-    { "wallet",             "walletpassphrase",         &walletpassphrase,         true,   {"passphrase","timeout"} },
-    { "wallet",             "removeprunedfunds",        &removeprunedfunds,        true,   {"txid"} },
-
-    { "generating",         "generate",                 &generate,                 true,   {"nblocks","maxtries"} },
+{ //  category              name                        actor (function)           okSafe  readOnly argNames
+    //  --------------------- ------------------------    -----------------------    ------  -------- ----------
+    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false,  false,   {"hexstring","options"} },
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,   false,   {} },
+    { "wallet",             "abandontransaction",       &abandontransaction,       false,  false,   {"txid"} },
+    { "wallet",             "abortrescan",              &abortrescan,              false,  false,   {} },
+    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,   false,   {"nrequired","keys","account"} },
+    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,   false,   {"address"} },
+    { "wallet",             "backupwallet",             &backupwallet,             true,   false,   {"destination"} },
+    { "wallet",             "bumpfee",                  &bumpfee,                  true,   false,   {"txid", "options"} },
+    { "wallet",             "dumpprivkey",              &dumpprivkey,              true,   false,   {"address"}  },
+    { "wallet",             "dumpwallet",               &dumpwallet,               true,   false,   {"filename"} },
+    { "wallet",             "encryptwallet",            &encryptwallet,            true,   false,   {"passphrase"} },
+    { "wallet",             "getaccountaddress",        &getaccountaddress,        true,   false,   {"account"} },
+    { "wallet",             "getaccount",               &getaccount,               true,   true,    {"address"} },
+    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true,   true,    {"account"} },
+    { "wallet",             "getbalance",               &getbalance,               false,  true,    {"account","minconf","include_watchonly"} },
+    { "wallet",             "getnewaddress",            &getnewaddress,            true,   false,   {"account"} },
+    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,   false,   {} },
+    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,  true,    {"account","minconf"} },
+    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,  true,    {"address","minconf"} },
+    { "wallet",             "gettransaction",           &gettransaction,           false,  true,    {"txid","include_watchonly"} },
+    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,  true,    {} },
+    { "wallet",             "getwalletinfo",            &getwalletinfo,            false,  true,    {} },
+    { "wallet",             "importmulti",              &importmulti,              true,   false,   {"requests","options"} },
+    { "wallet",             "importprivkey",            &importprivkey,            true,   false,   {"privkey","label","rescan"} },
+    { "wallet",             "importwallet",             &importwallet,             true,   false,   {"filename"} },
+    { "wallet",             "importaddress",            &importaddress,            true,   false,   {"address","label","rescan","p2sh"} },
+    { "wallet",             "importprunedfunds",        &importprunedfunds,        true,   false,   {"rawtransaction","txoutproof"} },
+    { "wallet",             "importpubkey",             &importpubkey,             true,   false,   {"pubkey","label","rescan"} },
+    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,   false,   {"newsize"} },
+    { "wallet",             "listaccounts",             &listaccounts,             false,  true,    {"minconf","include_watchonly"} },
+    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false,  true,    {} },
+    { "wallet",             "listlockunspent",          &listlockunspent,          false,  true,    {} },
+    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false,  true,    {"minconf","include_empty","include_watchonly"} },
+    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false,  true,    {"minconf","include_empty","include_watchonly"} },
+    { "wallet",             "listsinceblock",           &listsinceblock,           false,  true,    {"blockhash","target_confirmations","include_watchonly","include_removed"} },
+    { "wallet",             "listtransactions",         &listtransactions,         false,  true,    {"account","count","skip","include_watchonly"} },
+    { "wallet",             "listunspent",              &listunspent,              false,  true,    {"minconf","maxconf","addresses","include_unsafe","query_options"} },
+    { "wallet",             "listwallets",              &listwallets,              true,   true,    {} },
+    { "wallet",             "lockunspent",              &lockunspent,              true,   false,   {"unlock","transactions"} },
+    { "wallet",             "move",                     &movecmd,                  false,  false,   {"fromaccount","toaccount","amount","minconf","comment"} },
+    { "wallet",             "sendfrom",                 &sendfrom,                 false,  false,   {"fromaccount","toaddress","amount","minconf","comment","comment_to"} },
+    { "wallet",             "sendmany",                 &sendmany,                 false,  false,   {"fromaccount","amounts","minconf","comment","subtractfeefrom","replaceable","conf_target","estimate_mode"} },
+    { "wallet",             "sendtoaddress",            &sendtoaddress,            false,  false,   {"address","amount","comment","comment_to","subtractfeefromamount","replaceable","conf_target","estimate_mode"} },
+    { "wallet",             "setaccount",               &setaccount,               true,   false,   {"address","account"} },
+    { "wallet",             "settxfee",                 &settxfee,                 true,   false,   {"amount"} },
+    { "wallet",             "signmessage",              &signmessage,              true,   false,   {"address","message"} },
+    { "wallet",             "walletlock",               &walletlock,               true,   false,   {} },
+    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true,   false,   {"oldpassphrase","newpassphrase"} },
+    { "wallet",             "walletpassphrase",         &walletpassphrase,         true,   false,   {"passphrase","timeout"} },
+    { "wallet",             "removeprunedfunds",        &removeprunedfunds,        true,   false,   {"txid"} },
+
+    { "generating",         "generate",                 &generate,                 true,   false,   {"nblocks","maxtries"} },
 };
 
 void RegisterWalletRPCCommands(CRPCTable &t)
@@ -21,9 +21,9 @@ def deser_uint256(f):
     return r
 
 #allows simple http get calls
-def http_get_call(host, port, path, response_object = 0):
+def http_get_call(host, port, path, response_object = 0, headers = {}):
     conn = http.client.HTTPConnection(host, port)
-    conn.request('GET', path)
+    conn.request('GET', path, headers=headers)
 
     if response_object:
         return conn.getresponse()
@@ -221,6 +221,13 @@ class RESTTest (BitcoinTestFramework):
         response_hex_str = response_hex.read()
         assert_equal(encode(response_str, "hex_codec")[0:160], response_hex_str[0:160])
 
+        # an unchanged block is revalidated by its ETag without being sent again
+        etag = response_hex.getheader('etag')
+        response_hex = http_get_call(url.hostname, url.port, '/rest/block/'+bb_hash+self.FORMAT_SEPARATOR+"hex", True, {'If-None-Match': etag})
+        assert_equal(response_hex.status, 304)
+        assert_equal(response_hex.getheader('etag'), etag)
+        assert_equal(response_hex.read(), b'')
+
         # compare with hex block header
         response_header_hex = http_get_call(url.hostname, url.port, '/rest/headers/1/'+bb_hash+self.FORMAT_SEPARATOR+"hex", True)
         assert_equal(response_header_hex.status, 200)
@@ -265,6 +272,34 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(response_header_json_str)
         assert_equal(len(json_obj), 5) #now we should have 5 header objects
 
+        # get the last 5 blocks and headers by height
+        tip_height = self.nodes[0].getblockcount()
+        response = http_get_call(url.hostname, url.port, '/rest/headerrange/'+str(tip_height - 4)+'/10'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 200)
+        headers_str = response.read()
+        assert_equal(len(headers_str), 5*80) #the range ends at the tip
+
+        response = http_get_call(url.hostname, url.port, '/rest/blockrange/'+str(tip_height - 4)+'/5'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 200)
+        blocks_str = response.read()
+        expected_str = b''
+        for height in range(tip_height - 4, tip_height + 1):
+            block_hash = self.nodes[0].getblockhash(height)
+            expected_str += http_get_call(url.hostname, url.port, '/rest/block/'+block_hash+self.FORMAT_SEPARATOR+"bin", True).read()
+        assert_equal(blocks_str, expected_str)
+        assert_equal(blocks_str[0:80], headers_str[0:80])
+
+        response = http_get_call(url.hostname, url.port, '/rest/blockrange/'+str(tip_height + 1)+'/1'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 404)
+
+        # a count that would overflow the end height is clamped to the tip
+        response = http_get_call(url.hostname, url.port, '/rest/blockrange/'+str(tip_height - 4)+'/9223372036854775807'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 200)
+        assert_equal(response.read(), blocks_str)
+        response = http_get_call(url.hostname, url.port, '/rest/headerrange/1/9223372036854775807'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 200)
+        assert_equal(len(response.read()), tip_height*80)
+
         # do tx test
         tx_hash = block_json_obj['tx'][0]['txid']
         json_string = http_get_call(url.hostname, url.port, '/rest/tx/'+tx_hash+self.FORMAT_SEPARATOR+"json")
@@ -298,10 +333,19 @@ class RESTTest (BitcoinTestFramework):
         for tx in txs:
             assert_equal(tx in json_obj, True)
 
+        # the JSON of a block depends on the tip, so its ETag changes with it
+        json_etag = http_get_call(url.hostname, url.port, '/rest/block/'+bb_hash+self.FORMAT_SEPARATOR+'json', True).getheader('etag')
+        response = http_get_call(url.hostname, url.port, '/rest/block/'+bb_hash+self.FORMAT_SEPARATOR+'json', True, {'If-None-Match': json_etag})
+        assert_equal(response.status, 304)
+
         # now mine the transactions
         newblockhash = self.nodes[1].generate(1)
         self.sync_all()
 
+        response = http_get_call(url.hostname, url.port, '/rest/block/'+bb_hash+self.FORMAT_SEPARATOR+'json', True, {'If-None-Match': json_etag})
+        assert_equal(response.status, 200)
+        assert(response.getheader('etag') != json_etag)
+
         #check if the 3 tx show up in the new block
         json_string = http_get_call(url.hostname, url.port, '/rest/block/'+newblockhash[0]+self.FORMAT_SEPARATOR+'json')
         json_obj = json.loads(json_string)